@@ -0,0 +1,137 @@
+// Generates big synthetic Dig programs for the benchmarks, usage: gen <kind> <size>
+// kinds: expressions, functions, strings, comments, arrays, mixed, vectors, library
+
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+
+// Statements made of long chains of binary operators
+void gen_expressions(size_t size)
+{
+	const char* ops = "+-*/";
+	printf("fun main()\n{\n\tint a = 1;\n");
+	for (size_t i = 0; i < size; i++)
+	{
+		printf("\ta = a");
+		for (size_t j = 0; j < 64; j++)
+			printf(" %c (a %c %zu)", ops[j % 4], ops[(j + i) % 4], j + 1);
+		printf(";\n");
+	}
+	printf("}\n");
+}
+
+// Lots of small functions and calls to them
+void gen_functions(size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		printf("fun f%zu(int a, b) : int\n{\n\tint c = a * %zu + b;\n\tif c > %zu\n\t{\n\t\treturn c - a;\n\t}\n\treturn c;\n}\n\n", i, i, i);
+
+	printf("fun main()\n{\n\tint a = 0;\n");
+	for (size_t i = 0; i < size; i++)
+		printf("\ta = f%zu(a, %zu);\n", i, i);
+	printf("}\n");
+}
+
+// Long string literals, with escapes
+void gen_strings(size_t size)
+{
+	printf("fun main()\n{\n");
+	for (size_t i = 0; i < size; i++)
+	{
+		printf("\tstr s%zu = \"", i);
+		for (size_t j = 0; j < 1024; j++)
+			printf(j % 64 == 63 ? "\\n" : "%c", (char)('a' + (i + j) % 26));
+		printf("\";\n");
+	}
+	printf("}\n");
+}
+
+// More comments than code
+void gen_comments(size_t size)
+{
+	printf("fun main()\n{\n\tint a = 0;\n");
+	for (size_t i = 0; i < size; i++)
+	{
+		printf("\t// This is a line comment number %zu that goes on for a while, like real comments do\n", i);
+		printf("\t/* And a block comment\n\t * spanning a few lines\n\t * number %zu\n\t */\n", i);
+		printf("\ta = a + %zu; // trailing comment\n", i);
+	}
+	printf("}\n");
+}
+
+// Big array literals
+void gen_arrays(size_t size)
+{
+	printf("fun main()\n{\n");
+	for (size_t i = 0; i < size; i++)
+	{
+		printf("\tarr a%zu = [", i);
+		for (size_t j = 0; j < 1024; j++)
+			printf(j ? ", %zu" : "%zu", i * j);
+		printf("];\n");
+	}
+	printf("}\n");
+}
+
+// A program to run rather than compile: element-wise loops and reductions over arrs of numbers, size times
+void gen_vectors(size_t size)
+{
+	printf("fun main()\n{\n\tint n = 100000;\n\tarr a = [0:n];\n\tarr b = [0:n];\n\tarr c = [0:n];\n\tvar k = 0.5;\n");
+	printf("\tfor int i : n { b[i] = (i * 3) - 7; }\n");
+	printf("\tvar s = 0;\n\tvar t = 0;\n");
+	printf("\tfor int r : %zu\n\t{\n", size);
+	printf("\t\tfor int i : n { c[i] = (a[i] * b[i]) + k; }\n");
+	printf("\t\tfor int i : n { s = s + (a[i] * b[i]); }\n");
+	printf("\t\tfor int i : n { t = t + (c[i] / 3); }\n");
+	printf("\t}\n\tprint(s, \" \", t, \" \", c[n - 1]);\n}\n");
+}
+
+// Big libraries that the program only calls a handful of functions from, size namespaces of 32 functions
+void gen_library(size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		printf("namespace lib%zu\n{\n\tvar scale = %zu;\n", i, i + 1);
+		for (size_t j = 0; j < 32; j++)
+		{
+			printf("\tfun f%zu(a, b = %zu)\n\t{\n\t\tvar s = 0;\n", j, j);
+			printf("\t\tfor int k : a\n\t\t{\n\t\t\tif k > b { break; }\n\t\t\ts = s + (k * scale);\n\t\t}\n");
+			printf(j ? "\t\treturn s + f%zu(a - 1, b);\n\t}\n" : "\t\treturn s;\n\t}\n", j - 1);
+		}
+		if (i % 16 == 0)
+			printf("\tprint(f%zu(10));\n", i % 32);
+		printf("}\n\n");
+	}
+	printf("fun main()\n{\n\tprint(\"done\");\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) { fprintf(stderr, "Usage: gen <expressions|functions|strings|comments|arrays|mixed|vectors|library> <size>\n"); exit(-1); }
+
+	string kind = argv[1];
+	size_t size = strtoull(argv[2], NULL, 10);
+
+	if (kind == "expressions") gen_expressions(size);
+	else if (kind == "functions") gen_functions(size);
+	else if (kind == "strings") gen_strings(size);
+	else if (kind == "comments") gen_comments(size);
+	else if (kind == "arrays") gen_arrays(size);
+	else if (kind == "vectors") gen_vectors(size);
+	else if (kind == "library") gen_library(size);
+	else if (kind == "mixed")
+	{
+		// Every generator defines main, so rename all of them but the last
+		printf("namespace expressions\n{\n"); gen_expressions(size / 4); printf("}\n");
+		printf("namespace strings\n{\n"); gen_strings(size / 16); printf("}\n");
+		printf("namespace comments\n{\n"); gen_comments(size); printf("}\n");
+		printf("namespace arrays\n{\n"); gen_arrays(size / 16); printf("}\n");
+		gen_functions(size);
+	}
+	else { fprintf(stderr, "Unknown kind: %s\n", kind.c_str()); exit(-1); }
+
+	return 0;
+}
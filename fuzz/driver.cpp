@@ -0,0 +1,150 @@
+// Runs a fuzz target without libFuzzer, on generated programs or on files, usage:
+//	driver [-n count] [-seed seed] [-timeout ms] [-rss mb] [-out dir] [files...]
+// Every input runs in its own process under a time and memory limit, inputs that crash, time out,
+// or get much slower than linearly when repeated are saved to the output directory
+
+#include "generator.hpp"
+
+#include <string>
+#include <fstream>
+#include <streambuf>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+using std::string;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+enum class Outcome { OK, CRASH, TIMEOUT, OUT_OF_MEMORY };
+
+static unsigned timeout_ms = 2000;
+static unsigned rss_limit_mb = 512;
+static string out_dir = "findings";
+
+// Run the input in a child process so crashes, hangs and exit()s don't take the driver down
+Outcome run(const string& input, double& ms)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	fflush(stdout); // Or the child flushes our buffered output a second time
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		struct rlimit limit;
+		limit.rlim_cur = limit.rlim_max = (rlim_t)rss_limit_mb * 1024 * 1024;
+		setrlimit(RLIMIT_AS, &limit);
+
+		struct itimerval timer = {};
+		timer.it_value.tv_sec = timeout_ms / 1000;
+		timer.it_value.tv_usec = (timeout_ms % 1000) * 1000;
+		setitimer(ITIMER_REAL, &timer, NULL);
+
+		// Compile errors are fine, the generator makes plenty of broken programs on purpose
+		freopen("/dev/null", "w", stdout);
+		freopen("/dev/null", "w", stderr);
+
+		LLVMFuzzerTestOneInput((const uint8_t*)input.data(), input.size());
+		_exit(0);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (WIFSIGNALED(status))
+	{
+		if (WTERMSIG(status) == SIGALRM) return Outcome::TIMEOUT;
+		return Outcome::CRASH;
+	}
+	// operator new throws bad_alloc when it hits the limit, which ends in abort() above, or in an exit code
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != 255)
+		return Outcome::OUT_OF_MEMORY;
+	return Outcome::OK;
+}
+
+void save(const char* kind, size_t n, const string& input)
+{
+	string path = out_dir + "/" + kind + "-" + std::to_string(n) + ".dg";
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == NULL) { fprintf(stderr, "Couldn't write %s\n", path.c_str()); return; }
+	fwrite(input.data(), 1, input.size(), f);
+	fclose(f);
+	printf("%s: %s\n", kind, path.c_str());
+}
+
+// Returns true if the input was fine
+bool check(const string& input, size_t n)
+{
+	double ms;
+	Outcome outcome = run(input, ms);
+
+	if (outcome == Outcome::CRASH) { save("crash", n, input); return false; }
+	if (outcome == Outcome::TIMEOUT) { save("timeout", n, input); return false; }
+	if (outcome == Outcome::OUT_OF_MEMORY) { save("oom", n, input); return false; }
+
+	// Inputs that take a measurable time get repeated 8 times, linear code takes about 8 times longer,
+	// give it 3 times that before calling it quadratic
+	if (ms >= 5)
+	{
+		string repeated;
+		for (int i = 0; i < 8; i++)
+			repeated += input + "\n";
+
+		double repeated_ms;
+		outcome = run(repeated, repeated_ms);
+		if (outcome != Outcome::OK || repeated_ms > ms * 8 * 3)
+		{
+			save("slow", n, input);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+string read_file(const char* path)
+{
+	std::ifstream f(path, std::ios::binary);
+	return string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = 1000;
+	unsigned seed = 1;
+	vector<const char*> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) count = strtoull(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-timeout") && i + 1 < argc) timeout_ms = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-rss") && i + 1 < argc) rss_limit_mb = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-out") && i + 1 < argc) out_dir = argv[++i];
+		else files.push_back(argv[i]);
+	}
+
+	size_t failures = 0;
+
+	if (!files.empty())
+	{
+		for (size_t i = 0; i < files.size(); i++)
+			failures += !check(read_file(files[i]), i);
+	}
+	else
+	{
+		for (size_t i = 0; i < count; i++)
+			failures += !check(ProgramGenerator(seed + i).program(), seed + i);
+	}
+
+	printf("%zu inputs, %zu failures\n", files.empty() ? count : files.size(), failures);
+	return failures ? 1 : 0;
+}
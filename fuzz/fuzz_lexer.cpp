@@ -0,0 +1,26 @@
+// libFuzzer target for the preprocessor and the lexer, build with -DDIG_FUZZING
+
+#include "../src/lexer/lexer.hpp"
+#include "../src/preprocessor/preprocessor.hpp"
+#include "generator.hpp"
+
+#include <stdint.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	string src((const char*)data, size);
+
+	try
+	{
+		preprocess(src);
+
+		Lexer lexer(src, "fuzz.dg");
+		Token tok;
+		while (lexer.get_token(tok)) ;
+	}
+	catch (const CompileError&) {}
+
+	return 0;
+}
+
+#include "mutator.inc"
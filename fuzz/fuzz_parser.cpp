@@ -0,0 +1,34 @@
+// libFuzzer target for everything up to the parser, build with -DDIG_FUZZING
+
+#include "../src/lexer/lexer.hpp"
+#include "../src/parser/parser.hpp"
+#include "../src/preprocessor/preprocessor.hpp"
+#include "generator.hpp"
+
+#include <stdint.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	string src((const char*)data, size);
+
+	try
+	{
+		preprocess(src);
+
+		Lexer lexer(src, "fuzz.dg");
+		Parser parser(&lexer);
+
+		vector<Token> tokens;
+		Token tok;
+		while (lexer.get_token(tok))
+			tokens.push_back(tok);
+		tokens.push_back(Token());
+
+		parser.parse(*make_token_list(tokens));
+	}
+	catch (const CompileError&) {}
+
+	return 0;
+}
+
+#include "mutator.inc"
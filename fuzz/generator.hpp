@@ -0,0 +1,199 @@
+#ifndef FUZZ_GENERATOR_HPP
+#define FUZZ_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <random>
+
+#include "../src/macros.hpp"
+
+using std::string;
+using std::vector;
+
+// Generates random Dig programs from the words in language.inc, most of them are close
+// enough to valid code to get deep into the parser, and some are mutated to hit the error paths
+class ProgramGenerator
+{
+private:
+	std::mt19937 rng;
+	int max_depth;
+
+	vector<string> vartypes;
+	vector<string> bin_ops;
+	vector<string> un_ops;
+	vector<string> words; // Every keyword, vartype and operator
+public:
+	ProgramGenerator(unsigned seed, int max_depth=8) : rng(seed), max_depth(max_depth)
+	{
+		#define KEYWORD(id, str) words.push_back(str);
+		#define VARTYPE(id, str) vartypes.push_back(str); words.push_back(str);
+		#define OPERATOR(id, str, type) words.push_back(str); \
+			if (type == LANG_BIN_OP || type == LANG_BIN_UN_OP) bin_ops.push_back(str); \
+			if (type == LANG_UN_OP || type == LANG_BIN_UN_OP) un_ops.push_back(str);
+		#include "../src/grammar/language.inc"
+		#undef KEYWORD
+		#undef VARTYPE
+		#undef OPERATOR
+	}
+
+	string program()
+	{
+		string s;
+		int count = 1 + rand(8);
+		for (int i = 0; i < count; i++)
+			s += top_level();
+
+		// Every fourth program gets broken a bit
+		if (rand(4) == 0)
+			s = mutate(s);
+		return s;
+	}
+
+	// Change the text in a way that keeps most of it intact
+	string mutate(string s)
+	{
+		if (s.empty()) return pick(words);
+
+		size_t at = rand(s.size());
+		size_t len = 1 + rand(std::min<size_t>(16, s.size() - at));
+		switch (rand(5))
+		{
+		case 0: s.erase(at, len); break;														// drop a slice
+		case 1: s.insert(at, s.substr(at, len)); break;											// duplicate a slice
+		case 2: s.insert(at, " " + pick(words) + " "); break;									// insert a random word
+		case 3: s.insert(at, string(1 + rand(64), "([{\"'"[rand(5)])); break;					// unbalanced nesting
+		case 4: s = s.substr(0, at); break;														// truncate
+		}
+		return s;
+	}
+private:
+	size_t rand(size_t n) { return n ? rng() % n : 0; }
+	const string& pick(const vector<string>& v) { return v[rand(v.size())]; }
+
+	string identifier()
+	{
+		static const char* names[] = { "a", "b", "i", "foo", "print", "_x1", "math", "value" };
+		return names[rand(sizeof(names) / sizeof(names[0]))];
+	}
+
+	string number()
+	{
+		switch (rand(7))
+		{
+		case 0: return std::to_string(rand(1000));
+		case 1: return std::to_string(rand(1000)) + "." + std::to_string(rand(100));
+		case 2: return "." + std::to_string(rand(100));
+		case 3: return "0x" + string(1 + rand(4), "0123456789abcdefABCDEF"[rand(22)]);
+		case 4: return "0b" + string(1 + rand(8), "01"[rand(2)]);
+		case 5: return "0o" + std::to_string(rand(777));
+		default: return rand(2) ? "'a'" : "'\\n'";
+		}
+	}
+
+	string string_literal()
+	{
+		static const char* parts[] = { "hello", " ", "\\n", "\\t", "\\\\", "\\\"", "\\0", "a = ", "%d" };
+		string s = "\"";
+		int count = rand(6);
+		for (int i = 0; i < count; i++)
+			s += parts[rand(sizeof(parts) / sizeof(parts[0]))];
+		return s + "\"";
+	}
+
+	string expression(int depth)
+	{
+		if (depth >= max_depth)
+			return rand(2) ? identifier() : number();
+
+		switch (rand(12))
+		{
+		case 0: return number();
+		case 1: return string_literal();
+		case 2: return identifier();
+		case 3: return rand(3) ? (rand(2) ? "true" : "false") : "null";
+		case 4: case 5: return expression(depth + 1) + " " + pick(bin_ops) + " " + expression(depth + 1);
+		case 6: return pick(un_ops) + expression(depth + 1);
+		case 7: return "(" + expression(depth + 1) + ")";
+		case 8:
+		{
+			string s = identifier() + "(";
+			int count = rand(4);
+			for (int i = 0; i < count; i++)
+				s += (i ? ", " : "") + expression(depth + 1);
+			return s + ")";
+		}
+		case 9:
+		{
+			string s = "[";
+			int count = rand(5);
+			for (int i = 0; i < count; i++)
+				s += (i ? ", " : "") + expression(depth + 1);
+			return s + "]";
+		}
+		case 10: return "[" + expression(depth + 1) + ":" + expression(depth + 1) + (rand(2) ? ":" + expression(depth + 1) : "") + "]";
+		default: return identifier() + (rand(2) ? " = " : " " + pick(bin_ops) + "= ") + expression(depth + 1);
+		}
+	}
+
+	string block(int depth)
+	{
+		string s = "{\n";
+		int count = rand(5);
+		for (int i = 0; i < count; i++)
+			s += statement(depth + 1);
+		return s + "}\n";
+	}
+
+	string statement(int depth)
+	{
+		if (depth >= max_depth)
+			return expression(depth) + ";\n";
+
+		switch (rand(11))
+		{
+		case 0: return pick(vartypes) + " " + identifier() + (rand(2) ? " = " + expression(depth) : "") + ";\n";
+		case 1:
+		{
+			string s = "if " + expression(depth) + "\n" + block(depth);
+			int elifs = rand(3);
+			for (int i = 0; i < elifs; i++)
+				s += "elif " + expression(depth) + "\n" + block(depth);
+			if (rand(2))
+				s += "else\n" + block(depth);
+			return s;
+		}
+		case 2: return "while " + expression(depth) + "\n" + block(depth);
+		case 3: return "for " + pick(vartypes) + " i : " + expression(depth) + "\n" + block(depth);
+		case 4: return "for int i = 0; i < " + expression(depth) + "; i++\n" + block(depth);
+		case 5: return rand(2) ? "return " + expression(depth) + ";\n" : "return;\n";
+		case 6: return rand(2) ? "break;\n" : "continue;\n";
+		case 7: return block(depth);
+		case 8: return ";\n";
+		default: return expression(depth) + ";\n";
+		}
+	}
+
+	string top_level()
+	{
+		switch (rand(5))
+		{
+		case 0: return rand(2) ? "import " + identifier() + (rand(2) ? " as " + identifier() : "") + ";\n"
+							   : "import \"lib/" + identifier() + ".dg\";\n";
+		case 1: return "namespace " + identifier() + "\n{\n" + top_level() + "}\n";
+		case 2:
+		{
+			string s = "fun " + identifier() + "(";
+			int count = rand(4);
+			for (int i = 0; i < count; i++)
+				s += (i ? ", " : "") + (rand(2) ? pick(vartypes) + " " : "") + identifier();
+			s += ")";
+			if (rand(2))
+				s += " : " + pick(vartypes);
+			return s + "\n" + block(0);
+		}
+		default: return statement(0);
+		}
+	}
+};
+
+#endif // FUZZ_GENERATOR_HPP
@@ -15,7 +15,10 @@ Codegen::Codegen(Parser* parser)
 
 void Codegen::generate()
 {
-
+	for (auto& statement : parser->get_program().statements)
+	{
+		statement->codegen(*this);
+	}
 }
 
 string Codegen::tostr() const
@@ -30,6 +33,45 @@ string Codegen::tostr() const
 
 // Nodes codegen polymorphic function
 
+void Nodes::Statement::codegen(Codegen& codegen) const {}
+
+void Nodes::StatementBlock::codegen(Codegen& codegen) const {}
+
+void Nodes::Ite::codegen(Codegen& codegen) const {}
+
+void Nodes::VarDecl::codegen(Codegen& codegen) const {}
+
+void Nodes::FunctionDecl::codegen(Codegen& codegen) const
+{
+	TRACE_SCOPE("codegen_function", name);
+}
+
+void Nodes::ClassSysFunctionDecl::codegen(Codegen& codegen) const {}
+
+void Nodes::ClassDecl::codegen(Codegen& codegen) const {}
+
+void Nodes::NamespaceDecl::codegen(Codegen& codegen) const {}
+
+void Nodes::For::codegen(Codegen& codegen) const {}
+
+void Nodes::ForIter::codegen(Codegen& codegen) const {}
+
+void Nodes::While::codegen(Codegen& codegen) const {}
+
+void Nodes::Return::codegen(Codegen& codegen) const {}
+
+void Nodes::ImportModule::codegen(Codegen& codegen) const {}
+
+void Nodes::ImportFile::codegen(Codegen& codegen) const {}
+
+void Nodes::Break::codegen(Codegen& codegen) const {}
+
+void Nodes::Continue::codegen(Codegen& codegen) const {}
+
 void Nodes::RootStatement::codegen(Codegen& codegen) const {}
 
-void Nodes::EofStatement::codegen(Codegen& codegen) const {}
\ No newline at end of file
+void Nodes::EofStatement::codegen(Codegen& codegen) const {}
+
+void Nodes::EmptyStatement::codegen(Codegen& codegen) const {}
+
+void Nodes::ExpressionStatement::codegen(Codegen& codegen) const {}
\ No newline at end of file
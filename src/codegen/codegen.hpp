@@ -3,6 +3,7 @@
 
 #include "../parser/tree.hpp"
 #include "../parser/parser.hpp"
+#include "../profiler/tracer.hpp"
 #include <string>
 
 using std::string;
@@ -47,6 +47,19 @@ bool isUnOp(unsigned int u)
 	return false;
 }
 
+// Only the arithmetic operators can be doubled, a++ is a = a + 1 and a** is a = a * 2
+bool isDoubleOp(unsigned binOp)
+{
+	switch (static_cast<operators>(binOp))
+	{
+	case operators::PLUS: case operators::MINUS: case operators::MUL:
+	case operators::DIV: case operators::MOD: case operators::POW:
+		return true;
+	default:
+		return false;
+	}
+}
+
 double getValueForDoubleOp(unsigned binOp)
 {
 	switch (static_cast<operators>(binOp))
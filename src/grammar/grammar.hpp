@@ -77,6 +77,7 @@ string getStringFromId(unsigned i);
 bool isBinOp(unsigned int u);
 bool isUnOp(unsigned int u);
 
+bool isDoubleOp(unsigned binOp);
 double getValueForDoubleOp(unsigned binOp);
 
 #endif // GRAMMAR_HPP
\ No newline at end of file
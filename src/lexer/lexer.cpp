@@ -1,11 +1,35 @@
 #include "lexer.hpp"
 
+#include <algorithm>
+
 Lexer::Lexer(string src, string path)
 {
 	this->src = src;
-	this->path = path;
+	this->files.push_back(File{0, path});
 	this->size = src.size();
 	this->i = 0;
+
+	index_lines();
+}
+
+size_t Lexer::include(const string& src, const string& path)
+{
+	if (!this->src.empty() && this->src.back() != '\n')
+		this->src += '\n';
+	size_t start = this->src.size();
+	this->src += src;
+	this->files.push_back(File{start, path});
+	this->size = this->src.size();
+	this->i = start;
+
+	index_lines();
+	return start;
+}
+
+const string& Lexer::path_at(size_t at) const
+{
+	auto it = std::upper_bound(this->files.begin(), this->files.end(), at, [](size_t at, const File& file) { return at < file.start; });
+	return (it - 1)->path;
 }
 
 Token Lexer::next()
@@ -13,6 +37,8 @@ Token Lexer::next()
 	while (c() != '\0')
 	{
 		skip_blank();
+		if (c() == '\0') /* trailing blanks at the end of the file */
+			break;
 
 		if ( isalpha(c()) || c() == '_') /* if c is in the alphabet or its a _ */
 			return parse_alpha();
@@ -38,6 +64,14 @@ Token Lexer::parse_alpha()
 	{
 		v += c();
 		increment();
+		// A name in a namespace like math::pi is one identifier, the backends look it up from the namespace it's
+		// used in outwards
+		if (c() == ':' && c(this->i + 1) == ':' && (isalpha(c(this->i + 2)) || c(this->i + 2) == '_'))
+		{
+			v += "::";
+			increment();
+			increment();
+		}
 	} while (isalpha(c()) || c() == '_' || isdigit(c()));
 
 	// if it's a keyword (or a variable type)
@@ -58,11 +92,23 @@ Token Lexer::parse_digit()
 	{
 		increment();
 
-		while (c() != '\'' || (c() == '\'' && c(i-1) == '\\' && c(i-2) != '\\'))
+		while (c() != '\'')
 		{
+			if (c() == '\0')
+				error(index, ERROR_NO_MATCHING_SINGLE_QUOTE);
+
+			// Keep escape sequences together so an escaped quote doesn't end the literal
+			if (c() == '\\' && c(i+1) != '\0')
+			{
+				v += c();
+				increment();
+			}
+
 			v += c();
 			increment();
 		}
+
+		increment(); // skip the closing quote
 		
 		v = account_special_characters(v);
 		
@@ -80,7 +126,7 @@ Token Lexer::parse_digit()
 		// OR if it's the second character with the first being 0, it can be x or b for
 		// changing number mode to hexadecimal or binary, then - if the mode is hexadecimal
 		// also accept characters between a-f or A-F with a macro
-		while ( isdigit(c()) || c() == '.' || (v == "0" && (c() == 'x' || c() == 'b') || c() == 'o') \
+		while ( isdigit(c()) || c() == '.' || (v == "0" && (c() == 'x' || c() == 'b' || c() == 'o')) \
 		|| ( mode == 1 && IS_HEXA_DIGIT(c()) ) )
 		{
 			if (c() == '.')
@@ -89,30 +135,35 @@ Token Lexer::parse_digit()
 					error(ERROR_TWO_FLOAT_DOTS);
 				has_dot = true;
 			}
-			else
+			// The prefix only counts right after the leading 0, so hexadecimal b's are still digits
+			else if (mode == 0 && v == "0" && (c() == 'x' || c() == 'b' || c() == 'o'))
 			{
-				if (c() == 'x') { mode = 1; }
-				else if (c() == 'b') { mode = 2; v = ""; }
-				else if (c() == 'o') { mode = 3; v = ""; }
+				mode = c() == 'x' ? 1 : (c() == 'b' ? 2 : 3);
+				v = "";
+				increment();
+				continue;
 			}
 
-			if (c() != 'b' && c() != 'o')
-				v += c();
+			v += c();
 			increment();
 		}
 
+		if (v.empty())
+			error(index, ERROR_NO_DIGITS);
+
 		if (c(i-1) == '.') /* if the last digit is a dot- add a zero (12. -> 12.0) */
 			v += '0';
 
+		// strto* instead of sto* so numbers that are too big saturate instead of throwing
 		if (mode == 0){
-			if (has_dot) 	number = std::stod(v);
-			else 			number = std::stoull(v);}
+			if (has_dot) 	number = strtod(v.c_str(), NULL);
+			else 			number = strtoull(v.c_str(), NULL, 10);}
 		else if (mode == 1)
-			number = std::stoull(v, NULL, 16);
+			number = strtoull(v.c_str(), NULL, 16);
 		else if (mode == 2)
-			number = std::stoull(v, NULL, 2);
+			number = strtoull(v.c_str(), NULL, 2);
 		else if (mode == 3)
-			number = std::stoull(v, NULL, 8);
+			number = strtoull(v.c_str(), NULL, 8);
 		else
 			error(ERROR_WE_DONT_KNOW);
 
@@ -129,7 +180,7 @@ Token Lexer::parse_digit()
 		increment();
 	}
 
-	number = std::stold(v);
+	number = strtod(v.c_str(), NULL);
 	
 	return Token(toktype::NUM, number, index);
 }
@@ -141,10 +192,17 @@ Token Lexer::parse_string()
 	
 	increment();
 
-	while (c() != '"' || (c() == '"' && c(i-1) == '\\') && c(i-2) != '\\')
+	while (c() != '"')
 	{
 		if (c() == '\0')
 			error(index, ERROR_NO_MATCHING_QUOTE);
+
+		// Keep escape sequences together so an escaped quote doesn't end the string
+		if (c() == '\\' && c(i+1) != '\0')
+		{
+			v += c();
+			increment();
+		}
 		
 		v += c();
 		increment();
@@ -216,6 +274,33 @@ void Lexer::skip_blank()
 	}
 }
 
+void Lexer::index_lines()
+{
+	// Walk the source from newline to newline with memchr, which the libc implements with
+	// SIMD, so indexing even huge files is about as fast as reading them
+	const char* begin = this->src.c_str();
+	const char* end = begin + this->size;
+
+	this->line_starts.clear();
+	this->line_starts.push_back(0);
+	for (const char* nl = (const char*)memchr(begin, '\n', end - begin); nl != NULL; nl = (const char*)memchr(nl + 1, '\n', end - (nl + 1)))
+		this->line_starts.push_back(nl - begin + 1);
+}
+
+void Lexer::get_line_and_column(size_t at, size_t& line, size_t& column) const
+{
+	if (at > this->size)
+		at = this->size;
+
+	// Find the last line that starts at or before at, both line and column are 1-based, the line counts from the
+	// start of the file it's in
+	auto it = std::upper_bound(this->line_starts.begin(), this->line_starts.end(), at);
+	auto file = std::upper_bound(this->files.begin(), this->files.end(), at, [](size_t at, const File& file) { return at < file.start; }) - 1;
+	size_t first = std::upper_bound(this->line_starts.begin(), this->line_starts.end(), file->start) - this->line_starts.begin();
+	line = it - this->line_starts.begin() - first + 1;
+	column = at - *(it - 1) + 1;
+}
+
 string Lexer::account_special_characters(const string& og)
 {
 	string s = "";
@@ -287,27 +372,16 @@ void Lexer::error(size_t at, const char* format, ...)
 
 void Lexer::error(size_t at, const char* format, va_list args)
 {
-	size_t lineNumber = 1;
-	size_t characterNumberInLine = 1;
-	const char* j;
-	const char* jj;
-	// move j to at's character and count the '\n's in the way
-	for (j = this->src.c_str(); j < this->src.c_str()+at && *j != '\0'; j++)
-		if (*j == '\n')
-			lineNumber++;
-	// move jj to the begging of at's line
-	for (jj = j; *jj != '\n' && jj > src; jj--) ;
-	// calculate the column
-	characterNumberInLine = j - jj;
-	// FIXME: not generating column correctly
+	size_t lineNumber, characterNumberInLine;
+	get_line_and_column(at, lineNumber, characterNumberInLine);
 	
-	fprintf(stderr, "%s:%zu:%zu " COLOR_RED "error: " COLOR_RESET, path.c_str(), lineNumber, characterNumberInLine);
+	fprintf(stderr, "%s:%zu:%zu " COLOR_RED "error: " COLOR_RESET, path_at(at).c_str(), lineNumber, characterNumberInLine);
 
 	vfprintf(stderr, format, args);
 
 	fprintf(stderr, "\n");
 
-	exit(-1);
+	COMPILE_ERROR_EXIT();
 }
 
 void Lexer::warning(const char* format, ...)
@@ -328,20 +402,10 @@ void Lexer::warning(size_t at, const char* format, ...)
 
 void Lexer::warning(size_t at, const char* format, va_list args)
 {
-	size_t lineNumber = 1;
-	size_t characterNumberInLine = 1;
-	const char* j;
-	const char* jj;
-	// move j to at's character and count the '\n's in the way
-	for (j = this->src.c_str(); j < this->src.c_str()+at && *j != '\0'; j++)
-		if (*j == '\n')
-			lineNumber++;
-	// move jj to the begging of at's line
-	for (jj = j; *jj != '\n' && jj > src; jj--) ;
-	// calculate the column
-	characterNumberInLine = j - jj;
+	size_t lineNumber, characterNumberInLine;
+	get_line_and_column(at, lineNumber, characterNumberInLine);
 	
-	fprintf(stderr, "%s:%zu:%zu " COLOR_MAGENTA "warning: " COLOR_RESET, path.c_str(), lineNumber, characterNumberInLine);
+	fprintf(stderr, "%s:%zu:%zu " COLOR_MAGENTA "warning: " COLOR_RESET, path_at(at).c_str(), lineNumber, characterNumberInLine);
 
 	vfprintf(stderr, format, args);
 
@@ -2,6 +2,7 @@
 #define LEXER_LEXER_HPP
 
 #include <string>
+#include <vector>
 #include <regex>
 #include <stdarg.h>
 #include <stdio.h>
@@ -13,18 +14,30 @@
 #include "../grammar/grammar.hpp"
 
 using std::string;
+using std::vector;
 
 class Lexer
 {
 private:
-	string src;
-	string path;
+	struct File
+	{
+		size_t start; // Where it starts in src, always at the start of a line
+		string path;
+	};
+
+	string src; // Every file that was included is after the ones before it, so a position tells which file it's in
+	vector<File> files; // The first one is the file the lexer was created with
 	size_t size;
 	size_t i;
+	vector<size_t> line_starts; // The offset of the first character of every line, built again for every file
 public:
 	Lexer(string src, string path);
 	Token next();
 	bool get_token(Token& tok) { tok = this->next(); return tok.type != toktype::TOK_EOF; }
+	// Appends another file, like an import, and continues lexing from its start. Returns where it starts
+	size_t include(const string& src, const string& path);
+	inline const string& source() const { return this->src; }
+	const string& path_at(size_t at) const; // The path of the file the position is in
 
 	void error(const char* format, ...);
 	void error(size_t at, const char* format, ...);
@@ -40,11 +53,14 @@ private:
 	void increment();
 	void decrement();
 	void skip_blank();
+
+	void index_lines();
+	void get_line_and_column(size_t at, size_t& line, size_t& column) const; // In the file the position is in
 	
 	string account_special_characters(const string& og);
 
 	inline char c() const { return this->src[this->i]; }
-	inline char c(size_t i) const { return this->src[i]; }
+	inline char c(size_t i) const { return i < this->size ? this->src[i] : '\0'; }
 };
 
 #endif // LEXER_LEXER_HPP
\ No newline at end of file
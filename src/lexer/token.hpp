@@ -2,6 +2,7 @@
 #define LEXER_TOKEN_HPP
 
 #include <string>
+#include <vector>
 #include <cstdint>
 #include <stdio.h>
 #include "../grammar/grammar.hpp"
@@ -66,9 +67,24 @@ struct TokenNode
 	{
 		printf("TokenNode: ");
 		tok.print();
-		if (next != NULL)
+		if (next != NULL && next != this)
 			next->print();
 	}
 };
 
+// Link the tokens after a ROOT node, the last token (EOF) links to itself so
+// the parser can always look ahead without running off the end of the list
+inline TokenNode* make_token_list(const std::vector<Token>& tokens)
+{
+	TokenNode* root = new TokenNode();
+	TokenNode* tail = root;
+	for (auto& token : tokens)
+	{
+		tail->next = new TokenNode(token);
+		tail = tail->next;
+	}
+	tail->next = tail;
+	return root;
+}
+
 #endif // LEXER_TOKEN_HPP
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "linker.hpp"
+#include "../parser/parser.hpp"
+#include "../optimizer/optimizer.hpp"
+#include "../preprocessor/preprocessor.hpp"
+#include "../profiler/tracer.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+using std::map;
+
+// The same file is the same path however it was written
+static string canonical(const string& path)
+{
+	std::error_code error;
+	std::filesystem::path resolved = std::filesystem::weakly_canonical(path, error);
+	return error ? path : resolved.string();
+}
+
+static string directory(const string& path)
+{
+	size_t slash = path.find_last_of('/');
+	return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+struct Linker
+{
+	Lexer& lexer;
+	map<string, string> names; // The namespace of every file by its canonical path, "" for the program
+	map<string, string> files; // The file of every namespace
+	vector<Nodes::Statement*> modules; // The namespaces of the files, in the order they run
+
+	// Takes the imports out of the top level of a file and puts in the files they import
+	void link(vector<Nodes::Statement*>& statements, const string& path)
+	{
+		vector<Nodes::Statement*> kept;
+		map<string, string> aliases; // The other names this file imports a file as, by the namespace it's in
+		for (auto statement : statements)
+		{
+			string file, name;
+			if (auto import = dynamic_cast<Nodes::ImportFile*>(statement))
+			{
+				file = import->path;
+				name = import->as;
+			}
+			else if (auto import = dynamic_cast<Nodes::ImportModule*>(statement))
+			{
+				file = import->name + ".dg";
+				name = import->as;
+			}
+			else
+			{
+				kept.push_back(statement);
+				continue;
+			}
+
+			if (file.empty() || file[0] != '/')
+				file = directory(path) + file;
+			string bound = load(file, name, statement->position);
+			if (bound != name)
+				aliases[name] = bound;
+			delete statement;
+		}
+		statements = kept;
+
+		for (auto statement : statements)
+			rename(statement, aliases);
+	}
+
+	// Puts the file in the program under the name, or only gives it the name too if it's already in.
+	// Returns the namespace it's in
+	string load(const string& file, const string& name, size_t position)
+	{
+		string key = canonical(file);
+		auto taken = this->files.find(name);
+		if (taken != this->files.end() && canonical(taken->second) != key)
+			lexer.error(position, "%s is already the name of the import of %s", name.c_str(), taken->second.c_str());
+		auto found = this->names.find(key);
+		if (found != this->names.end())
+		{
+			this->files[name] = file;
+			return found->second;
+		}
+
+		std::ifstream f(file);
+		if (!f.good())
+			lexer.error(position, "Can't find %s to import", file.c_str());
+		string src((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+		TRACE_SCOPE("link_file", file);
+		// Before its own imports, so a file that imports one that imports it back doesn't go in twice
+		this->names[key] = name;
+		this->files[name] = file;
+
+		preprocess(src);
+		size_t start = lexer.include(src, file);
+		vector<Token> tokens;
+		Token tok;
+		while (lexer.get_token(tok))
+			tokens.push_back(tok);
+		tokens.push_back(tok);
+
+		Parser parser(&lexer);
+		parser.parse(*make_token_list(tokens));
+		vector<Nodes::Statement*> body;
+		std::swap(body, parser.get_program().statements);
+
+		link(body, file);
+		this->modules.push_back(new Nodes::NamespaceDecl{start, name, new Nodes::StatementBlock{start, body}});
+		return name;
+	}
+
+	// Another name of an import is the namespace it's in, m::f is math::f after `import math; import math as m;`,
+	// and the program itself imported back has its names at the top level
+	static void rename(Nodes::Statement* statement, const map<string, string>& aliases)
+	{
+		if (aliases.empty())
+			return;
+
+		auto qualified = [&](string& name)
+		{
+			size_t at = name.find("::");
+			if (at == string::npos)
+				return;
+			auto alias = aliases.find(name.substr(0, at));
+			if (alias != aliases.end())
+				name = alias->second.empty() ? name.substr(at + 2) : alias->second + name.substr(at);
+		};
+		auto fn = [&](Nodes::Expression* e)
+		{
+			if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e)) qualified(id->name);
+			else if (auto call = dynamic_cast<Nodes::FunctionCallExpression*>(e)) qualified(call->name);
+			else if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e)) qualified(assign->name);
+		};
+
+		if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+		{
+			for (auto& member : cls->members)
+				for_each_expression(member.first, fn);
+			for (auto& function : cls->functions)
+				for_each_expression(function.first, fn);
+			for (auto function : cls->sysFunctions)
+			{
+				for (auto& arg : function->args)
+					for_each_expression(arg.second, fn);
+				for_each_expression(function->body, fn);
+			}
+		}
+		else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+		{
+			for (auto s : ns->body->statements)
+				rename(s, aliases);
+		}
+		else for_each_expression(statement, fn);
+	}
+};
+
+size_t link_imports(Nodes::StatementBlock& program, Lexer& lexer, const string& path)
+{
+	Linker linker{lexer, {}, {}, {}};
+	linker.names[canonical(path)] = "";
+	linker.link(program.statements, path);
+	program.statements.insert(program.statements.begin(), linker.modules.begin(), linker.modules.end());
+	return linker.modules.size();
+}
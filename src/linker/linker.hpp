@@ -0,0 +1,23 @@
+#ifndef LINKER_LINKER_HPP
+#define LINKER_LINKER_HPP
+
+#include <string>
+#include "../lexer/lexer.hpp"
+#include "../parser/tree.hpp"
+
+using std::string;
+
+// Puts every file the program imports, and the ones they import, into the program's tree before anything else
+// looks at it, so the optimizer and the backends see the whole program: a function of another file is inlined
+// and folded like one of the same file. It only runs with -flto, without it imports are ignored like before.
+//
+// `import "path/file.dg";` and `import "path/file.dg" as name;` find the file from the directory of the file that
+// imports it, `import name;` is `import "name.dg";`. Everything in the file goes in a namespace named after it
+// or the name it's imported as, so it's name::function from outside. A file is only put in once however many
+// files import it under however many names, the other names mean the namespace it's in. The files it imports
+// go before it and they all go before the program's own statements, so their top level statements run first.
+// The files are read into the lexer after the program, so errors in them point at the right file. Returns how
+// many files it put in
+size_t link_imports(Nodes::StatementBlock& program, Lexer& lexer, const string& path);
+
+#endif // LINKER_LINKER_HPP
@@ -3,9 +3,12 @@
 
 #define DIG_VERSION "1.0.0"
 
-#define USAGE_HELPER "Usage: dig input_file_path [options]\n\texamples:\n\
+#define USAGE_HELPER "Usage: dig input_file_path [options]\n\
+       dig run input_file_path [options]\n\texamples:\n\
 \t\tdig main.dg -o main.exe\n\
 \t\tdig main.dg\n\
+\t\tdig run main.dg\n\
+\t\tdig run --jit main.dg\n\
 \t\tdig -h\n\
 Options:\n\
 \t-o <file>\t\t\tSet output file to <file>, the default will be the file name but with .exe extension.\n\
@@ -13,10 +16,23 @@ Options:\n\
 \t-v\t\t\t\tShows the version of the compiler.\n\
 \n\
 \t-E\t\t\tPreprocess only.\n\
+\t-finline-limit=<n>\t\tWith run, inline functions up to <n> statements and expressions big, 0 turns inlining off.\n\
+\t-fno-vectorize\t\t\tWith run, run element-wise loops one element at a time instead of with SIMD instructions.\n\
+\t-fno-dce\t\t\tKeep code that never runs and the functions nothing calls.\n\
+\t-fno-escape\t\t\tKeep the arrs and instances that never leave their function on the heap instead of in locals.\n\
+\t-flto\t\t\t\tPut the imported files in the program and optimize it all together, imports are ignored without it.\n\
+\t-fno-peephole\t\t\tWith run --jit, encode the machine code the JIT generates as it is, without the peephole pass.\n\
+\t-fprofile-generate[=<file>]\tWith run, count how often functions, branches and loops run and write it to <file> at exit.\n\
+\t-fprofile-use[=<file>]\t\tWith run, use a profile from -fprofile-generate for inlining, branch order and unrolling.\n\
+\t\t\t\t\tThe default <file> is the input file with the .profile extension.\n\
+\t--time-report\t\t\tPrint the time and memory every compilation phase took as JSON to stderr.\n\
+\t--trace=<file>\t\t\tWrite a Chrome trace (chrome://tracing, ui.perfetto.dev) of the compilation to <file>.\n\
+\t--dump-bytecode\t\t\tWith run, print the bytecode instead of running it.\n\
+\t--jit\t\t\t\tRun the program compiled to machine code instead of interpreting it, implies run.\n\
 "
 
 // Max 32 command line arguments
-#define CMD_OPTIONS_STRING "o:hve" /* all the options */
+#define CMD_OPTIONS_STRING "o:hvEf:" /* all the options */
 class cmd_args
 {
 public:
@@ -25,13 +41,37 @@ public:
 	static const int _h		= (1 << 1);
 	static const int _v		= (1 << 2);
 	static const int _E		= (1 << 3);
+	static const int _time_report	= (1 << 4);
+	static const int _trace		= (1 << 5);
+	static const int _dump_bytecode	= (1 << 6);
+	static const int _jit		= (1 << 7);
 };
 
+// Long options have no short version, so they get ids that can't collide with a character
+#define LONG_OPT_TIME_REPORT 256
+#define LONG_OPT_TRACE 257
+#define LONG_OPT_DUMP_BYTECODE 258
+#define LONG_OPT_JIT 259
+
 #define ERROR_WE_DONT_KNOW "Something went horribly wrong, probably a bug in the compiler itself, sorry"
 #define UNEXPECTED_CHARACTER(ch) "We reached an unexpected character: '%c'", ch
 #define ERROR_TWO_FLOAT_DOTS "Float number has two or more dots, it should only have one"
 #define ERROR_NO_MATCHING_QUOTE "No closing double quotes for this pair, add it somewhere"
 #define ERROR_CHAR_TOO_LONG "Single quotes are meant for single character literals, more were given"
+#define ERROR_NO_MATCHING_SINGLE_QUOTE "No closing single quote for this character literal, add it somewhere"
+#define ERROR_NO_DIGITS "Expected digits after the number prefix"
+#define ERROR_TOO_DEEP "Code is nested too deeply (more than %d levels)"
+
+// How deep expressions and blocks can be nested, so pathological code fails instead of overflowing the stack
+#define MAX_NESTING_DEPTH 512
+
+// Fuzzers run the compiler in-process, so a compile error can't end the process there
+#ifdef DIG_FUZZING
+struct CompileError {};
+#define COMPILE_ERROR_EXIT() throw CompileError()
+#else
+#define COMPILE_ERROR_EXIT() exit(-1)
+#endif
 
 #define IS_HEXA_DIGIT(c) ( (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') )
 #define CAN_BE_OPERATOR(c) ( (c >= 33 && c <= 47 && c != 34 && c != 39)\
@@ -61,7 +101,7 @@ template <class T, class Instance> inline bool IsType(const Instance* src)
 		(tok.tok.type == toktype::OPERATOR && \
 		(isBinOp(tok.tok.keyword) || isUnOp(tok.tok.keyword)) || \
 		tok.tok.keyword == uenum(operators::ASS)  || \
-		tok.tok.keyword == uenum(operators::LBRACK) || tok.tok.keyword == uenum(operators::LPAREN)) || \
+		tok.tok.keyword == uenum(operators::LBRACK) || tok.tok.keyword == uenum(operators::LPAREN) || tok.tok.keyword == uenum(operators::DOT)) || \
 		(tok.tok.type == toktype::KEYWORD && \
 		((tok.tok.keyword == uenum(keywords::TRUE) || tok.tok.keyword == uenum(keywords::FALSE) || tok.tok.keyword == uenum(keywords::_NULL)))\
 		|| IS_ENUM_VARTYPE(tok.tok.keyword)) \
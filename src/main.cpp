@@ -2,37 +2,73 @@
 #include "parser/parser.hpp"
 #include "codegen/codegen.hpp"
 #include "preprocessor/preprocessor.hpp"
+#include "optimizer/optimizer.hpp"
+#include "linker/linker.hpp"
+#include "vm/compiler.hpp"
+#include "vm/vm.hpp"
+#include "vm/jit.hpp"
+#include "vm/gc.hpp"
+#include "vm/output.hpp"
+#include "vm/profile.hpp"
+#include "profiler/profiler.hpp"
+#include "profiler/tracer.hpp"
 
 #include <string>
 #include <fstream>
 #include <streambuf>
 #include <string.h>
 #include <getopt.h>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 string getfile(string name);
 inline bool does_file_exist(string path);
-inline void get_options(int argc, char** argv, int &opts, string& path, string& _o);
+inline void get_options(int argc, char** argv, int &opts, string& _o, string& _trace, int& inline_limit, bool& vectorize, bool& dce, bool& escape, bool& peephole, bool& lto, string& profile_generate, string& profile_use);
 
 int main(int argc, char** argv)
 {
 	int cmd_options = cmd_args::None;
 	string path = "";
 	string output_file;
+	string trace_file;
+	int inline_limit = INLINE_DEFAULT_LIMIT;
+	bool vectorize = true;
+	bool dce = true;
+	bool escape = true;
+	bool peephole = true;
+	bool lto = false;
+	string profile_generate, profile_use; // The profiles' files, "=" until we know the default
 	string src;
 	bool dont_compile = false;
+	bool run = false;
 
 	//  -----=+*/ PARSE COMMAND LINE ARGUMENTS \*+=-----
 	// Make sure that there are command line arguments
 	if (argc < 2) { fprintf(stderr, "No input file\n\n" USAGE_HELPER); exit(-1); }
+	// `dig run file.dg` interprets the file instead of compiling it
+	if (strcmp(argv[1], "run") == 0)
+	{
+		if (argc < 3) { fprintf(stderr, "No input file to run\n\n" USAGE_HELPER); exit(-1); }
+		run = true;
+		argv++; argc--;
+	}
 	// Get the path, unless the first argument is a flag, then we'll stop comipilng before getting the file
 	if (argv[1][0] != '-')
 		path.assign(argv[1]);
 	else
 		dont_compile = true;
 	// Get the options
-	get_options(argc, argv, cmd_options, path, output_file);
+	get_options(argc, argv, cmd_options, output_file, trace_file, inline_limit, vectorize, dce, escape, peephole, lto, profile_generate, profile_use);
+	// getopt moves the file after the flags, so `dig run --jit main.dg` still has one
+	if (dont_compile && optind < argc)
+	{
+		path.assign(argv[optind]);
+		dont_compile = false;
+	}
+	if (cmd_options & cmd_args::_jit)
+		run = true;
 
 	//  -----=+*/ IMPLEMENT THE COMMAND LINE FLAGS THAT WE CAN \*+=-----
 	// If the -h flag is set, print the help page and continue
@@ -44,46 +80,189 @@ int main(int argc, char** argv)
 	if (dont_compile)
 		exit(0);
 
+	Profiler profiler(cmd_options & cmd_args::_time_report);
+	if (cmd_options & cmd_args::_trace)
+		Tracer::start(trace_file);
+
 	//  -----=+*/ GET THE FILE AND SET THE OUTPUT FILE NEEDED \*+=-----
 	// Check if file exist
 	if (!does_file_exist(path)) { fprintf(stderr, "Input file \"%s\" doesn't exist\n\n", path.c_str()); exit(-1); }
 	// set output_file if needed
 	if (!(cmd_options & cmd_args::_o))
 		output_file = path.substr(0, path.find_last_of('.')) + ".exe";
+	// The profile is next to the file by default, like the output
+	if (profile_generate == "=")
+		profile_generate = path.substr(0, path.find_last_of('.')) + ".profile";
+	if (profile_use == "=")
+		profile_use = path.substr(0, path.find_last_of('.')) + ".profile";
 	// Get the file
+	profiler.begin("read", path);
 	src = getfile(path);
+	profiler.end();
 
 	//  -----=+*/ BEGINNING OF THE COMPILATION PROCESS! \*+=-----
 
 	// Preprocess
-	preprocess(src); // FIXME: Might be problematic, may interfere with the error position. we might have to skip comments in the lexer
+	profiler.begin("preprocess");
+	preprocess(src);
+	profiler.end();
 
 	// If the -E flag is set, print the code and exit with exit code 0
-	if (cmd_options & cmd_args::_E) { printf("%s", src.c_str()); exit(0); }
+	if (cmd_options & cmd_args::_E) { printf("%s", src.c_str()); profiler.print(); Tracer::finish(); exit(0); }
 
 	Lexer lexer(src, path);
 	Parser parser(&lexer);
 	Codegen codegen(&parser);
 
-	TokenNode* root = new TokenNode();
+	profiler.begin("lex", path);
+	vector<Token> tokens;
 	Token tok;
 	while (lexer.get_token(tok))
 	{
-		root->add_child(tok);
+		tokens.push_back(tok);
 	}
-	root->add_child(Token());
+	tokens.push_back(Token());
+	profiler.end();
+
+	profiler.begin("token_list");
+	TokenNode* root = make_token_list(tokens);
+	profiler.end();
 
 	// root->print();
 
+	profiler.begin("parse", path);
 	parser.parse(*root);
+	profiler.end();
+
+	// With -flto the imported files are put in the program, so everything after sees the whole program
+	profiler.begin("link", path);
+	size_t imported_files = lto ? link_imports(parser.get_program(), lexer, path) : 0;
+	profiler.end();
+
+	profiler.begin("dce");
+	size_t dead_functions = dce ? eliminate_dead_code(parser.get_program()) : 0;
+	profiler.end();
+
+	profiler.begin("escape");
+	size_t scalar_replaced = escape ? replace_scalars(parser.get_program()) : 0;
+	profiler.end();
+
+	profiler.begin("lower");
+	lower_ranges(parser.get_program());
+	profiler.end();
+
+	profiler.begin("optimize");
+	optimize_loops(parser.get_program());
+	profiler.end();
 
 	// parser.print();
 
-	codegen.generate();
+	if (run)
+	{
+		// Positions in the profile are in the preprocessed source with the imported files, that's what the tree has
+		uint64_t source_hash = Profile::hash(lexer.source());
+		Profile profile;
+		profiler.begin("profile");
+		bool use_profile = !profile_use.empty() && profile.load(profile_use, source_hash);
+		profiler.end();
+
+		BytecodeCompiler compiler(&lexer, inline_limit, vectorize, !profile_generate.empty(), use_profile ? &profile : nullptr);
+		profiler.begin("bytecode");
+		Program program = compiler.compile(parser.get_program());
+		profiler.end();
+
+		if (cmd_options & cmd_args::_dump_bytecode)
+		{
+			program.print();
+			profiler.print();
+			Tracer::finish();
+			return 0;
+		}
+
+		bool jit = cmd_options & cmd_args::_jit;
+#ifndef DIG_HAS_JIT
+		if (jit)
+		{
+			fprintf(stderr, "Warning: there is no JIT for this platform, the program will be interpreted\n");
+			jit = false;
+		}
+#endif
+
+		if (!profile_generate.empty())
+			Profile::write_at_exit(profile_generate, source_hash, program.probes);
+
+		profiler.begin("execute", path);
+		Value result;
+		size_t jit_code_bytes = 0, jit_cold_bytes = 0, jit_tier_ups = 0, jit_peephole_rewrites = 0;
+		if (jit)
+		{
+			Jit compiled(&lexer, program, peephole);
+			result = compiled.run();
+			jit_code_bytes = compiled.get_code_bytes();
+			jit_cold_bytes = compiled.get_cold_bytes();
+			jit_tier_ups = compiled.get_tier_ups();
+			jit_peephole_rewrites = compiled.get_peephole_rewrites();
+		}
+		else
+		{
+			VM vm(&lexer, program);
+			result = vm.run();
+		}
+		Output::flush();
+		profiler.end();
 
-	codegen.print();
+		profiler.set_counter("source_bytes", src.size());
+		profiler.set_counter("tokens", tokens.size());
+		profiler.set_counter("ast_nodes", Nodes::Statement::created + Nodes::Expression::created);
+		profiler.set_counter("imported_files", imported_files);
+		profiler.set_counter("dead_functions", dead_functions);
+		profiler.set_counter("scalar_replaced", scalar_replaced);
+		profiler.set_counter("bytecode_instructions", program.instructions());
+		profiler.set_counter("profile_probes", program.probes.size());
+		profiler.set_counter("gc_minor_collections", GC::stats().minor_collections);
+		profiler.set_counter("gc_major_collections", GC::stats().major_collections);
+		profiler.set_counter("gc_freed_bytes", GC::stats().freed_bytes);
+		profiler.set_counter("gc_max_pause_us", GC::stats().max_pause_us);
+		if (jit)
+		{
+			profiler.set_counter("jit_code_bytes", jit_code_bytes);
+			profiler.set_counter("jit_cold_bytes", jit_cold_bytes);
+			profiler.set_counter("jit_tier_ups", jit_tier_ups);
+			profiler.set_counter("jit_peephole_rewrites", jit_peephole_rewrites);
+		}
+		profiler.set_rate("source_bytes_per_sec", src.size(), "lex");
+		profiler.set_rate("tokens_per_sec", tokens.size(), "lex");
+		profiler.set_rate("ast_nodes_per_sec", Nodes::Statement::created + Nodes::Expression::created, "parse");
+		profiler.print();
+		Tracer::finish();
+
+		// main's return value is the exit code, like it would be for the compiled program
+		return result.is_num() ? (int)result.as_num() : 0;
+	}
+
+	profiler.begin("codegen");
+	codegen.generate();
+	profiler.end();
 
 	// TODO: write to output_file
+	profiler.begin("output");
+	string output = codegen.tostr();
+	printf("%s", output.c_str());
+	profiler.end();
+
+	profiler.set_counter("source_bytes", src.size());
+	profiler.set_counter("tokens", tokens.size());
+	profiler.set_counter("ast_nodes", Nodes::Statement::created + Nodes::Expression::created);
+	profiler.set_counter("imported_files", imported_files);
+	profiler.set_counter("dead_functions", dead_functions);
+	profiler.set_counter("scalar_replaced", scalar_replaced);
+	profiler.set_counter("output_bytes", output.size());
+	profiler.set_rate("source_bytes_per_sec", src.size(), "lex");
+	profiler.set_rate("tokens_per_sec", tokens.size(), "lex");
+	profiler.set_rate("ast_nodes_per_sec", Nodes::Statement::created + Nodes::Expression::created, "parse");
+	profiler.set_rate("output_bytes_per_sec", output.size(), "output");
+	profiler.print();
+	Tracer::finish();
 
 	return 0;
 }
@@ -109,11 +288,18 @@ inline bool does_file_exist(string path)
 	return f.good();
 }
 
-inline void get_options(int argc, char** argv, int &opts, string& path, string& _o)
+inline void get_options(int argc, char** argv, int &opts, string& _o, string& _trace, int& inline_limit, bool& vectorize, bool& dce, bool& escape, bool& peephole, bool& lto, string& profile_generate, string& profile_use)
 {
 	int opt;
+	static const struct option long_options[] = {
+		{ "time-report", no_argument, NULL, LONG_OPT_TIME_REPORT },
+		{ "trace", required_argument, NULL, LONG_OPT_TRACE },
+		{ "dump-bytecode", no_argument, NULL, LONG_OPT_DUMP_BYTECODE },
+		{ "jit", no_argument, NULL, LONG_OPT_JIT },
+		{ NULL, 0, NULL, 0 }
+	};
 
-	while ((opt = getopt(argc, argv, ":" CMD_OPTIONS_STRING)) != -1)
+	while ((opt = getopt_long(argc, argv, ":" CMD_OPTIONS_STRING, long_options, NULL)) != -1)
 	{
 		switch(opt)
 		{
@@ -130,11 +316,54 @@ inline void get_options(int argc, char** argv, int &opts, string& path, string&
 			case 'E':
 				opts |= cmd_args::_E;
 				break;
+			case 'f':
+				// -f<name>=<value> tunes the optimizer, like gcc's
+				if (strncmp(optarg, "inline-limit=", 13) == 0)
+					inline_limit = atoi(optarg + 13);
+				else if (strcmp(optarg, "no-vectorize") == 0)
+					vectorize = false;
+				else if (strcmp(optarg, "no-dce") == 0)
+					dce = false;
+				else if (strcmp(optarg, "no-escape") == 0)
+					escape = false;
+				else if (strcmp(optarg, "no-peephole") == 0)
+					peephole = false;
+				else if (strcmp(optarg, "lto") == 0)
+					lto = true;
+				else if (strcmp(optarg, "profile-generate") == 0)
+					profile_generate = "=";
+				else if (strncmp(optarg, "profile-generate=", 17) == 0)
+					profile_generate = optarg + 17;
+				else if (strcmp(optarg, "profile-use") == 0)
+					profile_use = "=";
+				else if (strncmp(optarg, "profile-use=", 12) == 0)
+					profile_use = optarg + 12;
+				else
+				{
+					printf("Unknown option: -f%s.\n", optarg);
+					exit(-1);
+				}
+				break;
+			case LONG_OPT_TIME_REPORT:
+				opts |= cmd_args::_time_report;
+				break;
+			case LONG_OPT_TRACE:
+				opts |= cmd_args::_trace;
+				_trace.assign(optarg);
+				break;
+			case LONG_OPT_DUMP_BYTECODE:
+				opts |= cmd_args::_dump_bytecode;
+				break;
+			case LONG_OPT_JIT:
+				opts |= cmd_args::_jit;
+				break;
 			case ':':
-				printf("Option -%c requires a value.\n", optopt);
+				if (optopt > 255) printf("Option %s requires a value.\n", argv[optind-1]);
+				else printf("Option -%c requires a value.\n", optopt);
 				exit(-1);
 			case '?':
-				printf("Unknown option: -%c.\n", optopt);
+				if (optopt == 0) printf("Unknown option: %s.\n", argv[optind-1]);
+				else printf("Unknown option: -%c.\n", optopt);
 				exit(-1);
 			default:
 				fprintf(stderr, ERROR_WE_DONT_KNOW);
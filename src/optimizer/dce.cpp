@@ -0,0 +1,345 @@
+#include "optimizer.hpp"
+
+// Runs before the other passes and the backend, so none of them spend any time on code that never runs.
+// Dead code is only taken out, nothing in it is checked, so an error in a function nobody calls isn't
+// reported anymore, like an unused function in a library
+
+// If the condition is made of literals, whether it's true like the VM's is_truthy would tell
+static bool constant_truth(const Nodes::Expression* expr, bool& value)
+{
+	if (auto b = dynamic_cast<const Nodes::BoolLiteralExpression*>(expr))
+		value = b->value;
+	else if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expr))
+		value = num->value != 0;
+	else if (auto s = dynamic_cast<const Nodes::StringLiteralExpression*>(expr))
+		value = !s->value.empty();
+	else if (IsType<Nodes::NullLiteralExpression>(expr))
+		value = false;
+	else if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return constant_truth(paren->value, value);
+	else if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr); unary && unary->op == operators::NOT)
+	{
+		if (!constant_truth(unary->value, value))
+			return false;
+		value = !value;
+	}
+	else if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expr))
+	{
+		double x, y;
+		if (!get_constant_number(binary->left, x) || !get_constant_number(binary->right, y))
+			return false;
+		switch (binary->op)
+		{
+		case operators::EQ: value = x == y; break;
+		case operators::NEQ: value = x != y; break;
+		case operators::LT: value = x < y; break;
+		case operators::LEQ: value = x <= y; break;
+		case operators::GT: value = x > y; break;
+		case operators::GEQ: value = x >= y; break;
+		default: return false;
+		}
+	}
+	else return false;
+	return true;
+}
+
+// Nothing after the statement in its block runs
+static bool terminates(const Nodes::Statement* statement)
+{
+	if (IsType<Nodes::Return>(statement) || IsType<Nodes::Break>(statement) || IsType<Nodes::Continue>(statement))
+		return true;
+	if (auto block = dynamic_cast<const Nodes::StatementBlock*>(statement))
+		return !block->statements.empty() && terminates(block->statements.back());
+	if (auto ite = dynamic_cast<const Nodes::Ite*>(statement))
+		return terminates(ite->ifBranch) && ite->elseBranch && terminates(ite->elseBranch);
+	return false;
+}
+
+// Takes out branches that are never taken, loops that never run and, in functions, whatever comes after a
+// return, a break or a continue. Declarations after a return at the top level still declare something
+static void prune(Nodes::StatementBlock* block, bool in_function)
+{
+	vector<Nodes::Statement*> kept;
+	for (size_t i = 0; i < block->statements.size(); i++)
+	{
+		Nodes::Statement* statement = block->statements[i];
+		bool truth;
+
+		if (auto ite = dynamic_cast<Nodes::Ite*>(statement); ite && constant_truth(ite->condition, truth))
+		{
+			Nodes::StatementBlock* taken = truth ? ite->ifBranch : ite->elseBranch;
+			if (!taken || taken->statements.empty())
+				continue;
+			statement = taken;
+		}
+		else if (auto loop = dynamic_cast<Nodes::While*>(statement); loop && constant_truth(loop->condition, truth) && !truth)
+		{
+			delete loop;
+			continue;
+		}
+		else if (IsType<Nodes::EmptyStatement>(statement))
+		{
+			delete statement;
+			continue;
+		}
+
+		if (auto b = dynamic_cast<Nodes::StatementBlock*>(statement))
+			prune(b, in_function);
+		else if (auto ite = dynamic_cast<Nodes::Ite*>(statement))
+		{
+			prune(ite->ifBranch, in_function);
+			if (ite->elseBranch) prune(ite->elseBranch, in_function);
+		}
+		else if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+			prune(function->body, true);
+		else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+			prune(ns->body, false);
+		else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+		{
+			for (auto& function : cls->functions)
+				prune(function.first->body, true);
+			for (auto function : cls->sysFunctions)
+				prune(function->body, true);
+		}
+		else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+			prune(loop->body, in_function);
+		else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+			prune(loop->body, in_function);
+		else if (auto loop = dynamic_cast<Nodes::While*>(statement))
+			prune(loop->body, in_function);
+
+		kept.push_back(statement);
+		if (in_function && terminates(statement))
+		{
+			for (size_t j = i + 1; j < block->statements.size(); j++)
+				delete block->statements[j];
+			break;
+		}
+	}
+	block->statements = kept;
+}
+
+// Every expression of a class runs whenever it's created or its methods are called, which can't be told apart
+// from here: the initializers of its fields, its methods and their default arguments
+static void for_each_class_expression(Nodes::ClassDecl* cls, const std::function<void(Nodes::Expression*)>& fn)
+{
+	for (auto& member : cls->members)
+		for_each_expression(member.first, fn);
+	for (auto& function : cls->functions)
+	{
+		for (auto& arg : function.first->args)
+			for_each_expression(arg.second, fn);
+		for_each_expression(function.first->body, fn);
+	}
+	for (auto function : cls->sysFunctions)
+	{
+		for (auto& arg : function->args)
+			for_each_expression(arg.second, fn);
+		for_each_expression(function->body, fn);
+	}
+}
+
+static string outer_namespace(const string& ns)
+{
+	size_t at = ns.size() > 2 ? ns.rfind("::", ns.size() - 3) : string::npos;
+	return at == string::npos ? "" : ns.substr(0, at + 2);
+}
+
+// The functions main and the code outside of functions can get to, calls are looked up from the innermost
+// namespace outwards like the compiler does
+struct Reachability
+{
+	struct Definition
+	{
+		vector<Nodes::FunctionDecl*> decls; // More than one if it's defined twice, the compiler reports that
+		string ns;
+	};
+	map<string, Definition> functions; // By name with the namespace
+	Names reached;
+	std::set<pair<string, string>> defaults; // The functions whose default arguments were looked at, from a namespace
+	vector<string> pending;
+
+	void collect(Nodes::StatementBlock* block, const string& ns)
+	{
+		for (auto statement : block->statements)
+		{
+			if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+			{
+				Definition& def = this->functions[ns + function->name];
+				def.decls.push_back(function);
+				def.ns = ns;
+			}
+			else if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+				collect(nspace->body, ns + nspace->name + "::");
+		}
+	}
+
+	string find(const string& name, string ns) const
+	{
+		for (; ; ns = outer_namespace(ns))
+		{
+			if (this->functions.count(ns + name))
+				return ns + name;
+			if (ns.empty())
+				return "";
+		}
+	}
+
+	std::function<void(Nodes::Expression*)> caller(const string& ns)
+	{
+		return [this, ns](Nodes::Expression* e)
+		{
+			if (auto call = dynamic_cast<Nodes::FunctionCallExpression*>(e))
+				reach(call->name, ns);
+		};
+	}
+
+	// Default arguments are compiled where the function is called, so they're looked up from there
+	void reach(const string& name, const string& ns)
+	{
+		string found = find(name, ns);
+		if (found.empty())
+			return;
+
+		if (this->defaults.insert({found, ns}).second)
+			for (auto decl : this->functions[found].decls)
+				for (auto& arg : decl->args)
+					for_each_expression(arg.second, caller(ns));
+
+		if (this->reached.insert(found).second)
+			this->pending.push_back(found);
+	}
+
+	// The code outside of functions runs before main
+	void roots(Nodes::StatementBlock* block, const string& ns)
+	{
+		for (auto statement : block->statements)
+		{
+			if (IsType<Nodes::FunctionDecl>(statement))
+				continue;
+			else if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+				roots(nspace->body, ns + nspace->name + "::");
+			else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+				for_each_class_expression(cls, caller(ns));
+			else for_each_expression(statement, caller(ns));
+		}
+	}
+
+	void run(Nodes::StatementBlock* program)
+	{
+		collect(program, "");
+		if (this->functions.count("main"))
+			reach("main", "");
+		roots(program, "");
+
+		while (!this->pending.empty())
+		{
+			string name = this->pending.back();
+			this->pending.pop_back();
+			const Definition& def = this->functions[name];
+			for (auto decl : def.decls)
+				for_each_expression(decl->body, caller(def.ns));
+		}
+	}
+};
+
+// Can be dropped with nothing else changing if nothing reads it
+static bool pure(const Nodes::Expression* expr)
+{
+	if (expr == nullptr || IsType<Nodes::NumLiteralExpression>(expr) || IsType<Nodes::BoolLiteralExpression>(expr)
+		|| IsType<Nodes::StringLiteralExpression>(expr) || IsType<Nodes::NullLiteralExpression>(expr))
+		return true;
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return pure(paren->value);
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr))
+		return unary->op == operators::MINUS && IsType<Nodes::NumLiteralExpression>(unary->value);
+	if (auto array = dynamic_cast<const Nodes::ArrayLiteralExpression*>(expr))
+	{
+		for (auto value : array->values)
+			if (!pure(value))
+				return false;
+		return true;
+	}
+	return false;
+}
+
+static string unqualified(const string& name)
+{
+	size_t at = name.rfind("::");
+	return at == string::npos ? name : name.substr(at + 2);
+}
+
+// Takes out the functions that aren't reached, returns how many
+static size_t sweep_functions(Nodes::StatementBlock* block, const string& ns, const Names& reached)
+{
+	size_t removed = 0;
+	vector<Nodes::Statement*> kept;
+	for (auto statement : block->statements)
+	{
+		if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement); function && !reached.count(ns + function->name))
+		{
+			removed++;
+			continue;
+		}
+		if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+			removed += sweep_functions(nspace->body, ns + nspace->name + "::", reached);
+		kept.push_back(statement);
+	}
+	block->statements = kept;
+	return removed;
+}
+
+// Every name that's read or written anywhere, without its namespace
+static void used_names(Nodes::StatementBlock* block, Names& used)
+{
+	auto use = [&](Nodes::Expression* e)
+	{
+		if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e)) used.insert(unqualified(id->name));
+		else if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e)) used.insert(unqualified(assign->name));
+	};
+	for (auto statement : block->statements)
+	{
+		if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+			used_names(nspace->body, used);
+		else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+			for_each_class_expression(cls, use);
+		else for_each_expression(statement, use);
+	}
+}
+
+// Takes out the globals no name anywhere could mean, and the namespaces that are left empty
+static void sweep_globals(Nodes::StatementBlock* block, const Names& used)
+{
+	vector<Nodes::Statement*> kept;
+	for (auto statement : block->statements)
+	{
+		if (auto var = dynamic_cast<Nodes::VarDecl*>(statement); var && !used.count(var->name) && pure(var->value)
+			&& (var->type != vartypes::INT || var->value == nullptr || IsType<Nodes::NumLiteralExpression>(var->value)))
+		{
+			delete var;
+			continue;
+		}
+		if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+		{
+			sweep_globals(nspace->body, used);
+			if (nspace->body->statements.empty())
+				continue;
+		}
+		kept.push_back(statement);
+	}
+	block->statements = kept;
+}
+
+size_t eliminate_dead_code(Nodes::StatementBlock& program)
+{
+	prune(&program, false);
+
+	Reachability reachability;
+	reachability.run(&program);
+	size_t removed = sweep_functions(&program, "", reachability.reached);
+
+	Names used;
+	used_names(&program, used);
+	sweep_globals(&program, used);
+	return removed;
+}
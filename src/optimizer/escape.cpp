@@ -0,0 +1,308 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+// An arr literal or an instance a function only ever reads and writes the parts of, with a constant index or
+// the name of a field, never leaves it: nothing else can see it, so it doesn't have to exist at all. Every part
+// becomes a local of its own instead, which never gets to the heap and the collector never looks at
+
+// More parts than this would take too many registers for what it saves
+#define ESCAPE_MAX_PARTS 16
+
+// Copies a constant initializer, false if it isn't one. Every instance gets a new arr from an arr literal,
+// and so does every copy
+static bool literal(const Nodes::Expression* expr, Nodes::Expression*& copy)
+{
+	if (expr == nullptr)
+		copy = nullptr;
+	else if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expr))
+		copy = new Nodes::NumLiteralExpression{num->position, num->value};
+	else if (auto b = dynamic_cast<const Nodes::BoolLiteralExpression*>(expr))
+		copy = new Nodes::BoolLiteralExpression{b->position, b->value};
+	else if (auto s = dynamic_cast<const Nodes::StringLiteralExpression*>(expr))
+		copy = new Nodes::StringLiteralExpression{s->position, s->value};
+	else if (IsType<Nodes::NullLiteralExpression>(expr))
+		copy = new Nodes::NullLiteralExpression{expr->position};
+	else if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr); unary && unary->op == operators::MINUS)
+	{
+		auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(unary->value);
+		if (!num)
+			return false;
+		copy = new Nodes::NumLiteralExpression{num->position, -num->value};
+	}
+	else if (auto array = dynamic_cast<const Nodes::ArrayLiteralExpression*>(expr))
+	{
+		vector<Nodes::Expression*> values;
+		for (auto value : array->values)
+		{
+			Nodes::Expression* element;
+			if (!literal(value, element))
+				return false;
+			values.push_back(element);
+		}
+		copy = new Nodes::ArrayLiteralExpression{array->position, values};
+	}
+	else return false;
+	return true;
+}
+
+// The classes whose instances can be taken apart, by name with their namespace: the ones without an
+// initialize, which would get the instance, and with constant initializers, which can be copied into any
+// function. The functions are there because a call finds a function and a class the same way
+struct Classes
+{
+	map<string, Nodes::ClassDecl*> classes;
+	Names functions;
+
+	void collect(Nodes::StatementBlock* block, const string& ns)
+	{
+		for (auto statement : block->statements)
+		{
+			if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+				this->functions.insert(ns + function->name);
+			else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+				this->classes[ns + cls->name] = cls;
+			else if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+				collect(nspace->body, ns + nspace->name + "::");
+		}
+	}
+
+	// nullptr if the call isn't a construction of a class like that, found from the innermost namespace
+	// outwards like the compiler does
+	Nodes::ClassDecl* constructed(const Nodes::Expression* value, string ns) const
+	{
+		auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(value);
+		if (!call || !call->args.empty())
+			return nullptr;
+		for (; ; )
+		{
+			if (this->functions.count(ns + call->name))
+				return nullptr;
+			auto found = this->classes.find(ns + call->name);
+			if (found != this->classes.end())
+				return simple(found->second) ? found->second : nullptr;
+			if (ns.empty())
+				return nullptr;
+			size_t at = ns.size() > 2 ? ns.rfind("::", ns.size() - 3) : string::npos;
+			ns = at == string::npos ? "" : ns.substr(0, at + 2);
+		}
+	}
+
+	static bool simple(const Nodes::ClassDecl* cls)
+	{
+		if (cls->members.size() > ESCAPE_MAX_PARTS)
+			return false;
+		for (auto function : cls->sysFunctions)
+			if (function->name == "initialize")
+				return false;
+		for (auto& member : cls->members)
+		{
+			Nodes::Expression* copy;
+			if (!literal(member.first->value, copy))
+				return false;
+			delete copy;
+		}
+		return true;
+	}
+};
+
+struct ScalarReplacer
+{
+	const Classes& classes;
+	size_t replaced;
+
+	// What the variable can be taken apart into, the names of its parts
+	vector<string> parts(Nodes::VarDecl* var, const string& ns)
+	{
+		vector<string> names;
+		if (auto array = dynamic_cast<Nodes::ArrayLiteralExpression*>(var->value))
+		{
+			if (array->values.size() <= ESCAPE_MAX_PARTS)
+				for (size_t i = 0; i < array->values.size(); i++)
+					names.push_back(std::to_string(i));
+		}
+		else if (auto cls = this->classes.constructed(var->value, ns))
+		{
+			for (auto& member : cls->members)
+				if (member.second == Nodes::Access::PUBLIC)
+					names.push_back(member.first->name);
+		}
+		return names;
+	}
+
+	// The part of the variable the expression reads or writes, or "" if it's anything else
+	static string part(const Nodes::Expression* expr, const string& name, bool array)
+	{
+		const Nodes::Expression* object = nullptr;
+		const Nodes::Expression* index = nullptr;
+		string member;
+		if (auto access = dynamic_cast<const Nodes::ArrayAccessExpression*>(expr)) { object = access->array; index = access->index; }
+		else if (auto assign = dynamic_cast<const Nodes::IndexAssignExpression*>(expr)) { object = assign->array; index = assign->index; }
+		else if (auto access = dynamic_cast<const Nodes::MemberAccessExpression*>(expr)) { object = access->object; member = access->name; }
+		else if (auto assign = dynamic_cast<const Nodes::MemberAssignExpression*>(expr)) { object = assign->object; member = assign->name; }
+
+		auto id = dynamic_cast<const Nodes::IdentifierExpression*>(object);
+		if (!id || id->name != name || array != (index != nullptr))
+			return "";
+		double i;
+		if (!array)
+			return member;
+		if (!get_constant_number(index, i) || i != trunc(i) || i < 0)
+			return "";
+		return std::to_string((size_t)i);
+	}
+
+	// Takes apart the variable declared at block[index] if every use of it is in the statements after it and
+	// reads or writes one of its parts
+	bool replace(Nodes::FunctionDecl* function, Nodes::StatementBlock* block, size_t index, const string& ns)
+	{
+		auto var = dynamic_cast<Nodes::VarDecl*>(block->statements[index]);
+		if (!var || var->type != vartypes::VAR)
+			return false;
+		const string& name = var->name;
+		vector<string> names = parts(var, ns);
+		if (names.empty())
+			return false;
+		bool array = IsType<Nodes::ArrayLiteralExpression>(var->value);
+		Names known(names.begin(), names.end());
+
+		// Declared only here, and not in its own initializer, which would mean another variable
+		size_t definitions = 0;
+		for (auto& arg : function->args)
+			definitions += arg.first.second == name;
+		for_each_definition(function->body, [&](const string& defined, const Nodes::Expression*) { definitions += defined == name; });
+		size_t uses = 0;
+		for_each_expression(function->body, [&](Nodes::Expression* e)
+		{
+			if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e)) uses += id->name == name;
+		});
+		bool inside = false;
+		for_each_expression(var->value, [&](Nodes::Expression* e)
+		{
+			if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e)) inside |= id->name == name;
+		});
+		if (definitions != 1 || inside)
+			return false;
+
+		// An int field rounds what's stored in it, but the assignment gives what it got and a local doesn't, so
+		// those can only be statements of their own
+		Nodes::ClassDecl* cls = array ? nullptr : this->classes.constructed(var->value, ns);
+		std::set<const Nodes::Expression*> statements;
+		for_each_block(block, [&](Nodes::StatementBlock* b)
+		{
+			for (auto statement : b->statements)
+				if (auto expr = dynamic_cast<Nodes::ExpressionStatement*>(statement))
+					statements.insert(expr->value);
+		});
+		auto int_field = [&](const string& member)
+		{
+			for (auto& field : cls->members)
+				if (field.first->name == member)
+					return field.first->type == vartypes::INT;
+			return false;
+		};
+
+		size_t parts_used = 0;
+		Names used;
+		for (size_t i = index + 1; i < block->statements.size(); i++)
+		{
+			for_each_expression(block->statements[i], [&](Nodes::Expression* e)
+			{
+				string p = part(e, name, array);
+				if (p.empty() || !known.count(p))
+					return;
+				if (cls && IsType<Nodes::MemberAssignExpression>(e) && int_field(p) && !statements.count(e))
+					return;
+				parts_used++;
+				used.insert(p);
+			});
+		}
+		if (parts_used != uses)
+			return false;
+
+		// The parts are declared in the order the arr literal has its values, so they still run in that order
+		vector<Nodes::Statement*> decls;
+		if (array)
+		{
+			auto values = static_cast<Nodes::ArrayLiteralExpression*>(var->value)->values;
+			for (size_t i = 0; i < values.size(); i++)
+				decls.push_back(new Nodes::VarDecl{values[i]->position, vartypes::VAR, "@" + name + "." + names[i], values[i]});
+		}
+		else
+		{
+			// Only the fields it uses, the others are constants nothing would see
+			vector<Nodes::VarDecl*> fields;
+			for (auto& member : cls->members)
+				if (used.count(member.first->name))
+					fields.push_back(member.first);
+			std::sort(fields.begin(), fields.end(), [](auto x, auto y) { return x->position < y->position; });
+			for (auto field : fields)
+			{
+				Nodes::Expression* value;
+				literal(field->value, value);
+				decls.push_back(new Nodes::VarDecl{var->position, field->type, "@" + name + "." + field->name, value});
+			}
+		}
+
+		std::function<bool(Nodes::Expression*&)> fn = [&](Nodes::Expression*& e)
+		{
+			string p = part(e, name, array);
+			if (p.empty())
+				return false;
+			string local = "@" + name + "." + p;
+			Nodes::Expression* value = nullptr;
+			if (auto assign = dynamic_cast<Nodes::IndexAssignExpression*>(e)) value = assign->value;
+			else if (auto assign = dynamic_cast<Nodes::MemberAssignExpression*>(e)) value = assign->value;
+			if (!value)
+			{
+				e = new Nodes::IdentifierExpression{e->position, local};
+				return true;
+			}
+			rewrite_expressions(value, fn);
+			e = new Nodes::AssignExpression{e->position, local, value};
+			return true;
+		};
+		for (size_t i = index + 1; i < block->statements.size(); i++)
+			rewrite_expressions(block->statements[i], fn);
+
+		block->statements.erase(block->statements.begin() + index);
+		block->statements.insert(block->statements.begin() + index, decls.begin(), decls.end());
+		this->replaced++;
+		return true;
+	}
+
+	void run(Nodes::FunctionDecl* function, const string& ns)
+	{
+		for_each_block(function->body, [&](Nodes::StatementBlock* block)
+		{
+			for (size_t i = 0; i < block->statements.size(); i++)
+				replace(function, block, i, ns);
+		});
+	}
+
+	void visit(Nodes::StatementBlock* block, const string& ns)
+	{
+		for (auto statement : block->statements)
+		{
+			if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+				run(function, ns);
+			else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+			{
+				for (auto& method : cls->functions)
+					run(method.first, ns);
+			}
+			else if (auto nspace = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+				visit(nspace->body, ns + nspace->name + "::");
+		}
+	}
+};
+
+size_t replace_scalars(Nodes::StatementBlock& program)
+{
+	Classes classes;
+	classes.collect(&program, "");
+	ScalarReplacer replacer{classes, 0};
+	replacer.visit(&program, "");
+	return replacer.replaced;
+}
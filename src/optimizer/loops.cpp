@@ -0,0 +1,246 @@
+#include "optimizer.hpp"
+
+#include <math.h>
+
+// Both passes only move arithmetic on numbers, which never fails and has nothing else to it, so it can't
+// be told apart when it runs once before the loop instead of in every iteration, or even when the loop
+// never runs. They only look at functions, anything the body calls could change a global
+
+// Strength reduction keeps the variable and the products whole numbers that doubles hold exactly
+#define LOOPS_MAX_INDUCTION (1 << 30)
+#define LOOPS_MAX_FACTOR (1 << 16)
+
+// Tells expressions with the same value apart, e.g. (a * 2) and a * 2 are the same
+static string key(const Nodes::Expression* expr)
+{
+	if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expr))
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.17g", num->value);
+		return buffer;
+	}
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expr))
+		return id->name;
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return key(paren->value);
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr))
+		return "(-" + key(unary->value) + ")";
+	auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expr);
+	return "(" + key(binary->left) + " " + std::to_string(uenum(binary->op)) + " " + key(binary->right) + ")";
+}
+
+struct LoopOptimizer
+{
+	Names& numeric; // The variables it declares are numbers too
+	size_t& temps;
+
+	// The names that get a value anywhere in the loop, so expressions that read them can't leave it
+	Names written(Nodes::Statement* loop)
+	{
+		Names names;
+		auto add = [&](Nodes::Expression* e)
+		{
+			if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e)) names.insert(assign->name);
+			else if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(e)) names.insert(var->name);
+		};
+		Nodes::StatementBlock* body = nullptr;
+		if (auto l = dynamic_cast<Nodes::For*>(loop))
+		{
+			body = l->body;
+			for (auto e : {l->init, l->condition, l->step})
+				for_each_expression(e, add);
+		}
+		else if (auto l = dynamic_cast<Nodes::ForIter*>(loop))
+		{
+			body = l->body;
+			if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(l->init)) names.insert(id->name);
+			else add(l->init);
+		}
+		else if (auto l = dynamic_cast<Nodes::While*>(loop))
+		{
+			body = l->body;
+			for_each_expression(l->condition, add);
+		}
+		for_each_definition(body, [&](const string& name, const Nodes::Expression*) { names.insert(name); });
+		return names;
+	}
+
+	// Arithmetic that reads locals the loop doesn't write, worth a variable of its own
+	bool invariant(const Nodes::Expression* expr, const Names& written)
+	{
+		if (!is_numeric(expr, this->numeric))
+			return false;
+
+		const Nodes::Expression* inner = expr;
+		while (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(inner))
+			inner = paren->value;
+		if (!IsType<Nodes::BinaryExpression>(inner))
+			return false;
+
+		bool reads = false, changes = false;
+		for_each_expression(const_cast<Nodes::Expression*>(expr), [&](Nodes::Expression* e)
+		{
+			if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e))
+			{
+				reads = true;
+				changes |= written.count(id->name) > 0;
+			}
+		});
+		return reads && !changes;
+	}
+
+	// Moves the biggest invariant expressions of the loop at block[index] to variables declared right
+	// before it, returns how many were declared
+	size_t hoist(Nodes::StatementBlock* block, size_t index)
+	{
+		Nodes::Statement* loop = block->statements[index];
+		Names names = written(loop);
+		map<string, string> hoisted; // By key, the variable that has it
+		vector<Nodes::Statement*> decls;
+
+		auto fn = [&](Nodes::Expression*& e)
+		{
+			if (!invariant(e, names))
+				return false;
+			string k = key(e);
+			auto found = hoisted.find(k);
+			if (found == hoisted.end())
+			{
+				string name = "@inv" + std::to_string(this->temps++);
+				found = hoisted.insert({k, name}).first;
+				this->numeric.insert(name);
+				decls.push_back(new Nodes::VarDecl{e->position, vartypes::VAR, name, e});
+			}
+			e = new Nodes::IdentifierExpression{e->position, found->second};
+			return true;
+		};
+
+		// The init of a for and what a for iterates over only run once anyway
+		if (auto l = dynamic_cast<Nodes::For*>(loop))
+		{
+			rewrite_expressions(l->condition, fn);
+			rewrite_expressions(l->step, fn);
+			rewrite_expressions(l->body, fn);
+		}
+		else if (auto l = dynamic_cast<Nodes::ForIter*>(loop))
+			rewrite_expressions(l->body, fn);
+		else if (auto l = dynamic_cast<Nodes::While*>(loop))
+		{
+			rewrite_expressions(l->condition, fn);
+			rewrite_expressions(l->body, fn);
+		}
+
+		block->statements.insert(block->statements.begin() + index, decls.begin(), decls.end());
+		return decls.size();
+	}
+
+	// In a loop from a range with a constant start and step, i * k goes up by step * k every iteration, so
+	// it's kept in a variable that's added to at the end of the body instead. continue would skip that
+	size_t reduce(Nodes::StatementBlock* block, size_t index)
+	{
+		auto loop = dynamic_cast<Nodes::For*>(block->statements[index]);
+		if (!loop || !loop->range)
+			return 0;
+
+		auto decl = dynamic_cast<Nodes::VarDeclExpression*>(loop->init);
+		auto step = dynamic_cast<Nodes::AssignExpression*>(loop->step);
+		auto increment = step ? dynamic_cast<Nodes::BinaryExpression*>(step->value) : nullptr;
+		double start, by;
+		if (!decl || !increment || increment->op != operators::PLUS || !get_constant_number(decl->value, start) || !get_constant_number(increment->right, by))
+			return 0;
+		if (start != trunc(start) || fabs(start) > LOOPS_MAX_INDUCTION || by != trunc(by) || fabs(by) > LOOPS_MAX_INDUCTION)
+			return 0;
+
+		bool skips = false;
+		for_each_block(loop->body, [&](Nodes::StatementBlock* b)
+		{
+			for (auto statement : b->statements)
+				skips |= IsType<Nodes::Continue>(statement);
+		});
+		Names body;
+		for_each_definition(loop->body, [&](const string& name, const Nodes::Expression*) { body.insert(name); });
+		if (skips || body.count(decl->name))
+			return 0;
+
+		const string& name = decl->name;
+		map<double, string> products; // By factor, the variable that has it
+		rewrite_expressions(loop->body, [&](Nodes::Expression*& e)
+		{
+			auto mul = dynamic_cast<Nodes::BinaryExpression*>(e);
+			if (!mul || mul->op != operators::MUL)
+				return false;
+			auto left = dynamic_cast<Nodes::IdentifierExpression*>(mul->left);
+			auto right = dynamic_cast<Nodes::IdentifierExpression*>(mul->right);
+			double factor;
+			bool found = (left && left->name == name && get_constant_number(mul->right, factor))
+				|| (right && right->name == name && get_constant_number(mul->left, factor));
+			if (!found || factor != trunc(factor) || fabs(factor) > LOOPS_MAX_FACTOR)
+				return false;
+
+			auto product = products.find(factor);
+			if (product == products.end())
+			{
+				product = products.insert({factor, "@iv" + std::to_string(this->temps++)}).first;
+				this->numeric.insert(product->second);
+			}
+			e = new Nodes::IdentifierExpression{e->position, product->second};
+			return true;
+		});
+
+		size_t pos = loop->position;
+		for (auto& product : products)
+		{
+			block->statements.insert(block->statements.begin() + index, new Nodes::VarDecl{pos, vartypes::VAR, product.second,
+				new Nodes::NumLiteralExpression{pos, start * product.first}});
+			loop->body->statements.push_back(new Nodes::ExpressionStatement{pos, new Nodes::AssignExpression{pos, product.second,
+				new Nodes::BinaryExpression{pos, new Nodes::IdentifierExpression{pos, product.second}, operators::PLUS,
+					new Nodes::NumLiteralExpression{pos, by * product.first}}}});
+		}
+		return products.size();
+	}
+
+	// Outer loops first, what they hoist is hoisted out of the loops in them too
+	void optimize(Nodes::StatementBlock* block)
+	{
+		for (size_t i = 0; i < block->statements.size(); i++)
+		{
+			Nodes::Statement* statement = block->statements[i];
+			if (auto b = dynamic_cast<Nodes::StatementBlock*>(statement))
+				optimize(b);
+			else if (auto ite = dynamic_cast<Nodes::Ite*>(statement))
+			{
+				optimize(ite->ifBranch);
+				if (ite->elseBranch) optimize(ite->elseBranch);
+			}
+			else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+			{
+				i += hoist(block, i);
+				i += reduce(block, i);
+				optimize(loop->body);
+			}
+			else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+			{
+				i += hoist(block, i);
+				optimize(loop->body);
+			}
+			else if (auto loop = dynamic_cast<Nodes::While*>(statement))
+			{
+				i += hoist(block, i);
+				optimize(loop->body);
+			}
+		}
+	}
+};
+
+void optimize_loops(Nodes::StatementBlock& program)
+{
+	size_t temps = 0;
+
+	Names globals = global_names(&program);
+
+	for_each_function(&program, [&](Nodes::FunctionDecl* function)
+	{
+		Names numeric = numeric_locals(function, globals);
+		LoopOptimizer{numeric, temps}.optimize(function->body);
+	});
+}
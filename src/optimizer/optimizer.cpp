@@ -0,0 +1,391 @@
+#include "optimizer.hpp"
+
+void for_each_block(Nodes::StatementBlock* block, const std::function<void(Nodes::StatementBlock*)>& fn)
+{
+	for (auto& statement : block->statements)
+	{
+		if (auto b = dynamic_cast<Nodes::StatementBlock*>(statement))
+			for_each_block(b, fn);
+		else if (auto ite = dynamic_cast<Nodes::Ite*>(statement))
+		{
+			for_each_block(ite->ifBranch, fn);
+			for_each_block(ite->elseBranch, fn);
+		}
+		else if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+			for_each_block(function->body, fn);
+		else if (auto function = dynamic_cast<Nodes::ClassSysFunctionDecl*>(statement))
+			for_each_block(function->body, fn);
+		else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+		{
+			for (auto& function : cls->functions)
+				for_each_block(function.first->body, fn);
+			for (auto& function : cls->sysFunctions)
+				for_each_block(function->body, fn);
+		}
+		else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+			for_each_block(ns->body, fn);
+		else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+			for_each_block(loop->body, fn);
+		else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+			for_each_block(loop->body, fn);
+		else if (auto loop = dynamic_cast<Nodes::While*>(statement))
+			for_each_block(loop->body, fn);
+	}
+
+	fn(block);
+}
+
+void for_each_function(Nodes::StatementBlock* block, const std::function<void(Nodes::FunctionDecl*)>& fn)
+{
+	for (auto& statement : block->statements)
+	{
+		if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+			fn(function);
+		else if (auto cls = dynamic_cast<Nodes::ClassDecl*>(statement))
+		{
+			for (auto& method : cls->functions)
+				fn(method.first);
+		}
+		else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+			for_each_function(ns->body, fn);
+	}
+}
+
+void for_each_expression(Nodes::Statement* statement, const std::function<void(Nodes::Expression*)>& fn)
+{
+	if (statement == nullptr)
+		return;
+
+	if (auto block = dynamic_cast<Nodes::StatementBlock*>(statement))
+	{
+		for (auto s : block->statements)
+			for_each_expression(s, fn);
+	}
+	else if (auto expr = dynamic_cast<Nodes::ExpressionStatement*>(statement))
+		for_each_expression(expr->value, fn);
+	else if (auto var = dynamic_cast<Nodes::VarDecl*>(statement))
+		for_each_expression(var->value, fn);
+	else if (auto ite = dynamic_cast<Nodes::Ite*>(statement))
+	{
+		for_each_expression(ite->condition, fn);
+		for_each_expression(ite->ifBranch, fn);
+		for_each_expression(ite->elseBranch, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+	{
+		for_each_expression(loop->init, fn);
+		for_each_expression(loop->condition, fn);
+		for_each_expression(loop->step, fn);
+		for_each_expression(loop->body, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+	{
+		for_each_expression(loop->init, fn);
+		for_each_expression(loop->iterOrNum, fn);
+		for_each_expression(loop->body, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::While*>(statement))
+	{
+		for_each_expression(loop->condition, fn);
+		for_each_expression(loop->body, fn);
+	}
+	else if (auto ret = dynamic_cast<Nodes::Return*>(statement))
+		for_each_expression(ret->value, fn);
+	else if (auto function = dynamic_cast<Nodes::FunctionDecl*>(statement))
+	{
+		for (auto& arg : function->args)
+			for_each_expression(arg.second, fn);
+		for_each_expression(function->body, fn);
+	}
+	else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+		for_each_expression(ns->body, fn);
+}
+
+void for_each_expression(Nodes::Expression* expression, const std::function<void(Nodes::Expression*)>& fn)
+{
+	if (expression == nullptr)
+		return;
+
+	fn(expression);
+	if (auto binary = dynamic_cast<Nodes::BinaryExpression*>(expression))
+	{
+		for_each_expression(binary->left, fn);
+		for_each_expression(binary->right, fn);
+	}
+	else if (auto assign = dynamic_cast<Nodes::AssignExpression*>(expression))
+		for_each_expression(assign->value, fn);
+	else if (auto unary = dynamic_cast<Nodes::UnaryExpression*>(expression))
+		for_each_expression(unary->value, fn);
+	else if (auto paren = dynamic_cast<Nodes::ParenthesisExpression*>(expression))
+		for_each_expression(paren->value, fn);
+	else if (auto ternary = dynamic_cast<Nodes::TernaryExpression*>(expression))
+	{
+		for_each_expression(ternary->condition, fn);
+		for_each_expression(ternary->true_value, fn);
+		for_each_expression(ternary->false_value, fn);
+	}
+	else if (auto call = dynamic_cast<Nodes::FunctionCallExpression*>(expression))
+	{
+		for (auto arg : call->args)
+			for_each_expression(arg, fn);
+	}
+	else if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(expression))
+		for_each_expression(var->value, fn);
+	else if (auto access = dynamic_cast<Nodes::ArrayAccessExpression*>(expression))
+	{
+		for_each_expression(access->array, fn);
+		for_each_expression(access->index, fn);
+	}
+	else if (auto assign = dynamic_cast<Nodes::IndexAssignExpression*>(expression))
+	{
+		for_each_expression(assign->array, fn);
+		for_each_expression(assign->index, fn);
+		for_each_expression(assign->value, fn);
+	}
+	else if (auto member = dynamic_cast<Nodes::MemberAccessExpression*>(expression))
+		for_each_expression(member->object, fn);
+	else if (auto assign = dynamic_cast<Nodes::MemberAssignExpression*>(expression))
+	{
+		for_each_expression(assign->object, fn);
+		for_each_expression(assign->value, fn);
+	}
+	else if (auto call = dynamic_cast<Nodes::MethodCallExpression*>(expression))
+	{
+		for_each_expression(call->object, fn);
+		for (auto arg : call->args)
+			for_each_expression(arg, fn);
+	}
+	else if (auto array = dynamic_cast<Nodes::ArrayLiteralExpression*>(expression))
+	{
+		for (auto value : array->values)
+			for_each_expression(value, fn);
+	}
+	else if (auto range = dynamic_cast<Nodes::RangeArrayLiteralExpression*>(expression))
+	{
+		for_each_expression(range->start, fn);
+		for_each_expression(range->end, fn);
+		for_each_expression(range->step, fn);
+	}
+}
+
+void rewrite_expressions(Nodes::Statement* statement, const std::function<bool(Nodes::Expression*&)>& fn)
+{
+	if (statement == nullptr)
+		return;
+
+	if (auto block = dynamic_cast<Nodes::StatementBlock*>(statement))
+	{
+		for (auto s : block->statements)
+			rewrite_expressions(s, fn);
+	}
+	else if (auto expr = dynamic_cast<Nodes::ExpressionStatement*>(statement))
+		rewrite_expressions(expr->value, fn);
+	else if (auto var = dynamic_cast<Nodes::VarDecl*>(statement))
+		rewrite_expressions(var->value, fn);
+	else if (auto ite = dynamic_cast<Nodes::Ite*>(statement))
+	{
+		rewrite_expressions(ite->condition, fn);
+		rewrite_expressions(ite->ifBranch, fn);
+		rewrite_expressions(ite->elseBranch, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+	{
+		rewrite_expressions(loop->init, fn);
+		rewrite_expressions(loop->condition, fn);
+		rewrite_expressions(loop->step, fn);
+		rewrite_expressions(loop->body, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+	{
+		rewrite_expressions(loop->init, fn);
+		rewrite_expressions(loop->iterOrNum, fn);
+		rewrite_expressions(loop->body, fn);
+	}
+	else if (auto loop = dynamic_cast<Nodes::While*>(statement))
+	{
+		rewrite_expressions(loop->condition, fn);
+		rewrite_expressions(loop->body, fn);
+	}
+	else if (auto ret = dynamic_cast<Nodes::Return*>(statement))
+		rewrite_expressions(ret->value, fn);
+}
+
+void rewrite_expressions(Nodes::Expression*& expression, const std::function<bool(Nodes::Expression*&)>& fn)
+{
+	if (expression == nullptr || fn(expression))
+		return;
+
+	if (auto binary = dynamic_cast<Nodes::BinaryExpression*>(expression))
+	{
+		rewrite_expressions(binary->left, fn);
+		rewrite_expressions(binary->right, fn);
+	}
+	else if (auto assign = dynamic_cast<Nodes::AssignExpression*>(expression))
+		rewrite_expressions(assign->value, fn);
+	else if (auto unary = dynamic_cast<Nodes::UnaryExpression*>(expression))
+		rewrite_expressions(unary->value, fn);
+	else if (auto paren = dynamic_cast<Nodes::ParenthesisExpression*>(expression))
+		rewrite_expressions(paren->value, fn);
+	else if (auto ternary = dynamic_cast<Nodes::TernaryExpression*>(expression))
+	{
+		rewrite_expressions(ternary->condition, fn);
+		rewrite_expressions(ternary->true_value, fn);
+		rewrite_expressions(ternary->false_value, fn);
+	}
+	else if (auto call = dynamic_cast<Nodes::FunctionCallExpression*>(expression))
+	{
+		for (auto& arg : call->args)
+			rewrite_expressions(arg, fn);
+	}
+	else if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(expression))
+		rewrite_expressions(var->value, fn);
+	else if (auto access = dynamic_cast<Nodes::ArrayAccessExpression*>(expression))
+	{
+		rewrite_expressions(access->array, fn);
+		rewrite_expressions(access->index, fn);
+	}
+	else if (auto assign = dynamic_cast<Nodes::IndexAssignExpression*>(expression))
+	{
+		rewrite_expressions(assign->array, fn);
+		rewrite_expressions(assign->index, fn);
+		rewrite_expressions(assign->value, fn);
+	}
+	else if (auto member = dynamic_cast<Nodes::MemberAccessExpression*>(expression))
+		rewrite_expressions(member->object, fn);
+	else if (auto assign = dynamic_cast<Nodes::MemberAssignExpression*>(expression))
+	{
+		rewrite_expressions(assign->object, fn);
+		rewrite_expressions(assign->value, fn);
+	}
+	else if (auto call = dynamic_cast<Nodes::MethodCallExpression*>(expression))
+	{
+		rewrite_expressions(call->object, fn);
+		for (auto& arg : call->args)
+			rewrite_expressions(arg, fn);
+	}
+	else if (auto array = dynamic_cast<Nodes::ArrayLiteralExpression*>(expression))
+	{
+		for (auto& value : array->values)
+			rewrite_expressions(value, fn);
+	}
+	else if (auto range = dynamic_cast<Nodes::RangeArrayLiteralExpression*>(expression))
+	{
+		rewrite_expressions(range->start, fn);
+		rewrite_expressions(range->end, fn);
+		rewrite_expressions(range->step, fn);
+	}
+}
+
+void for_each_definition(Nodes::StatementBlock* block, const std::function<void(const string&, const Nodes::Expression*)>& fn)
+{
+	for_each_block(block, [&](Nodes::StatementBlock* b)
+	{
+		for (auto statement : b->statements)
+		{
+			if (auto var = dynamic_cast<Nodes::VarDecl*>(statement))
+				fn(var->name, var->value);
+			else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+			{
+				if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(loop->init)) fn(var->name, nullptr);
+				else if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(loop->init)) fn(id->name, nullptr);
+				else if (auto assign = dynamic_cast<Nodes::AssignExpression*>(loop->init)) fn(assign->name, nullptr);
+			}
+		}
+	});
+	for_each_expression(block, [&](Nodes::Expression* e)
+	{
+		if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e)) fn(assign->name, assign->value);
+		else if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(e)) fn(var->name, var->value);
+	});
+}
+
+static bool is_arithmetic(operators op)
+{
+	return op == operators::PLUS || op == operators::MINUS || op == operators::MUL || op == operators::DIV
+		|| op == operators::MOD || op == operators::POW;
+}
+
+bool is_numeric(const Nodes::Expression* expr, const Names& numeric)
+{
+	if (IsType<Nodes::NumLiteralExpression>(expr))
+		return true;
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expr))
+		return numeric.count(id->name);
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return is_numeric(paren->value, numeric);
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr))
+		return unary->op == operators::MINUS && is_numeric(unary->value, numeric);
+	if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expr))
+		return is_arithmetic(binary->op) && is_numeric(binary->left, numeric) && is_numeric(binary->right, numeric);
+	return false;
+}
+
+// Typed arguments aren't checked when the function is called, so they can be anything. Every local starts
+// as a number and the ones that get a value that isn't one are taken out until nothing changes, so
+// `x = x + 1` keeps x a number
+Names global_names(Nodes::StatementBlock* program)
+{
+	Names globals;
+	for (auto statement : program->statements)
+	{
+		if (auto var = dynamic_cast<Nodes::VarDecl*>(statement)) globals.insert(var->name);
+		else if (auto expr = dynamic_cast<Nodes::ExpressionStatement*>(statement))
+		{
+			if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(expr->value)) globals.insert(var->name);
+		}
+		else if (auto ns = dynamic_cast<Nodes::NamespaceDecl*>(statement))
+		{
+			Names inner = global_names(ns->body);
+			globals.insert(inner.begin(), inner.end());
+		}
+	}
+	return globals;
+}
+
+Names numeric_locals(Nodes::FunctionDecl* function, const Names& globals)
+{
+	vector<pair<string, const Nodes::Expression*>> defs;
+	for (auto& arg : function->args)
+		defs.push_back({arg.first.second, nullptr});
+	for_each_definition(function->body, [&](const string& name, const Nodes::Expression* value) { defs.push_back({name, value}); });
+
+	Names numeric;
+	for (auto& def : defs)
+		if (!globals.count(def.first))
+			numeric.insert(def.first);
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (auto& def : defs)
+		{
+			if (numeric.count(def.first) && (!def.second || !is_numeric(def.second, numeric)))
+			{
+				numeric.erase(def.first);
+				changed = true;
+			}
+		}
+	}
+	return numeric;
+}
+
+bool get_constant_number(const Nodes::Expression* expr, double& value)
+{
+	if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expr))
+	{
+		value = num->value;
+		return true;
+	}
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return get_constant_number(paren->value, value);
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr))
+	{
+		if (unary->op == operators::MINUS && get_constant_number(unary->value, value))
+		{
+			value = -value;
+			return true;
+		}
+	}
+	return false;
+}
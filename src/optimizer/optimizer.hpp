@@ -0,0 +1,56 @@
+#ifndef OPTIMIZER_OPTIMIZER_HPP
+#define OPTIMIZER_OPTIMIZER_HPP
+
+#include <functional>
+#include <set>
+#include "../parser/tree.hpp"
+#include "../macros.hpp"
+
+// Passes that rewrite the tree between the parser and the backend
+
+// Calls fn on every block in the tree, inner blocks before the blocks that contain them
+void for_each_block(Nodes::StatementBlock* block, const std::function<void(Nodes::StatementBlock*)>& fn);
+// Calls fn on every function in the tree, including the ones in namespaces
+void for_each_function(Nodes::StatementBlock* block, const std::function<void(Nodes::FunctionDecl*)>& fn);
+
+// Calls fn on every expression in the statement or the expression, outer expressions before the ones in them
+void for_each_expression(Nodes::Statement* statement, const std::function<void(Nodes::Expression*)>& fn);
+void for_each_expression(Nodes::Expression* expression, const std::function<void(Nodes::Expression*)>& fn);
+
+// Calls fn on the place of every expression in the statement, so it can replace it. If fn returns true it
+// replaced the expression and what's in it is skipped, otherwise fn is called on the expressions in it next
+void rewrite_expressions(Nodes::Statement* statement, const std::function<bool(Nodes::Expression*&)>& fn);
+void rewrite_expressions(Nodes::Expression*& expression, const std::function<bool(Nodes::Expression*&)>& fn);
+
+typedef std::set<string> Names;
+
+// Calls fn with every place a variable gets a value in the block, with the value or nullptr if we can't tell
+void for_each_definition(Nodes::StatementBlock* block, const std::function<void(const string&, const Nodes::Expression*)>& fn);
+// The variables declared at the top level of the file or of a namespace, without the namespace
+Names global_names(Nodes::StatementBlock* program);
+// The locals of the function that only ever hold numbers, none of the globals are
+Names numeric_locals(Nodes::FunctionDecl* function, const Names& globals);
+// If the expression can only be a number, it's made of literals and the numeric locals
+bool is_numeric(const Nodes::Expression* expr, const Names& numeric);
+
+// Gets the value of a number literal, possibly negated or in parenthesis
+bool get_constant_number(const Nodes::Expression* expr, double& value);
+
+// Takes out code that never runs: branches with a constant condition, what comes after a return, a break or
+// a continue, and the functions and globals that main and the code outside of functions never get to.
+// Returns how many functions it took out
+size_t eliminate_dead_code(Nodes::StatementBlock& program);
+
+// Turns the arr literals and the instances a function creates that never leave it, because it only indexes
+// them with constants or reads and writes their fields, into a local for every element or field. Returns how
+// many it took apart
+size_t replace_scalars(Nodes::StatementBlock& program);
+
+// Turns `for x : [a:b:c]` and `for x : n` into counted loops that never build the range
+void lower_ranges(Nodes::StatementBlock& program);
+
+// Hoists arithmetic that doesn't change out of the loops of functions and turns multiplications by a range
+// loop's variable into additions
+void optimize_loops(Nodes::StatementBlock& program);
+
+#endif // OPTIMIZER_OPTIMIZER_HPP
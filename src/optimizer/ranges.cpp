@@ -0,0 +1,289 @@
+#include "optimizer.hpp"
+
+#include <cmath>
+#include <map>
+#include <set>
+
+// The declared type of every variable in a scope, names that were declared with
+// different types are VAR since we can't tell which one a use refers to
+typedef map<string, vartypes> TypeMap;
+
+static void declare(TypeMap& types, const string& name, vartypes type)
+{
+	auto it = types.find(name);
+	if (it == types.end()) types[name] = type;
+	else if (it->second != type) it->second = vartypes::VAR;
+}
+
+static void collect_types(Nodes::StatementBlock* block, TypeMap& types)
+{
+	for_each_block(block, [&](Nodes::StatementBlock* b)
+	{
+		for (auto& statement : b->statements)
+		{
+			Nodes::Expression* init = nullptr;
+			if (auto var = dynamic_cast<Nodes::VarDecl*>(statement))
+				declare(types, var->name, var->type);
+			else if (auto loop = dynamic_cast<Nodes::For*>(statement))
+				init = loop->init;
+			else if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+				init = loop->init;
+			else if (auto expr = dynamic_cast<Nodes::ExpressionStatement*>(statement))
+				init = expr->value;
+
+			if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(init))
+				declare(types, var->name, var->type);
+		}
+	});
+}
+
+static bool is_number(const Nodes::Expression* expr, const TypeMap& types)
+{
+	double value;
+	if (get_constant_number(expr, value))
+		return true;
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expr))
+		return is_number(paren->value, types);
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expr))
+		return unary->op == operators::MINUS && is_number(unary->value, types);
+	if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expr))
+	{
+		switch (binary->op)
+		{
+		case operators::PLUS: case operators::MINUS: case operators::MUL:
+		case operators::DIV: case operators::MOD: case operators::POW:
+			return is_number(binary->left, types) && is_number(binary->right, types);
+		default:
+			return false;
+		}
+	}
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expr))
+	{
+		auto it = types.find(id->name);
+		return it != types.end() && (it->second == vartypes::INT || it->second == vartypes::FLOAT);
+	}
+	return false;
+}
+
+// What a loop can see, locals is nullptr outside of functions
+struct Scope
+{
+	const TypeMap& types;
+	const TypeMap* locals;
+	bool builtinLen; // If len() is the builtin, and not a function of the program
+	const Names* numeric; // The locals that only ever hold numbers, even if they're declared var
+};
+
+// `for i : [0:len(a)]` only reads a in range: arrs never shrink and strs never change, so as long as
+// the body doesn't change a or i, a[i] doesn't need a bounds check. a has to be a local, a function
+// the body calls could give a global a shorter arr
+static void mark_in_bounds(Nodes::ForIter* loop, const string& name, double start, double step, const Nodes::Expression* end, const Scope& scope)
+{
+	auto len = dynamic_cast<const Nodes::FunctionCallExpression*>(end);
+	if (!len || len->name != "len" || !scope.builtinLen || len->args.size() != 1 || !scope.locals)
+		return;
+	auto array = dynamic_cast<const Nodes::IdentifierExpression*>(len->args[0]);
+	if (!array || !scope.locals->count(array->name) || array->name == name)
+		return;
+	if (start < 0 || start != (int64_t)start || step < 1 || step != (int64_t)step)
+		return;
+
+	auto changes = [&](const string& var) { return var == name || var == array->name; };
+	bool changed = false;
+	for_each_expression(loop->body, [&](Nodes::Expression* e)
+	{
+		if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e)) changed |= changes(assign->name);
+		else if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(e)) changed |= changes(var->name);
+	});
+	for_each_block(loop->body, [&](Nodes::StatementBlock* block)
+	{
+		for (auto statement : block->statements)
+		{
+			if (auto var = dynamic_cast<Nodes::VarDecl*>(statement)) changed |= changes(var->name);
+			else if (auto inner = dynamic_cast<Nodes::ForIter*>(statement))
+				if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(inner->init)) changed |= changes(id->name);
+		}
+	});
+	if (changed)
+		return;
+
+	for_each_expression(loop->body, [&](Nodes::Expression* e)
+	{
+		auto access = dynamic_cast<Nodes::ArrayAccessExpression*>(e);
+		if (!access) return;
+		auto a = dynamic_cast<Nodes::IdentifierExpression*>(access->array);
+		auto i = dynamic_cast<Nodes::IdentifierExpression*>(access->index);
+		if (a && i && a->name == array->name && i->name == name)
+			access->inBounds = true;
+	});
+}
+
+// A whole number constant or an int variable
+static bool is_whole(const Nodes::Expression* expr, const TypeMap& types)
+{
+	double value;
+	if (get_constant_number(expr, value))
+		return value == trunc(value);
+	auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expr);
+	if (!id)
+		return false;
+	auto it = types.find(id->name);
+	return it != types.end() && it->second == vartypes::INT;
+}
+
+// A counted loop from `for x : [start:end:step]`, or nullptr if the loop has to iterate a real value
+static Nodes::Statement* lower_for_iter(Nodes::ForIter* loop, const Scope& scope, size_t& temps)
+{
+	size_t pos = loop->position;
+	Nodes::Expression* start;
+	Nodes::Expression* end;
+	Nodes::Expression* step;
+
+	string name;
+	if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(loop->init))
+		name = var->name;
+	else if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(loop->init))
+		name = id->name;
+	else return nullptr;
+
+	// The variable gets the next value of the range every iteration whatever the body did to it, the counted
+	// loop counts with the variable itself so it can't be written in the body
+	bool written = false;
+	for_each_definition(loop->body, [&](const string& defined, const Nodes::Expression*) { written |= defined == name; });
+	if (written)
+		return nullptr;
+
+	if (auto range = dynamic_cast<Nodes::RangeArrayLiteralExpression*>(loop->iterOrNum))
+	{
+		start = range->start;
+		end = range->end;
+		step = range->step;
+	}
+	// for x : n is the same as for x : [0:n:1]
+	else if (is_number(loop->iterOrNum, scope.types) || (scope.numeric && is_numeric(loop->iterOrNum, *scope.numeric)))
+	{
+		start = new Nodes::NumLiteralExpression{pos, 0};
+		end = loop->iterOrNum;
+		step = new Nodes::NumLiteralExpression{pos, 1};
+	}
+	else return nullptr;
+
+	// The range checks its step isn't 0 when it's made, so only a step we know is left to the loop. An int
+	// variable gets every value of the range cut to a whole number but the loop counts with the variable, so
+	// it has to start whole and go up by whole steps to count the same
+	double startValue, stepValue, endValue;
+	bool constantStart = get_constant_number(start, startValue);
+	bool constantEnd = get_constant_number(end, endValue);
+	if (!get_constant_number(step, stepValue) || stepValue == 0)
+		return nullptr;
+	bool truncates;
+	if (auto decl = dynamic_cast<Nodes::VarDeclExpression*>(loop->init))
+		truncates = decl->type == vartypes::INT;
+	else
+	{
+		auto it = scope.types.find(name);
+		truncates = it == scope.types.end() || it->second != vartypes::FLOAT;
+	}
+	if (truncates && (!is_whole(start, scope.types) || stepValue != trunc(stepValue)))
+		return nullptr;
+
+	// The range is evaluated once before the loop, keep the end in a variable unless it's a constant, the
+	// names can't be written in Dig so they never collide with the program's. The start goes first in one
+	// too if it's evaluated before the end, so they're evaluated in order
+	Nodes::StatementBlock* wrapper = new Nodes::StatementBlock{pos};
+	string startName = "@start" + std::to_string(temps);
+	string endName = "@end" + std::to_string(temps);
+	temps++;
+
+	if (!constantStart && !constantEnd)
+	{
+		wrapper->statements.push_back(new Nodes::VarDecl{pos, vartypes::VAR, startName, start});
+		start = new Nodes::IdentifierExpression{pos, startName};
+	}
+	if (!constantEnd)
+		wrapper->statements.push_back(new Nodes::VarDecl{pos, vartypes::VAR, endName, end});
+
+	auto endRef = [&]() -> Nodes::Expression* {
+		if (constantEnd) return new Nodes::NumLiteralExpression{pos, endValue};
+		return new Nodes::IdentifierExpression{pos, endName};
+	};
+	auto var = [&]() { return new Nodes::IdentifierExpression{pos, name}; };
+
+	// Count up or down depending on the step
+	Nodes::Expression* condition = new Nodes::BinaryExpression{pos, var(), stepValue < 0 ? operators::GT : operators::LT, endRef()};
+	Nodes::Expression* increment = new Nodes::AssignExpression{pos, name,
+		new Nodes::BinaryExpression{pos, var(), operators::PLUS, new Nodes::NumLiteralExpression{pos, stepValue}}};
+
+	if (constantStart && dynamic_cast<Nodes::VarDeclExpression*>(loop->init))
+		mark_in_bounds(loop, name, startValue, stepValue, end, scope);
+
+	Nodes::Expression* init;
+	if (auto var = dynamic_cast<Nodes::VarDeclExpression*>(loop->init))
+		init = new Nodes::VarDeclExpression{var->position, var->type, var->name, start};
+	else init = new Nodes::AssignExpression{loop->init->position, name, start};
+
+	Nodes::For* counted = new Nodes::For{pos, init, condition, increment, loop->body};
+	counted->range = true;
+
+	if (wrapper->statements.empty())
+	{
+		delete wrapper;
+		return counted;
+	}
+	wrapper->statements.push_back(counted);
+	return wrapper;
+}
+
+static void lower_block(Nodes::StatementBlock* root, const Scope& scope, std::set<Nodes::ForIter*>& visited, size_t& temps)
+{
+	for_each_block(root, [&](Nodes::StatementBlock* block)
+	{
+		for (auto& statement : block->statements)
+		{
+			auto loop = dynamic_cast<Nodes::ForIter*>(statement);
+			if (loop == nullptr || visited.count(loop))
+				continue;
+			visited.insert(loop);
+
+			if (auto lowered = lower_for_iter(loop, scope, temps))
+				statement = lowered;
+		}
+	});
+}
+
+void lower_ranges(Nodes::StatementBlock& program)
+{
+	size_t temps = 0;
+	std::set<Nodes::ForIter*> visited;
+
+	// Variables declared at the top level of the file
+	TypeMap globals;
+	for (auto& statement : program.statements)
+		if (auto var = dynamic_cast<Nodes::VarDecl*>(statement))
+			declare(globals, var->name, var->type);
+
+	Names globalNames = global_names(&program);
+	bool builtinLen = true;
+	for_each_function(&program, [&](Nodes::FunctionDecl* function) { builtinLen &= function->name != "len"; });
+
+	// Functions see the globals, unless they declare a variable with the same name
+	for_each_function(&program, [&](Nodes::FunctionDecl* function)
+	{
+		TypeMap locals;
+		for (auto& arg : function->args)
+			declare(locals, arg.first.second, arg.first.first);
+		collect_types(function->body, locals);
+
+		TypeMap types = globals;
+		for (auto& local : locals)
+			types[local.first] = local.second;
+
+		Names numeric = numeric_locals(function, globalNames);
+		lower_block(function->body, Scope{types, &locals, builtinLen, &numeric}, visited, temps);
+	});
+
+	// Whatever is left is code outside of functions
+	TypeMap types = globals;
+	collect_types(&program, types);
+	lower_block(&program, Scope{types, nullptr, builtinLen, nullptr}, visited, temps);
+}
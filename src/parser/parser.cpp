@@ -3,6 +3,7 @@
 Parser::Parser(Lexer* lexer)
 {
 	this->lexer = lexer;
+	this->depth = 0;
 }
 
 void Parser::parse(TokenNode& root)
@@ -71,6 +72,9 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 
 	size_t pos = tok.tok.position;
 
+	if (++depth > MAX_NESTING_DEPTH)
+		error(tok, ERROR_TOO_DEEP, MAX_NESTING_DEPTH);
+
 	// We'll need to keep track of the last expression we parsed
 	Nodes::Expression* last = nullptr;
 
@@ -210,7 +214,7 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 				continue;
 			}
 			// if there's a double operator after the identifier, it's an automatic bop
-			else if (tok.next->next->tok.type == toktype::OPERATOR && tok.next->next->tok.keyword == tok.next->tok.keyword)
+			else if (tok.next->next->tok.type == toktype::OPERATOR && tok.next->next->tok.keyword == tok.next->tok.keyword && isDoubleOp(tok.next->tok.keyword))
 			{
 				Nodes::Expression* value = new Nodes::BinaryExpression{pos, new Nodes::IdentifierExpression{pos, tok.tok.str}, static_cast<operators>(tok.next->next->tok.keyword), new Nodes::NumLiteralExpression{tok.tok.position, getValueForDoubleOp(tok.next->next->tok.keyword)}};
 				last = incRet(
@@ -236,17 +240,112 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 			continue;
 		}
 	}
+	// Member of an object, might be a method call or an assignment or simply reading it
+	else if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::DOT))
+	{
+		if (!last || !(IsType<Nodes::IdentifierExpression>(last) || IsType<Nodes::ArrayAccessExpression>(last) || IsType<Nodes::FunctionCallExpression>(last)
+			|| IsType<Nodes::ParenthesisExpression>(last) || IsType<Nodes::MemberAccessExpression>(last) || IsType<Nodes::MethodCallExpression>(last)))
+			error(tok, "Expected an object before '.' (<object>.<member>)");
+		if (tok.next->tok.type != toktype::IDENTIFIER)
+			error(*tok.next, "Expected a member name after '.' (<object>.<member>)");
+
+		string name = tok.next->tok.str;
+		TokenNode* after = tok.next->next;
+
+		// Parse method call
+		if (after->tok.type == toktype::OPERATOR && after->tok.keyword == uenum(operators::LPAREN))
+		{
+			// Collect arguments
+			std::vector<Nodes::Expression*> args;
+			tok = *after->next;
+			while (tok.tok.type != toktype::OPERATOR || tok.tok.keyword != uenum(operators::RPAREN))
+			{
+				args.push_back(parse_expression(tok, 0));
+				// Check for a right parenthesis
+				if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::RPAREN))
+					break;
+				// Account for the comma
+				if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::COMMA))
+					tok = *tok.next;
+				// Account for EOF (if there's no right parenthesis)
+				if (tok.tok.type == toktype::TOK_EOF)
+					error(tok, "Expected ')' after method call");
+			}
+			// Increment the token to skip the closing parenthesis
+			tok = *tok.next;
+
+			last = incRet(
+				new Nodes::MethodCallExpression{pos, last, name, args},
+				tok, 0);
+			continue;
+		}
+		// Parse assignment
+		else if (after->tok.type == toktype::OPERATOR && after->tok.keyword == uenum(operators::ASS))
+		{
+			Nodes::Expression* value = parse_expression(tok, 3);
+			last = incRet(
+				new Nodes::MemberAssignExpression{pos, last, name, value},
+				tok, 0);
+			continue;
+		}
+		// Parse special assignments (+=, --, *=, etc), the object is read twice so it has to be a variable
+		else if (after->tok.type == toktype::OPERATOR && isBinOp(after->tok.keyword)
+			&& ((after->next->tok.type == toktype::OPERATOR && after->next->tok.keyword == uenum(operators::ASS))
+			|| (after->next->tok.type == toktype::OPERATOR && after->next->tok.keyword == after->tok.keyword && isDoubleOp(after->tok.keyword))))
+		{
+			auto object = dynamic_cast<Nodes::IdentifierExpression*>(last);
+			if (!object)
+				error(tok, "%s%s only works on a member of a variable (<name>.<member> %s%s <value>)", getStringFromId(after->tok.keyword).c_str(), getStringFromId(after->next->tok.keyword).c_str(),
+					getStringFromId(after->tok.keyword).c_str(), getStringFromId(after->next->tok.keyword).c_str());
+
+			operators op = static_cast<operators>(after->tok.keyword);
+			size_t binExprPos = after->tok.position;
+			Nodes::Expression* read = new Nodes::MemberAccessExpression{pos, new Nodes::IdentifierExpression{object->position, object->name}, name};
+			Nodes::Expression* value;
+			if (after->next->tok.keyword == uenum(operators::ASS))
+				value = new Nodes::BinaryExpression{binExprPos, read, op, parse_expression(tok, 4)};
+			else
+			{
+				value = new Nodes::BinaryExpression{binExprPos, read, op, new Nodes::NumLiteralExpression{binExprPos, getValueForDoubleOp(after->tok.keyword)}};
+				tok = *after->next->next;
+			}
+			last = incRet(
+				new Nodes::MemberAssignExpression{pos, last, name, value},
+				tok, 0);
+			continue;
+		}
+		// It's just reading the member
+		else
+		{
+			last = incRet(
+				new Nodes::MemberAccessExpression{pos, last, name},
+				tok, 2);
+			continue;
+		}
+	}
 	// Check for array literal or array access
 	else if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::LBRACK))
 	{
-		// if last is IdentifierExpression or a literal, we'll assume it's an array access
-		if (last && (IsType<Nodes::IdentifierExpression>(last) || IsType<Nodes::StringLiteralExpression>(last) || IsType<Nodes::ArrayLiteralExpression>(last)))
+		// if last is IdentifierExpression, a literal or something that gives a value, we'll assume it's an array access
+		if (last && (IsType<Nodes::IdentifierExpression>(last) || IsType<Nodes::StringLiteralExpression>(last) || IsType<Nodes::ArrayLiteralExpression>(last)
+			|| IsType<Nodes::ArrayAccessExpression>(last) || IsType<Nodes::FunctionCallExpression>(last) || IsType<Nodes::ParenthesisExpression>(last)
+			|| IsType<Nodes::MemberAccessExpression>(last) || IsType<Nodes::MethodCallExpression>(last)))
 		{
 			// Parse array access
 			Nodes::Expression* index = parse_expression(tok, 1);
 			// skip the closing bracket
 			tok = *tok.next;
 
+			// Assigning to the element, array[index] = value
+			if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::ASS))
+			{
+				Nodes::Expression* value = parse_expression(tok, 1);
+				last = incRet(
+					new Nodes::IndexAssignExpression{pos, last, index, value},
+					tok, 0);
+				continue;
+			}
+
 			last = incRet(
 				new Nodes::ArrayAccessExpression{pos, last, index},
 				tok, 0);
@@ -262,16 +361,26 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 		std::vector<Nodes::Expression*> elements;
 		TokenNode* elem = tok.next;
 		bool isRangeLiteral = false;
+		int nesting = 0; // Only look at the colons and commas that belong to this literal, not to nested ones
 		// Check if there's a colon between the brackets by looping through the tokens until we find a closing bracket
-		while (elem->tok.type != toktype::OPERATOR || elem->tok.keyword != uenum(operators::RBRACK))
+		while (nesting > 0 || elem->tok.type != toktype::OPERATOR || elem->tok.keyword != uenum(operators::RBRACK))
 		{
-			// Check if it's a colon - it's a range literal
-			if (elem->tok.type == toktype::OPERATOR && elem->tok.keyword == uenum(operators::COLON))
-				{isRangeLiteral = true;
-				break;}
-			// Check if it's a comma = it's a normal array literal
-			else if (elem->tok.type == toktype::OPERATOR && elem->tok.keyword == uenum(operators::COMMA))
-				break;
+			if (elem->tok.type == toktype::TOK_EOF)
+				error(tok, "Expected closing bracket");
+			if (elem->tok.type == toktype::OPERATOR)
+			{
+				if (elem->tok.keyword == uenum(operators::LBRACK) || elem->tok.keyword == uenum(operators::LPAREN))
+					nesting++;
+				else if (elem->tok.keyword == uenum(operators::RBRACK) || elem->tok.keyword == uenum(operators::RPAREN))
+					nesting--;
+				// Check if it's a colon - it's a range literal
+				else if (nesting == 0 && elem->tok.keyword == uenum(operators::COLON))
+					{isRangeLiteral = true;
+					break;}
+				// Check if it's a comma = it's a normal array literal
+				else if (nesting == 0 && elem->tok.keyword == uenum(operators::COMMA))
+					break;
+			}
 			// increment the elem
 			elem = elem->next;
 		}
@@ -308,11 +417,13 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 		// Else it's a normal array literal
 		while (elem->tok.type != toktype::OPERATOR || elem->tok.keyword != uenum(operators::RBRACK))
 		{
+			// parse_expression leaves elem on the token after the element
 			elements.push_back(parse_expression(*elem, 0));
-			elem = elem->next;
 			// Account for the comma
 			if (elem->tok.type == toktype::OPERATOR && elem->tok.keyword == uenum(operators::COMMA))
 				elem = elem->next;
+			else if (elem->tok.type != toktype::OPERATOR || elem->tok.keyword != uenum(operators::RBRACK))
+				error(*elem, "Expected ',' or ']' after array element");
 		}
 		
 		// Make sure we have a closing bracket
@@ -376,6 +487,10 @@ Nodes::Expression* Parser::parse_expression(TokenNode& tok, int skip) const
 
 	}
 
+	if (last == nullptr)
+		error(tok, "Expected an expression, got %s", tok.tok.tostr().c_str());
+
+	depth--;
 	return last;
 }
 
@@ -403,19 +518,19 @@ Nodes::Statement* Parser::parse_keyword(TokenNode& tok, int skip) const
 	case uenum(keywords::IF): 				// -----=====*****\ IF /*****=====-----
 		return parse_if(tok, 1);
 	case uenum(keywords::CLASS): 			// -----=====*****\ CLASS /*****=====-----
-		// TODO: return parse_class(tok, 1);
+		return parse_class(tok, 1);
 	case uenum(keywords::NAMESPACE): 		// -----=====*****\ NAMESPACE /*****=====-----
 		return parse_namespace(tok, 1);
 	case uenum(keywords::FUN): 				// -----=====*****\ FUN /*****=====-----
 		return parse_function(tok, 1);
-	case uenum(keywords::TRUE): case uenum(keywords::FALSE): // -----=====*****\ BOOL /*****=====-----
-		return parse_expression_statement(tok, 1);
+	case uenum(keywords::TRUE): case uenum(keywords::FALSE): case uenum(keywords::_NULL): // -----=====*****\ BOOL /*****=====-----
+		return parse_expression_statement(tok, 0);
 	default:
 		// VARTYPES or ERROR
 		if (IS_ENUM_VARTYPE(tok.tok.keyword))
 			return parse_variable(tok, 0);
 		else
-			error(tok, "Unexpected keyword: %s", tok.tok.str.c_str());
+			error(tok, "Unexpected keyword: %s", getStringFromId(tok.tok.keyword).c_str());
 	}
 
 	return incRet(
@@ -432,6 +547,9 @@ Nodes::StatementBlock* Parser::parse_block(TokenNode& tok, int skip) const
 
 	Nodes::StatementBlock* block = new Nodes::StatementBlock{tok.tok.position, vector<Nodes::Statement*>()};
 
+	if (++depth > MAX_NESTING_DEPTH)
+		error(tok, ERROR_TOO_DEEP, MAX_NESTING_DEPTH);
+
 	// Make sure we have a '{'
 	if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::LBRACE))
 	{
@@ -457,6 +575,7 @@ Nodes::StatementBlock* Parser::parse_block(TokenNode& tok, int skip) const
 	// if (true)
 	//     print("hello");
 
+	depth--;
 	// no need to incRet beacause we're incrementing in the loop
 	return block;
 }
@@ -464,6 +583,7 @@ Nodes::StatementBlock* Parser::parse_block(TokenNode& tok, int skip) const
 inline Nodes::Statement* Parser::parse_import(TokenNode& tok, int skip) const
 {
 	size_t pos = tok.tok.position;
+	TRACE_SCOPE("parse_import", tok.next->tok.str);
 
 	for (int i = 0; i < skip; i++)
 	{
@@ -644,10 +764,10 @@ inline Nodes::Break* Parser::parse_break(TokenNode& tok, int skip) const
 		tok = *tok.next;
 	}
 
-	if (tok.tok.keyword == uenum(operators::SEMICOLON))
+	if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::SEMICOLON))
 		return incRet(
 			new Nodes::Break{pos},
-			tok, 2);
+			tok, 1);
 	else error(tok, "Expected ';' after 'break' (break;)");
 
 	// We should never reach this point
@@ -664,10 +784,10 @@ inline Nodes::Continue* Parser::parse_continue(TokenNode& tok, int skip) const
 		tok = *tok.next;
 	}
 
-	if (tok.tok.keyword == uenum(operators::SEMICOLON))
+	if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::SEMICOLON))
 		return incRet(
 			new Nodes::Continue{pos},
-			tok, 2);
+			tok, 1);
 	else error(tok, "Expected ';' after 'continue' (continue;)");
 
 	// We should never reach this point
@@ -720,7 +840,69 @@ inline Nodes::Ite* Parser::parse_if(TokenNode& tok, int skip) const
 		new Nodes::Ite{pos, condition, new Nodes::StatementBlock{}, new Nodes::StatementBlock{}},
 		tok, 1);
 }
-// TODO: inline Nodes::ClassDecl* Parser::parse_class(TokenNode& tok, int skip) const
+inline Nodes::ClassDecl* Parser::parse_class(TokenNode& tok, int skip) const
+{
+	size_t pos = tok.tok.position;
+	TRACE_SCOPE("parse_class", tok.next->tok.str);
+
+	for (int i = 0; i < skip; i++)
+	{
+		tok = *tok.next;
+	}
+
+	map<Nodes::VarDecl*, Nodes::Access> members;
+	map<Nodes::FunctionDecl*, Nodes::Access> functions;
+	vector<Nodes::ClassSysFunctionDecl*> sysFunctions;
+
+	// class <name> { <members> }
+	if (tok.tok.type != toktype::IDENTIFIER)
+		error(tok, "Expected identifier class name (class <name> { ... })");
+	string name = tok.tok.str;
+	tok = *tok.next;
+
+	if (tok.tok.type != toktype::OPERATOR || tok.tok.keyword != uenum(operators::LBRACE))
+		error(tok, "Expected '{' after the class name (class <name> { ... })");
+	tok = *tok.next;
+
+	while (tok.tok.type != toktype::OPERATOR || tok.tok.keyword != uenum(operators::RBRACE))
+	{
+		if (tok.tok.type == toktype::TOK_EOF)
+			error(tok, "Expected '}' to end the class %s", name.c_str());
+
+		// public, private and protected are only words with a meaning here, members are public if they don't say
+		Nodes::Access access = Nodes::Access::PUBLIC;
+		if (tok.tok.type == toktype::IDENTIFIER && (tok.tok.str == "public" || tok.tok.str == "private" || tok.tok.str == "protected"))
+		{
+			access = tok.tok.str == "public" ? Nodes::Access::PUBLIC : tok.tok.str == "private" ? Nodes::Access::PRIVATE : Nodes::Access::PROTECTED;
+			tok = *tok.next;
+		}
+
+		// <type> <name> = <value>;
+		if (tok.tok.type == toktype::KEYWORD && IS_ENUM_VARTYPE(tok.tok.keyword))
+			members[parse_variable(tok, 0)] = access;
+		// fun <name>( <args> ) : <rType> { ... }
+		else if (tok.tok.type == toktype::KEYWORD && tok.tok.keyword == uenum(keywords::FUN))
+			functions[parse_function(tok, 1)] = access;
+		// initialize, terminate, __str__, __OP_PLUS__, etc. look like functions without the fun
+		else if (tok.tok.type == toktype::IDENTIFIER && tok.next->tok.type == toktype::OPERATOR && tok.next->tok.keyword == uenum(operators::LPAREN))
+		{
+			if (access != Nodes::Access::PUBLIC)
+				error(tok, "%s is always public", tok.tok.str.c_str());
+
+			Nodes::FunctionDecl* function = parse_function(tok, 0);
+			sysFunctions.push_back(new Nodes::ClassSysFunctionDecl{function->position, function->name, function->args, function->rType, function->body});
+			delete function;
+		}
+		else error(tok, "Expected a variable, a function or a special function like initialize in the class %s", name.c_str());
+	}
+
+	// skip the '}'
+	tok = *tok.next;
+
+	return incRet(
+		new Nodes::ClassDecl{pos, name, members, functions, sysFunctions},
+		tok, 0);
+}
 inline Nodes::NamespaceDecl* Parser::parse_namespace(TokenNode& tok, int skip) const
 {
 	size_t pos = tok.tok.position;
@@ -734,8 +916,8 @@ inline Nodes::NamespaceDecl* Parser::parse_namespace(TokenNode& tok, int skip) c
 	{
 		// Get the namespace name
 		auto name = tok.tok.str;
-		// Get the namespace block
-		auto block = parse_block(tok);
+		// Get the namespace block, skip the name
+		auto block = parse_block(tok, 1);
 		// Return the namespace
 		return incRet(
 			new Nodes::NamespaceDecl{pos, name, block},
@@ -751,6 +933,7 @@ inline Nodes::NamespaceDecl* Parser::parse_namespace(TokenNode& tok, int skip) c
 inline Nodes::FunctionDecl* Parser::parse_function(TokenNode& tok, int skip) const
 {
 	size_t pos = tok.tok.position;
+	TRACE_SCOPE("parse_function", tok.next->tok.str);
 
 	for (int i = 0; i < skip; i++)
 	{
@@ -758,9 +941,9 @@ inline Nodes::FunctionDecl* Parser::parse_function(TokenNode& tok, int skip) con
 	}
 
 	string name;
-	map<pair<vartypes, string>, Nodes::Expression*> params;
+	vector<pair<pair<vartypes, string>, Nodes::Expression*>> params; // In the order they were declared
 	vartypes rType = vartypes::VAR;
-	Nodes::StatementBlock* body;
+	Nodes::StatementBlock* body = nullptr;
 
 	// TODO: Maybe add support to lambda like functions, support syntax like this - fun foo(a, b) = (a + b);
 
@@ -801,14 +984,14 @@ inline Nodes::FunctionDecl* Parser::parse_function(TokenNode& tok, int skip) con
 				else error(tok, "Expected parameter type or identifier (parameter name) if no type is specified var is assumed");
 
 				// Get the default value is exists
-				if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::EQ))
+				if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::ASS))
 				{
 					tok = *tok.next;
 					param.second = parse_expression(tok);
 				}
 
 				// Add the parameter to the list
-				params.insert(param);
+				params.push_back(param);
 
 				// Check if we reached the end of the parameters
 				if (tok.tok.type == toktype::OPERATOR && tok.tok.keyword == uenum(operators::RPAREN))
@@ -865,8 +1048,8 @@ inline Nodes::VarDecl* Parser::parse_variable(TokenNode& tok, int skip) const
 	}
 
 	string name;
-	vartypes type;
-	Nodes::Expression* value;
+	vartypes type = vartypes::VAR;
+	Nodes::Expression* value = nullptr;
 
 	// <type> <name> = <value>
 	if (tok.tok.type == toktype::KEYWORD && IS_ENUM_VARTYPE(tok.tok.keyword))
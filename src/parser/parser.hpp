@@ -5,17 +5,22 @@
 #include "tree.hpp"
 #include "../grammar/grammar.hpp"
 #include "../lexer/lexer.hpp"
+#include "../profiler/tracer.hpp"
 
 class Parser
 {
 private:
 	Lexer* lexer;
 	Nodes::StatementBlock program;
+	mutable int depth; // How deep the expression or block being parsed is nested
 public:
 	Parser(Lexer* lexer);
 
 	void parse(TokenNode& root);
 	void print() const;
+
+	inline const Nodes::StatementBlock& get_program() const { return program; }
+	inline Nodes::StatementBlock& get_program() { return program; }
 private:
 	void error(const TokenNode& tok, const char* format, ...) const;
 	void warning(const TokenNode& tok, const char* format, ...) const;
@@ -32,7 +37,7 @@ private:
 	inline Nodes::Break* parse_break(TokenNode& tok, int skip=0) const;
 	inline Nodes::Continue* parse_continue(TokenNode& tok, int skip=0) const;
 	inline Nodes::Ite* parse_if(TokenNode& tok, int skip=0) const;
-	// TODO: inline Nodes::ClassDecl* parse_class(TokenNode& tok, int skip=0) const;
+	inline Nodes::ClassDecl* parse_class(TokenNode& tok, int skip=0) const;
 	inline Nodes::NamespaceDecl* parse_namespace(TokenNode& tok, int skip=0) const;
 	inline Nodes::FunctionDecl* parse_function(TokenNode& tok, int skip=0) const;
 	inline Nodes::VarDecl* parse_variable(TokenNode& tok, int skip=0) const;
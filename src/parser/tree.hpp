@@ -11,6 +11,8 @@ using std::string;
 using std::map;
 using std::pair;
 
+class Codegen;
+
 namespace Nodes
 {
 enum class Access : char
@@ -23,10 +25,12 @@ enum class Access : char
 
 struct Statement
 {
+	static inline size_t created = 0; // How many statements were made, reported by --time-report
 	size_t position; 
 
-	Statement(size_t position) : position(position) {};
-	Statement() : position(-1) {};
+	Statement(size_t position) : position(position) { created++; };
+	Statement() : position(-1) { created++; };
+	virtual ~Statement() {}
 
 	virtual void print() const { printf("Statement at %zu\n", position); }
 
@@ -34,10 +38,12 @@ struct Statement
 };
 struct Expression
 {
+	static inline size_t created = 0; // How many expressions were made, reported by --time-report
 	size_t position;
-	Expression(size_t position) : position(position) {};
-	Expression() : position(-1) {};
-	
+	Expression(size_t position) : position(position) { created++; };
+	Expression() : position(-1) { created++; };
+	virtual ~Expression() {}
+
 	virtual void print() const { printf("Expression at %zu\n", position); }
 
 	// virtual string codegen() const { return "; Just an Expression"; }
@@ -111,11 +117,11 @@ struct VarDecl : public Statement // type name = value; type name;
 struct FunctionDecl : public Statement // fun name(args) { body }
 {
 	string name;
-	map<pair<vartypes, string>, Expression*> args;
+	vector<pair<pair<vartypes, string>, Expression*>> args;
 	vartypes rType; // if not specified, it is set to vartypes::VAR
 	StatementBlock* body;
 
-	FunctionDecl(size_t position, string name, map<pair<vartypes, string>, Expression*> args, vartypes rType, StatementBlock* body) : Statement(position), name(name), args(args), rType(rType), body(body) {}
+	FunctionDecl(size_t position, string name, vector<pair<pair<vartypes, string>, Expression*>> args, vartypes rType, StatementBlock* body) : Statement(position), name(name), args(args), rType(rType), body(body) {}
 
 	void print() const
 	{
@@ -137,11 +143,11 @@ struct FunctionDecl : public Statement // fun name(args) { body }
 struct ClassSysFunctionDecl : public Statement
 {
 	string name; // initialize, terminate, __str__, __OP_PLUS__, etc.
-	map<pair<vartypes, string>, Expression*> args;
+	vector<pair<pair<vartypes, string>, Expression*>> args;
 	vartypes rType;
 	StatementBlock* body;
 
-	ClassSysFunctionDecl(size_t position, string name, map<pair<vartypes, string>, Expression*> args, vartypes rType, StatementBlock* body) : Statement(position), name(name), args(args), rType(rType), body(body) {}
+	ClassSysFunctionDecl(size_t position, string name, vector<pair<pair<vartypes, string>, Expression*>> args, vartypes rType, StatementBlock* body) : Statement(position), name(name), args(args), rType(rType), body(body) {}
 
 	void print() const
 	{
@@ -213,6 +219,7 @@ struct For : public Statement /* for init; condition; step e.g. for int i; i < 1
 	Expression* condition;
 	Expression* step;
 	StatementBlock* body;
+	bool range = false; // Lowered from a range, the bounds are numbers and can be counted before the loop starts
 
 	For(size_t position, Expression* init, Expression* condition, Expression* step, StatementBlock* body) : Statement(position), init(init), condition(condition), step(step), body(body) {}
 
@@ -498,8 +505,9 @@ struct ArrayAccessExpression : public Expression // Access array element: array[
 {
 	Expression* array;
 	Expression* index;
+	bool inBounds; // Set by the optimizer when the index can't be out of range, so it isn't checked
 
-	ArrayAccessExpression(size_t position, Expression* array, Expression* index) : Expression(position), array(array), index(index) {}
+	ArrayAccessExpression(size_t position, Expression* array, Expression* index) : Expression(position), array(array), index(index), inBounds(false) {}
 
 	void print() const
 	{
@@ -510,7 +518,26 @@ struct ArrayAccessExpression : public Expression // Access array element: array[
 		printf("]\n");
 	}
 };
-struct MemberAccessExpression : public Expression // Call a member of an object: object.name;
+struct IndexAssignExpression : public Expression // Assign to an array element: array[index] = value;
+{
+	Expression* array;
+	Expression* index;
+	Expression* value;
+
+	IndexAssignExpression(size_t position, Expression* array, Expression* index, Expression* value) : Expression(position), array(array), index(index), value(value) {}
+
+	void print() const
+	{
+		printf("(IndexAssign at %zu)\n", position);
+		array->print();
+		printf("[");
+		index->print();
+		printf("] = ");
+		value->print();
+		printf(";\n");
+	}
+};
+struct MemberAccessExpression : public Expression // Read a member of an object: object.name
 {
 	Expression* object;
 	string name;
@@ -524,6 +551,44 @@ struct MemberAccessExpression : public Expression // Call a member of an object:
 		printf(".%s\n", name.c_str());
 	}
 };
+struct MemberAssignExpression : public Expression // Assign to a member of an object: object.name = value;
+{
+	Expression* object;
+	string name;
+	Expression* value;
+
+	MemberAssignExpression(size_t position, Expression* object, string name, Expression* value) : Expression(position), object(object), name(name), value(value) {}
+
+	void print() const
+	{
+		printf("(MemberAssign at %zu)\n", position);
+		object->print();
+		printf(".%s = ", name.c_str());
+		value->print();
+		printf(";\n");
+	}
+};
+struct MethodCallExpression : public Expression // Call a method of an object: object.name(args);
+{
+	Expression* object;
+	string name;
+	vector<Expression*> args;
+
+	MethodCallExpression(size_t position, Expression* object, string name, vector<Expression*> args) : Expression(position), object(object), name(name), args(args) {}
+
+	void print() const
+	{
+		printf("(MethodCallExpression at %zu) ", position);
+		object->print();
+		printf(".%s(", name.c_str());
+		for (auto& arg : args)
+		{
+			arg->print();
+			printf(", ");
+		}
+		printf(")\n");
+	}
+};
 struct IdentifierExpression : public Expression // Access Variable: name
 {
 	string name;
@@ -5,9 +5,9 @@
 
 using std::string;
 
-void strip_comments(string& og);
+inline void strip_comments(string& og);
 
-void preprocess(string& src)
+inline void preprocess(string& src)
 {
 	// Strip comments
 	strip_comments(src);
@@ -15,35 +15,29 @@ void preprocess(string& src)
 	// TODO: add support for other preprocess things such macros and stuff, basically everything that starts with '#' in c
 }
 
-void strip_comments(string& src)
+inline void strip_comments(string& src)
 {
-	string result = "";
-	result.reserve(src.size());
-
+	// Comments are blanked out instead of erased so every character keeps its offset and the
+	// lexer's diagnostics point at the right line and column of the original file
 	bool s_cmt = false;
 	bool m_cmt = false;
  
-	for (int i=0; i<src.size(); i++)
+	for (size_t i=0; i<src.size(); i++)
 	{
 		if (s_cmt == true && src[i] == '\n')
 			s_cmt = false;
 		
 		else if (m_cmt == true && src[i] == '*' && src[i+1] == '/')
-			m_cmt = false,  i++;
+			m_cmt = false, src[i] = src[i+1] = ' ', i++;
 
 		else if (s_cmt || m_cmt)
-			continue;
+			{ if (src[i] != '\n') src[i] = ' '; }
  
 		else if (src[i] == '/' && src[i+1] == '/')
-			s_cmt = true, i++;
+			s_cmt = true, src[i] = src[i+1] = ' ', i++;
 		else if (src[i] == '/' && src[i+1] == '*')
-			m_cmt = true,  i++;
- 
-		else  result += src[i];
+			m_cmt = true, src[i] = src[i+1] = ' ', i++;
 	}
-
-	result.shrink_to_fit();
-	src = result;
 }
 
 #endif // PREPROCESSOR_PREPROCESSOR_HPP
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "profiler.hpp"
+#include "tracer.hpp"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define PSAPI_VERSION 2 // GetProcessMemoryInfo is in kernel32, no psapi.lib to link
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Count every allocation the compiler makes, it's cheap enough to always be on
+static std::atomic<size_t> allocation_count(0);
+
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+void Profiler::begin(const char* name, const string& detail)
+{
+	current = name;
+	if (Tracer::is_enabled())
+	{
+		current_detail = detail;
+		trace_start = Tracer::now_us();
+	}
+
+	if (!enabled) return;
+
+	allocations_start = allocations();
+	cpu_start = std::clock();
+	wall_start = std::chrono::steady_clock::now();
+}
+
+void Profiler::end()
+{
+	if (Tracer::is_enabled())
+		Tracer::add(current, current_detail, trace_start, Tracer::now_us() - trace_start);
+
+	if (!enabled) return;
+
+	auto wall_end = std::chrono::steady_clock::now();
+	std::clock_t cpu_end = std::clock();
+
+	PhaseReport phase;
+	phase.name = current;
+	phase.wall_ms = std::chrono::duration<double, std::milli>(wall_end - wall_start).count();
+	phase.cpu_ms = 1000.0 * (cpu_end - cpu_start) / CLOCKS_PER_SEC;
+	phase.allocations = allocations() - allocations_start;
+	phase.peak_rss_kb = peak_rss_kb();
+	phases.push_back(phase);
+}
+
+void Profiler::set_counter(const char* name, size_t value)
+{
+	if (!enabled) return;
+
+	counters.push_back({name, value});
+}
+
+void Profiler::set_rate(const char* name, size_t amount, const char* phase)
+{
+	if (!enabled) return;
+
+	for (auto& p : phases)
+	{
+		if (p.name == phase)
+		{
+			rates.push_back({name, p.wall_ms > 0 ? amount / (p.wall_ms / 1000.0) : 0});
+			return;
+		}
+	}
+}
+
+string Profiler::tojson() const
+{
+	char buf[256];
+	string json = "{\n\t\"phases\": [\n";
+
+	double total_wall = 0, total_cpu = 0;
+	for (size_t i = 0; i < phases.size(); i++)
+	{
+		const PhaseReport& phase = phases[i];
+		snprintf(buf, sizeof(buf), "\t\t{ \"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocations\": %zu, \"peak_rss_kb\": %zu }%s\n",
+			phase.name.c_str(), phase.wall_ms, phase.cpu_ms, phase.allocations, phase.peak_rss_kb, i + 1 < phases.size() ? "," : "");
+		json += buf;
+		total_wall += phase.wall_ms;
+		total_cpu += phase.cpu_ms;
+	}
+
+	snprintf(buf, sizeof(buf), "\t],\n\t\"total\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocations\": %zu, \"peak_rss_kb\": %zu },\n\t\"counters\": {",
+		total_wall, total_cpu, allocations(), peak_rss_kb());
+	json += buf;
+
+	for (size_t i = 0; i < counters.size(); i++)
+	{
+		snprintf(buf, sizeof(buf), "%s \"%s\": %zu", i ? "," : "", counters[i].first.c_str(), counters[i].second);
+		json += buf;
+	}
+	json += " },\n\t\"rates\": {";
+
+	for (size_t i = 0; i < rates.size(); i++)
+	{
+		snprintf(buf, sizeof(buf), "%s \"%s\": %.0f", i ? "," : "", rates[i].first.c_str(), rates[i].second);
+		json += buf;
+	}
+	json += " }\n}";
+
+	return json;
+}
+
+size_t Profiler::allocations()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+size_t Profiler::peak_rss_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss; // In kilobytes on Linux
+#endif
+	return 0;
+}
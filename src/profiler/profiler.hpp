@@ -0,0 +1,63 @@
+#ifndef PROFILER_PROFILER_HPP
+#define PROFILER_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <ctime>
+#include <stdio.h>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+using std::pair;
+
+// Measures every phase of the compilation for --time-report, and traces them for --trace
+struct PhaseReport
+{
+	string name;
+	double wall_ms;
+	double cpu_ms;
+	size_t allocations; // Number of calls to operator new during the phase
+	size_t peak_rss_kb; // The peak resident set size of the process by the end of the phase
+};
+
+class Profiler
+{
+private:
+	bool enabled;
+	vector<PhaseReport> phases;
+	vector<pair<string, size_t>> counters;
+	vector<pair<string, double>> rates;
+
+	// The phase that is currently running
+	const char* current;
+	string current_detail;
+	uint64_t trace_start;
+	std::chrono::steady_clock::time_point wall_start;
+	std::clock_t cpu_start;
+	size_t allocations_start;
+public:
+	Profiler(bool enabled) : enabled(enabled), current(""), trace_start(0), cpu_start(0), allocations_start(0) {}
+
+	inline bool is_enabled() const { return enabled; }
+
+	void begin(const char* name, const string& detail = "");
+	void end();
+	void set_counter(const char* name, size_t value);
+	void set_rate(const char* name, size_t amount, const char* phase); // amount per second of the phase
+
+	string tojson() const;
+
+	inline void print() const
+	{
+		if (enabled)
+			fprintf(stderr, "%s\n", tojson().c_str());
+	}
+
+	static size_t allocations();
+	static size_t peak_rss_kb();
+};
+
+#endif // PROFILER_PROFILER_HPP
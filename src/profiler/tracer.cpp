@@ -0,0 +1,70 @@
+#include "tracer.hpp"
+
+#include <atomic>
+#include <stdio.h>
+
+void Tracer::start(const string& path)
+{
+	Tracer::path = path;
+	Tracer::epoch = std::chrono::steady_clock::now();
+	Tracer::enabled = true;
+}
+
+uint64_t Tracer::now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+unsigned Tracer::thread_id()
+{
+	// Small sequential ids read better in the trace viewer than the native ones
+	static std::atomic<unsigned> next_id(1);
+	thread_local unsigned id = next_id.fetch_add(1);
+	return id;
+}
+
+void Tracer::add(const char* name, const string& detail, uint64_t ts_us, uint64_t dur_us)
+{
+	unsigned tid = thread_id();
+	std::lock_guard<std::mutex> guard(lock);
+	events.push_back({name, detail, ts_us, dur_us, tid});
+}
+
+static void write_json_string(FILE* f, const string& s)
+{
+	fputc('"', f);
+	for (char ch : s)
+	{
+		if (ch == '"' || ch == '\\') fprintf(f, "\\%c", ch);
+		else if ((unsigned char)ch < 0x20) fprintf(f, "\\u%04x", ch);
+		else fputc(ch, f);
+	}
+	fputc('"', f);
+}
+
+void Tracer::finish()
+{
+	if (!enabled) return;
+	enabled = false;
+
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL) { fprintf(stderr, "Couldn't open trace file \"%s\"\n", path.c_str()); return; }
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const TraceEvent& e = events[i];
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"dig\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u",
+			e.name, (unsigned long long)e.ts_us, (unsigned long long)e.dur_us, e.tid);
+		if (!e.detail.empty())
+		{
+			fprintf(f, ",\"args\":{\"detail\":");
+			write_json_string(f, e.detail);
+			fprintf(f, "}");
+		}
+		fprintf(f, "}%s\n", i + 1 < events.size() ? "," : "");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	fclose(f);
+}
@@ -0,0 +1,68 @@
+#ifndef PROFILER_TRACER_HPP
+#define PROFILER_TRACER_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+// Records spans in the Chrome trace event format for --trace, open the file
+// with chrome://tracing or https://ui.perfetto.dev
+struct TraceEvent
+{
+	const char* name;
+	string detail;
+	uint64_t ts_us;
+	uint64_t dur_us;
+	unsigned tid;
+};
+
+class Tracer
+{
+private:
+	static inline bool enabled = false;
+	static inline string path;
+	static inline vector<TraceEvent> events;
+	static inline std::mutex lock;
+	static inline std::chrono::steady_clock::time_point epoch;
+public:
+	static void start(const string& path);
+	static void finish();
+
+	static inline bool is_enabled() { return enabled; }
+
+	static uint64_t now_us();
+	static unsigned thread_id();
+	static void add(const char* name, const string& detail, uint64_t ts_us, uint64_t dur_us);
+};
+
+// A span that lasts until the end of the scope
+class TraceScope
+{
+private:
+	const char* name;
+	string detail;
+	uint64_t start;
+public:
+	TraceScope(const char* name, const string& detail = "") : name(name), start(0)
+	{
+		if (!Tracer::is_enabled()) return;
+		this->detail = detail;
+		start = Tracer::now_us();
+	}
+	~TraceScope()
+	{
+		if (Tracer::is_enabled())
+			Tracer::add(name, detail, start, Tracer::now_us() - start);
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif // PROFILER_TRACER_HPP
@@ -0,0 +1,41 @@
+#include "builtins.hpp"
+#include "output.hpp"
+
+// print(values...) writes all the values one after the other and a new line
+static Value builtin_print(Value* args, int argc)
+{
+	for (int i = 0; i < argc; i++)
+		Output::value(args[i]);
+	Output::line();
+	return Value::null();
+}
+
+// len(value) is the length of a str or an arr
+static Value builtin_len(Value* args, int)
+{
+	if (args[0].is_str()) return Value::from_num(args[0].as_str()->length);
+	if (args[0].is_arr()) return Value::from_num(args[0].as_arr()->length);
+	return Value::null();
+}
+
+// push(arr, value) adds value at the end of arr
+static Value builtin_push(Value* args, int)
+{
+	if (args[0].is_arr()) args[0].as_arr()->push(args[1]);
+	return Value::null();
+}
+
+const Builtin builtins[] = {
+	{ "print", 0, -1, builtin_print },
+	{ "len", 1, 1, builtin_len },
+	{ "push", 2, 2, builtin_push },
+};
+const int builtins_count = sizeof(builtins) / sizeof(builtins[0]);
+
+int find_builtin(const string& name)
+{
+	for (int i = 0; i < builtins_count; i++)
+		if (name == builtins[i].name)
+			return i;
+	return -1;
+}
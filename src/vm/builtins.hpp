@@ -0,0 +1,24 @@
+#ifndef VM_BUILTINS_HPP
+#define VM_BUILTINS_HPP
+
+#include <string>
+#include "value.hpp"
+
+using std::string;
+
+// Functions every program can call without importing anything
+struct Builtin
+{
+	const char* name;
+	int min_args;
+	int max_args; // -1 for any number of arguments
+	Value (*fn)(Value* args, int argc);
+};
+
+extern const Builtin builtins[];
+extern const int builtins_count;
+
+// The index of the builtin or -1
+int find_builtin(const string& name);
+
+#endif // VM_BUILTINS_HPP
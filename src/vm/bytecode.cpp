@@ -0,0 +1,116 @@
+#include "bytecode.hpp"
+
+#include <stdio.h>
+
+static const char* opcode_names[] = {
+#define OPCODE(id, fmt) #id,
+#include "opcodes.inc"
+#undef OPCODE
+};
+
+static const int opcode_formats[] = {
+#define OPCODE(id, fmt) fmt,
+#include "opcodes.inc"
+#undef OPCODE
+};
+
+const char* getOpcodeName(opcode op)
+{
+	return opcode_names[static_cast<uint8_t>(op)];
+}
+
+void Function::print() const
+{
+	printf("fun %s (%zu args, %d registers, %zu instructions)\n", name.c_str(), args.size(), registers, code.size());
+
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		const Instruction& ins = code[i];
+		printf("\t%4zu  %-12s", i, getOpcodeName(ins.op));
+
+		switch (opcode_formats[static_cast<uint8_t>(ins.op)])
+		{
+		case OP_A: printf("R%d", ins.a); break;
+		case OP_AB: printf("R%d R%d", ins.a, ins.b); break;
+		case OP_ABC: printf("R%d R%d R%d", ins.a, ins.b, ins.c); break;
+		case OP_AK:
+		{
+			Value k = constants[ins.bx()];
+			printf(k.is_str() ? "R%d \"%s\"" : "R%d %s", ins.a, value_tostr(k).c_str());
+			break;
+		}
+		case OP_AJ: printf("R%d -> %u", ins.a, ins.bx()); break;
+		case OP_J: printf("-> %u", ins.bx()); break;
+		case OP_AG: printf("R%d G%u", ins.a, ins.bx()); break;
+		case OP_CALL: printf("R%d F%d (%d args)", ins.a, ins.b, ins.c); break;
+		case OP_AV: printf("R%d V%u", ins.a, ins.bx()); break;
+		case OP_AO: printf("R%d C%u", ins.a, ins.bx()); break;
+		case OP_ABM: printf("R%d R%d S%d M%d", ins.a, ins.b, ins.c, sites[ins.c]); break;
+		case OP_INVOKE: printf("R%d S%d M%d (%d args)", ins.a, ins.b, sites[ins.b], ins.c); break;
+		case OP_P: printf("P%u", ins.bx()); break;
+		default: break;
+		}
+		printf("\n");
+	}
+	for (auto& range : cold)
+		printf("\tcold %u-%u\n", range.first, range.second - 1);
+}
+
+void Kernel::print() const
+{
+	printf(reduce ? "R%d +=" : "R%d[i] =", target);
+	for (auto& step : code)
+	{
+		switch (step.op)
+		{
+		case KernelOp::ARR: printf(" R%d[i]", step.reg); break;
+		case KernelOp::INDEX: printf(" i"); break;
+		case KernelOp::SCALAR: printf(" R%d", step.reg); break;
+		case KernelOp::ADD: printf(" +"); break;
+		case KernelOp::SUB: printf(" -"); break;
+		case KernelOp::MUL: printf(" *"); break;
+		case KernelOp::DIV: printf(" /"); break;
+		case KernelOp::NEG: printf(" neg"); break;
+		}
+	}
+	printf("\n");
+}
+
+size_t Program::instructions() const
+{
+	size_t count = 0;
+	for (auto& function : functions)
+		count += function.code.size();
+	return count;
+}
+
+void Program::print() const
+{
+	for (size_t i = 0; i < globals.size(); i++)
+		printf("G%zu %s %s\n", i, getStringFromId(uenum(global_types[i])).c_str(), globals[i].c_str());
+
+	for (size_t i = 0; i < members.size(); i++)
+		printf("M%zu %s\n", i, members[i].c_str());
+	for (size_t i = 0; i < classes.size(); i++)
+	{
+		printf("C%zu %s {", i, classes[i].name.c_str());
+		for (size_t slot = 0; slot < classes[i].fields.size(); slot++)
+			printf(" %s%s", classes[i].ints[slot] ? "int " : "", classes[i].fields[slot].c_str());
+		printf(" }\n");
+	}
+
+	for (size_t i = 0; i < probes.size(); i++)
+		printf("P%zu %s\n", i, probes[i].c_str());
+
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		printf("V%zu ", i);
+		kernels[i].print();
+	}
+
+	for (size_t i = 0; i < functions.size(); i++)
+	{
+		printf("\nF%zu ", i);
+		functions[i].print();
+	}
+}
@@ -0,0 +1,123 @@
+#ifndef VM_BYTECODE_HPP
+#define VM_BYTECODE_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "value.hpp"
+#include "../grammar/grammar.hpp"
+#include "../parser/tree.hpp"
+
+using std::string;
+using std::vector;
+
+// The register based bytecode `dig run` executes, every function gets its own frame of registers
+// and the arguments of a call are the first registers of the callee's frame
+
+#define OP_NONE 0
+#define OP_A 1
+#define OP_AB 2
+#define OP_ABC 3
+#define OP_AK 4
+#define OP_AJ 5
+#define OP_J 6
+#define OP_AG 7
+#define OP_CALL 8
+#define OP_AV 9
+#define OP_AO 10
+#define OP_ABM 11
+#define OP_INVOKE 12
+#define OP_P 13
+
+enum class opcode : uint8_t
+{
+#define OPCODE(id, fmt) id,
+#include "opcodes.inc"
+#undef OPCODE
+	__END
+};
+
+// Every instruction is 8 bytes, a 32 bit operand (constant index, jump target, global index) is split over b and c
+struct Instruction
+{
+	opcode op;
+	uint8_t unused;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+
+	Instruction() : op(opcode::RETNULL), unused(0), a(0), b(0), c(0) {}
+	Instruction(opcode op, uint16_t a, uint16_t b, uint16_t c) : op(op), unused(0), a(a), b(b), c(c) {}
+
+	static inline Instruction with_bx(opcode op, uint16_t a, uint32_t bx) { return Instruction(op, a, bx & 0xffff, bx >> 16); }
+	inline uint32_t bx() const { return uint32_t(b) | (uint32_t(c) << 16); }
+	inline void set_bx(uint32_t bx) { b = bx & 0xffff; c = bx >> 16; }
+};
+
+// What a counted loop with a single element-wise statement computes, so it can run over whole blocks of
+// elements at once. The code is in postfix and every step pushes a value for every element, the registers
+// it reads are in the frame of the function the loop is in
+enum class KernelOp : uint8_t
+{
+	ARR,	// R[reg][i]
+	INDEX,	// i itself
+	SCALAR,	// R[reg], the same for every element
+	ADD, SUB, MUL, DIV, NEG,
+};
+struct KernelStep
+{
+	KernelOp op;
+	uint16_t reg;
+};
+#define KERNEL_MAX_STEPS 16
+struct Kernel
+{
+	vector<KernelStep> code;
+	bool reduce; // R[target] = R[target] + the values, otherwise R[target][i] = the value
+	bool truncate; // R[target] is an int variable, rounded after every addition
+	uint16_t target;
+
+	void print() const;
+};
+
+struct Function
+{
+	string name; // Qualified with the namespaces it's in, e.g. math::sqrt
+	size_t position;
+	vartypes rType;
+	vector<pair<pair<vartypes, string>, Nodes::Expression*>> args; // The defaults are compiled into every call that leaves them out
+	vector<Value> defaults; // For methods, what INVOKE gives the arguments a call leaves out, they're constants
+	int registers; // The size of the frame
+
+	vector<Instruction> code;
+	vector<size_t> positions; // The source position of every instruction, for runtime errors
+	vector<Value> constants;
+	vector<int32_t> sites; // The selector every GETMEMBER, SETMEMBER and INVOKE looks up, they name their site
+	vector<pair<uint32_t, uint32_t>> cold; // The [from, to) of the branches that rarely run, the JIT moves them out of the way
+
+	Function(string name, size_t position, vartypes rType, vector<pair<pair<vartypes, string>, Nodes::Expression*>> args) : name(name), position(position), rType(rType), args(args), registers(0) {}
+
+	void print() const;
+};
+
+struct Program
+{
+	vector<Function> functions;
+	vector<string> globals;
+	vector<vartypes> global_types;
+	vector<Kernel> kernels;
+	vector<Class> classes;
+	vector<string> members; // By selector
+	vector<string> probes; // What every PROBE counts, see profile.hpp
+	int init; // The function that runs the top level statements, before main
+	int main; // -1 if there's no main function
+
+	Program() : init(-1), main(-1) {}
+
+	size_t instructions() const;
+	void print() const;
+};
+
+const char* getOpcodeName(opcode op);
+
+#endif // VM_BYTECODE_HPP
@@ -0,0 +1,1834 @@
+#include "compiler.hpp"
+#include "builtins.hpp"
+#include "runtime.hpp"
+#include "../optimizer/optimizer.hpp"
+#include "../profiler/tracer.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+#define MAX_REGISTERS 0xffff
+#define MAX_SITES 0xffff
+
+static const map<string, int> no_classes;
+
+BytecodeCompiler::BytecodeCompiler(Lexer* lexer, int inline_limit, bool vectorize, bool instrument, const Profile* profile)
+{
+	this->lexer = lexer;
+	this->inline_limit = inline_limit;
+	this->vectorize_loops = vectorize;
+	this->instrument = instrument;
+	this->profile = profile;
+	this->function = nullptr;
+	this->free_reg = 0;
+	this->scope_floor = 0;
+	this->local_classes = &no_classes;
+	this->current_class = -1;
+}
+
+Program BytecodeCompiler::compile(const Nodes::StatementBlock& program)
+{
+	// Functions and globals can be used before they're declared, so find all of them first
+	this->program.functions.push_back(Function{"@init", 0, vartypes::VAR, {}});
+	this->program.init = 0;
+	collect(program, "");
+	layout_classes();
+	this->callees.assign(this->program.functions.size(), Callee{nullptr, "", 0, 0, false, {}});
+	for (size_t i = 0; i < this->classes.size(); i++)
+	{
+		this->callees[this->classes[i].constructor].constructs = i;
+		for (auto method : this->classes[i].functions)
+			this->callees[this->functions[this->classes[i].ns + method->name]].cls = i;
+	}
+	analyze(program, "");
+	find_recursion();
+
+	auto main = this->functions.find("main");
+	if (main != this->functions.end())
+		this->program.main = main->second;
+
+	compile_functions(program, "");
+
+	begin_function(this->program.init, "");
+	compile_top_level(program, "");
+	end_function();
+
+	return this->program;
+}
+
+void BytecodeCompiler::collect(const Nodes::StatementBlock& block, const string& ns)
+{
+	for (auto& statement : block.statements)
+	{
+		if (auto function = dynamic_cast<const Nodes::FunctionDecl*>(statement))
+		{
+			string name = ns + function->name;
+			if (this->functions.count(name))
+				lexer->error(function->position, "Function %s is already defined", name.c_str());
+
+			this->functions[name] = this->program.functions.size();
+			this->program.functions.push_back(Function{name, function->position, function->rType, function->args});
+		}
+		else if (auto var = dynamic_cast<const Nodes::VarDecl*>(statement))
+		{
+			string name = ns + var->name;
+			if (this->globals.count(name))
+				lexer->error(var->position, "Global variable %s is already defined", name.c_str());
+
+			this->globals[name] = this->program.globals.size();
+			this->program.globals.push_back(name);
+			this->program.global_types.push_back(var->type);
+		}
+		else if (auto cls = dynamic_cast<const Nodes::ClassDecl*>(statement))
+			collect_class(cls, ns);
+		else if (auto nspace = dynamic_cast<const Nodes::NamespaceDecl*>(statement))
+			collect(*nspace->body, ns + nspace->name + "::");
+	}
+}
+
+// The operators a class can overload, by the name of their special function
+static const map<string, opcode> overloadable = {
+	{"__OP_PLUS__", opcode::ADD}, {"__OP_MINUS__", opcode::SUB}, {"__OP_MUL__", opcode::MUL}, {"__OP_DIV__", opcode::DIV},
+	{"__OP_MOD__", opcode::MOD}, {"__OP_POW__", opcode::POW}, {"__OP_LT__", opcode::LT}, {"__OP_LEQ__", opcode::LEQ},
+	{"__OP_GT__", opcode::GT}, {"__OP_GEQ__", opcode::GEQ},
+};
+
+// A class is a function that creates its instances, and its methods and special functions are functions whose
+// first argument is this, named like Point.length so no call can name them. The fields are laid out in the
+// order they're declared
+void BytecodeCompiler::collect_class(const Nodes::ClassDecl* decl, const string& ns)
+{
+	string name = ns + decl->name;
+	if (this->functions.count(name))
+		lexer->error(decl->position, "Function %s is already defined", name.c_str());
+
+	ClassInfo info{decl, ns, (int)this->program.functions.size(), -1, {}, {}, {}, {}};
+	this->functions[name] = info.constructor;
+	this->program.functions.push_back(Function{name, decl->position, vartypes::VAR, {}});
+	Class cls{name, {}, {}, {}, {}, vector<int32_t>(static_cast<size_t>(opcode::__END), -1), -1};
+
+	auto declare_member = [&](const string& member, Nodes::Access access, size_t position)
+	{
+		if (info.access.count(member))
+			lexer->error(position, "%s is already a member of %s", member.c_str(), name.c_str());
+		info.access[member] = access;
+		this->selectors.emplace(member, this->selectors.size());
+	};
+	auto add_function = [&](const string& function, const Nodes::FunctionDecl* source)
+	{
+		auto args = source->args;
+		args.insert(args.begin(), {{vartypes::VAR, "this"}, nullptr});
+		auto method = new Nodes::FunctionDecl{source->position, decl->name + "." + function, args, source->rType, source->body};
+		int id = this->program.functions.size();
+		this->functions[ns + method->name] = id;
+		this->program.functions.push_back(Function{ns + method->name, method->position, method->rType, args});
+		info.functions.push_back(method);
+		return id;
+	};
+
+	// The maps are by pointer, sorted by where they are they're in the order they're declared
+	vector<pair<Nodes::VarDecl*, Nodes::Access>> fields(decl->members.begin(), decl->members.end());
+	std::sort(fields.begin(), fields.end(), [](auto& x, auto& y) { return x.first->position < y.first->position; });
+	for (auto& field : fields)
+	{
+		declare_member(field.first->name, field.second, field.first->position);
+		info.fields.push_back(field.first);
+		cls.fields.push_back(field.first->name);
+		cls.ints.push_back(field.first->type == vartypes::INT);
+	}
+
+	vector<pair<Nodes::FunctionDecl*, Nodes::Access>> methods(decl->functions.begin(), decl->functions.end());
+	std::sort(methods.begin(), methods.end(), [](auto& x, auto& y) { return x.first->position < y.first->position; });
+	for (auto& method : methods)
+	{
+		declare_member(method.first->name, method.second, method.first->position);
+		int id = add_function(method.first->name, method.first);
+		info.methods[method.first->name] = id;
+
+		// INVOKE can't compile the defaults at the call like CALL does, it doesn't know the method
+		Function& function = this->program.functions[id];
+		function.defaults.assign(function.args.size(), Value::null());
+		for (size_t i = 1; i < function.args.size(); i++)
+		{
+			const Nodes::Expression* value = function.args[i].second;
+			if (!value || IsType<Nodes::NullLiteralExpression>(value) || IsType<Nodes::EmptyExpression>(value))
+				continue;
+			if (auto str = dynamic_cast<const Nodes::StringLiteralExpression*>(value))
+			{
+				auto& literal = this->strings[str->value];
+				if (!literal)
+					literal = StrObject::create(str->value, true);
+				function.defaults[i] = Value::from_obj(literal);
+			}
+			else if (!fold(value, function.defaults[i]))
+				lexer->error(value->position, "The default value of %s in method %s has to be a constant", function.args[i].first.second.c_str(), function.name.c_str());
+		}
+	}
+
+	std::set<string> special;
+	for (auto function : decl->sysFunctions)
+	{
+		const string& sys = function->name;
+		if (!special.insert(sys).second)
+			lexer->error(function->position, "%s is already defined in %s", sys.c_str(), name.c_str());
+
+		Nodes::FunctionDecl source{function->position, sys, function->args, function->rType, function->body};
+		if (sys == "initialize")
+		{
+			info.initialize = add_function(sys, &source);
+			this->program.functions[info.constructor].args = function->args;
+		}
+		else if (sys == "terminate")
+			lexer->warning(function->position, "terminate is never called, instances are freed by the collector once nothing uses them");
+		else if (sys == "__str__")
+		{
+			if (!function->args.empty())
+				lexer->error(function->position, "__str__ takes no arguments");
+			cls.str = add_function(sys, &source);
+		}
+		else if (sys == "__OP_EQ__" || sys == "__OP_NEQ__")
+			lexer->error(function->position, "Instances are compared by identity, == and != can't be overloaded");
+		else if (auto op = overloadable.find(sys); op != overloadable.end())
+		{
+			if (function->args.size() != 1)
+				lexer->error(function->position, "%s takes one argument, the right operand", sys.c_str());
+			cls.operators[static_cast<uint8_t>(op->second)] = add_function(sys, &source);
+		}
+		else lexer->error(function->position, "Unknown special function %s in class %s", sys.c_str(), name.c_str());
+	}
+
+	this->program.classes.push_back(cls);
+	this->classes.push_back(info);
+}
+
+// Only the public members can be found through the selectors, an instance whose class the compiler can't tell
+// doesn't know whose method it's in
+void BytecodeCompiler::layout_classes()
+{
+	this->program.members.resize(this->selectors.size());
+	for (auto& selector : this->selectors)
+		this->program.members[selector.second] = selector.first;
+
+	for (size_t i = 0; i < this->classes.size(); i++)
+	{
+		const ClassInfo& info = this->classes[i];
+		Class& cls = this->program.classes[i];
+		cls.slots.assign(this->selectors.size(), -1);
+		cls.methods.assign(this->selectors.size(), -1);
+		for (size_t slot = 0; slot < cls.fields.size(); slot++)
+			if (info.access.at(cls.fields[slot]) == Nodes::Access::PUBLIC)
+				cls.slots[this->selectors[cls.fields[slot]]] = slot;
+		for (auto& method : info.methods)
+			if (info.access.at(method.first) == Nodes::Access::PUBLIC)
+				cls.methods[this->selectors[method.first]] = method.second;
+	}
+}
+
+// A local has a class if it gets a value only from calls to the class, this always has its method's class
+map<string, int> BytecodeCompiler::infer_classes(const Nodes::FunctionDecl* decl, int self)
+{
+	map<string, int> classes;
+	if (self >= 0)
+		classes["this"] = self;
+
+	for_each_definition(decl->body, [&](const string& name, const Nodes::Expression* value)
+	{
+		if (self >= 0 && name == "this")
+			lexer->error(value ? value->position : decl->position, "Can't assign to this");
+
+		while (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(value))
+			value = paren->value;
+		auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(value);
+		int function = call ? find_function(call->name) : -1;
+		int cls = function >= 0 ? this->callees[function].constructs : -1;
+
+		auto found = classes.find(name);
+		if (found == classes.end()) classes[name] = cls;
+		else if (found->second != cls) found->second = -1;
+	});
+	// The arguments can be anything
+	for (auto& arg : decl->args)
+		if (arg.first.second != "this" || self < 0)
+			classes[arg.first.second] = -1;
+	return classes;
+}
+
+// The walkers in the optimizer take trees they can change, these only read them
+static size_t tree_size(const Nodes::StatementBlock* body)
+{
+	auto block = const_cast<Nodes::StatementBlock*>(body);
+	size_t size = 0;
+	for_each_block(block, [&](Nodes::StatementBlock* b) { size += b->statements.size(); });
+	for_each_expression(block, [&](Nodes::Expression*) { size++; });
+	return size;
+}
+
+static void for_each_call(const Nodes::Statement* statement, const std::function<void(const Nodes::FunctionCallExpression*)>& fn)
+{
+	for_each_expression(const_cast<Nodes::Statement*>(statement), [&](Nodes::Expression* e)
+	{
+		if (auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(e))
+			fn(call);
+	});
+}
+
+void BytecodeCompiler::analyze(const Nodes::StatementBlock& block, const string& ns)
+{
+	auto function = [&](const Nodes::FunctionDecl* decl)
+	{
+		int id = this->functions[ns + decl->name];
+		Callee& callee = this->callees[id];
+		callee.decl = decl;
+		callee.ns = ns;
+		callee.size = tree_size(decl->body);
+
+		this->ns = ns;
+		callee.classes = infer_classes(decl, callee.cls);
+		auto target = [&](int target)
+		{
+			this->callees[target].calls++;
+			callee.targets.push_back(target);
+		};
+		for_each_call(decl->body, [&](const Nodes::FunctionCallExpression* call)
+		{
+			if (int id = find_function(call->name); id >= 0)
+				target(id);
+		});
+		// The methods called on a local with a class, the ones it calls on other instances can't be told yet
+		for_each_expression(decl->body, [&](Nodes::Expression* e)
+		{
+			auto call = dynamic_cast<Nodes::MethodCallExpression*>(e);
+			auto object = call ? dynamic_cast<Nodes::IdentifierExpression*>(call->object) : nullptr;
+			auto cls = object ? callee.classes.find(object->name) : callee.classes.end();
+			if (cls != callee.classes.end() && cls->second >= 0)
+				if (auto method = this->classes[cls->second].methods.find(call->name); method != this->classes[cls->second].methods.end())
+					target(method->second);
+		});
+	};
+
+	for (auto& statement : block.statements)
+	{
+		if (auto decl = dynamic_cast<const Nodes::FunctionDecl*>(statement))
+			function(decl);
+		else if (auto decl = dynamic_cast<const Nodes::ClassDecl*>(statement))
+		{
+			const ClassInfo& info = this->classes[this->callees[this->functions[ns + decl->name]].constructs];
+			for (auto method : info.functions)
+				function(method);
+
+			// The constructor runs the initializers of the fields and calls initialize
+			Callee& constructor = this->callees[info.constructor];
+			constructor.ns = ns;
+			this->ns = ns;
+			for (auto field : info.fields)
+				for_each_call(field, [&](const Nodes::FunctionCallExpression* call)
+				{
+					if (int id = find_function(call->name); id >= 0)
+					{
+						this->callees[id].calls++;
+						constructor.targets.push_back(id);
+					}
+				});
+			if (info.initialize >= 0)
+			{
+				this->callees[info.initialize].calls++;
+				constructor.targets.push_back(info.initialize);
+			}
+		}
+		else if (auto nspace = dynamic_cast<const Nodes::NamespaceDecl*>(statement))
+			analyze(*nspace->body, ns + nspace->name + "::");
+		else
+		{
+			this->ns = ns;
+			for_each_call(statement, [&](const Nodes::FunctionCallExpression* call)
+			{
+				int target = find_function(call->name);
+				if (target >= 0) this->callees[target].calls++;
+			});
+		}
+	}
+	this->ns = "";
+}
+
+// The functions in a cycle of calls are never inlined, copying one into a caller in the cycle only unrolls
+// the recursion once, and `return f()` in the copy couldn't reuse the frame. The cycles are the strongly
+// connected components of the calls with more than one function in them, or a function that calls itself
+void BytecodeCompiler::find_recursion()
+{
+	size_t count = this->callees.size();
+	vector<int> index(count, -1), low(count, 0);
+	vector<bool> on_stack(count, false);
+	vector<int> stack;
+	int next = 0;
+
+	std::function<void(int)> visit = [&](int id)
+	{
+		index[id] = low[id] = next++;
+		stack.push_back(id);
+		on_stack[id] = true;
+		for (int target : this->callees[id].targets)
+		{
+			if (index[target] < 0)
+			{
+				visit(target);
+				low[id] = std::min(low[id], low[target]);
+			}
+			else if (on_stack[target])
+				low[id] = std::min(low[id], index[target]);
+			this->callees[id].recursive |= target == id;
+		}
+		if (low[id] != index[id])
+			return;
+
+		size_t first = stack.size();
+		do first--; while (stack[first] != id);
+		for (size_t i = first; i < stack.size(); i++)
+		{
+			on_stack[stack[i]] = false;
+			this->callees[stack[i]].recursive |= stack.size() - first > 1;
+		}
+		stack.resize(first);
+	};
+	for (size_t id = 0; id < count; id++)
+		if (index[id] < 0)
+			visit(id);
+}
+
+void BytecodeCompiler::compile_functions(const Nodes::StatementBlock& block, const string& ns)
+{
+	for (auto& statement : block.statements)
+	{
+		if (auto decl = dynamic_cast<const Nodes::FunctionDecl*>(statement))
+			compile_function(decl, ns);
+		else if (auto decl = dynamic_cast<const Nodes::ClassDecl*>(statement))
+		{
+			const ClassInfo& info = this->classes[this->callees[this->functions[ns + decl->name]].constructs];
+			for (auto method : info.functions)
+				compile_function(method, ns);
+			compile_constructor(info);
+		}
+		else if (auto nspace = dynamic_cast<const Nodes::NamespaceDecl*>(statement))
+			compile_functions(*nspace->body, ns + nspace->name + "::");
+	}
+}
+
+void BytecodeCompiler::compile_function(const Nodes::FunctionDecl* decl, const string& ns)
+{
+	TRACE_SCOPE("bytecode_function", decl->name);
+
+	begin_function(this->functions[ns + decl->name], ns);
+
+	// The arguments are the first registers
+	for (auto& arg : decl->args)
+	{
+		if (this->scopes.back().count(arg.first.second))
+			lexer->error(decl->position, "Argument %s is defined twice", arg.first.second.c_str());
+
+		int reg = alloc(1, decl->position);
+		this->scopes.back()[arg.first.second] = Local{(uint16_t)reg, arg.first.first};
+		if (arg.first.first == vartypes::INT)
+			emit(Instruction(opcode::TOINT, reg, 0, 0), decl->position);
+	}
+
+	probe("fn " + this->function->name, decl->position);
+	this->block(decl->body);
+	end_function();
+}
+
+// Creates the instance, gives the fields their initial values and passes the arguments on to initialize. The
+// initializers can't see the arguments, they're only named for the call
+void BytecodeCompiler::compile_constructor(const ClassInfo& info)
+{
+	TRACE_SCOPE("bytecode_function", info.decl->name);
+
+	size_t pos = info.decl->position;
+	int cls = this->callees[info.constructor].constructs;
+	begin_function(info.constructor, info.ns);
+	size_t argc = this->function->args.size();
+	int args = alloc(argc, pos);
+	int object = alloc(1, pos);
+	emit(Instruction::with_bx(opcode::NEWOBJ, object, cls), pos);
+
+	for (size_t slot = 0; slot < info.fields.size(); slot++)
+	{
+		const Nodes::VarDecl* field = info.fields[slot];
+		int reg = alloc(1, field->position);
+		expression(field->value, reg);
+		if (field->type == vartypes::INT)
+			emit(Instruction(opcode::TOINT, reg, 0, 0), field->position);
+		emit(Instruction(opcode::SETFIELD, object, slot, reg), field->position);
+		this->free_reg = reg;
+	}
+
+	if (info.initialize >= 0)
+	{
+		vector<Nodes::Expression*> values{new Nodes::IdentifierExpression{pos, "@this"}};
+		this->scopes.back()["@this"] = Local{(uint16_t)object, vartypes::VAR};
+		for (size_t i = 0; i < argc; i++)
+		{
+			string name = "@" + std::to_string(i);
+			this->scopes.back()[name] = Local{(uint16_t)(args + i), this->function->args[i].first.first};
+			values.push_back(new Nodes::IdentifierExpression{pos, name});
+		}
+
+		Nodes::FunctionCallExpression initialize{pos, "initialize", values};
+		int reg = alloc(1, pos);
+		call_function(info.initialize, &initialize, reg);
+		this->free_reg = reg;
+		for (auto value : values)
+			delete value;
+	}
+
+	emit(Instruction(opcode::RET, object, 0, 0), pos);
+	end_function();
+}
+
+void BytecodeCompiler::compile_top_level(const Nodes::StatementBlock& block, const string& ns)
+{
+	for (auto& statement : block.statements)
+	{
+		if (IsType<Nodes::FunctionDecl>(statement) || IsType<Nodes::ClassDecl>(statement))
+			continue;
+		else if (auto nspace = dynamic_cast<const Nodes::NamespaceDecl*>(statement))
+		{
+			string outer = this->ns;
+			this->ns = ns + nspace->name + "::";
+			compile_top_level(*nspace->body, this->ns);
+			this->ns = outer;
+		}
+		else this->statement(statement);
+	}
+}
+
+void BytecodeCompiler::begin_function(int id, const string& ns)
+{
+	this->function = &this->program.functions[id];
+	this->ns = ns;
+	this->scopes.clear();
+	this->scopes.emplace_back();
+	this->scope_floor = 0;
+	this->local_classes = &this->callees[id].classes;
+	this->current_class = this->callees[id].cls;
+	this->free_reg = 0;
+	this->loops.clear();
+	this->num_constants.clear();
+	this->str_constants.clear();
+}
+
+void BytecodeCompiler::end_function()
+{
+	// Falling off the end of a function returns null, and so does jumping to the end, like an if whose
+	// branch doesn't return does when the function ends with the other branch's return
+	bool jumped = false;
+	for (auto& ins : this->function->code)
+		jumped |= (ins.op == opcode::JMP || ins.op == opcode::JMPIF || ins.op == opcode::JMPIFNOT || ins.op == opcode::ITERNEXT
+			|| ins.op == opcode::FORPREP || ins.op == opcode::FORLOOP || ins.op == opcode::FORDEC) && ins.bx() == here();
+	if (this->function->code.empty() || this->function->code.back().op != opcode::RET || jumped)
+		emit(Instruction(opcode::RETNULL, 0, 0, 0), this->function->position);
+	this->function = nullptr;
+}
+
+void BytecodeCompiler::statement(const Nodes::Statement* statement)
+{
+	size_t pos = statement->position;
+
+	if (auto block = dynamic_cast<const Nodes::StatementBlock*>(statement))
+		this->block(block);
+	else if (auto expr = dynamic_cast<const Nodes::ExpressionStatement*>(statement))
+	{
+		auto assign = dynamic_cast<const Nodes::AssignExpression*>(expr->value);
+		Local* local = assign ? find_local(assign->name) : nullptr;
+
+		if (auto decl = dynamic_cast<const Nodes::VarDeclExpression*>(expr->value))
+			declare(decl->name, decl->type, decl->value, pos);
+		// Assigning to a local can skip the temporary when the value is only written at the very end
+		else if (local && !writes_early(assign->value))
+		{
+			expression(assign->value, local->reg);
+			if (local->type == vartypes::INT)
+				emit(Instruction(opcode::TOINT, local->reg, 0, 0), pos);
+		}
+		else
+		{
+			int reg = alloc(1, pos);
+			expression(expr->value, reg);
+			this->free_reg = reg;
+		}
+	}
+	else if (auto var = dynamic_cast<const Nodes::VarDecl*>(statement))
+		declare(var->name, var->type, var->value, pos);
+	else if (auto ite = dynamic_cast<const Nodes::Ite*>(statement))
+	{
+		// The branch the profile says runs more often goes first so it falls through, the other one is
+		// jumped to and out of its way
+		string name = std::to_string(ite->condition->position);
+		bool has_else = ite->elseBranch && !ite->elseBranch->statements.empty();
+		bool swap = has_else && this->profile && this->profile->count("then " + name) * 2 < this->profile->count("if " + name);
+		probe("if " + name, pos);
+
+		// A branch that rarely runs is cold, the JIT puts it after the rest of the function so it doesn't
+		// take space in the cache between the instructions that do
+		bool cold_then = unlikely(ite, true), cold_else = has_else && unlikely(ite, false);
+
+		vector<size_t> jumps;
+		condition(ite->condition, jumps, swap);
+		if (swap)
+		{
+			size_t start = here();
+			this->block(ite->elseBranch);
+			size_t skip_then = emit(Instruction(opcode::JMP, 0, 0, 0), pos);
+			if (cold_else) cold(start);
+			for (auto jump : jumps) patch(jump, here());
+			start = here();
+			probe("then " + name, pos);
+			this->block(ite->ifBranch);
+			if (cold_then) cold(start);
+			patch(skip_then, here());
+		}
+		else
+		{
+			size_t start = here();
+			probe("then " + name, pos);
+			this->block(ite->ifBranch);
+			if (has_else)
+			{
+				size_t skip_else = emit(Instruction(opcode::JMP, 0, 0, 0), pos);
+				if (cold_then) cold(start);
+				for (auto jump : jumps) patch(jump, here());
+				start = here();
+				this->block(ite->elseBranch);
+				if (cold_else) cold(start);
+				patch(skip_else, here());
+			}
+			else
+			{
+				if (cold_then) cold(start);
+				for (auto jump : jumps) patch(jump, here());
+			}
+		}
+	}
+	else if (auto loop = dynamic_cast<const Nodes::While*>(statement))
+	{
+		string name = std::to_string(pos);
+		probe("loop " + name, pos);
+		size_t start = here();
+		this->loops.emplace_back();
+		condition(loop->condition, this->loops.back().breaks);
+
+		probe("iter " + name, pos);
+		this->block(loop->body);
+		emit(Instruction::with_bx(opcode::JMP, 0, start), pos);
+		end_loop(start);
+	}
+	else if (auto loop = dynamic_cast<const Nodes::For*>(statement); loop && counted_loop(loop))
+		;
+	else if (auto loop = dynamic_cast<const Nodes::For*>(statement))
+	{
+		int saved = this->free_reg;
+		this->scopes.emplace_back();
+
+		if (auto decl = dynamic_cast<const Nodes::VarDeclExpression*>(loop->init))
+			declare(decl->name, decl->type, decl->value, pos);
+		else
+		{
+			int reg = alloc(1, pos);
+			expression(loop->init, reg);
+			this->free_reg = reg;
+		}
+
+		string name = std::to_string(pos);
+		probe("loop " + name, pos);
+		size_t start = here();
+		this->loops.emplace_back();
+		condition(loop->condition, this->loops.back().breaks);
+
+		probe("iter " + name, pos);
+		this->block(loop->body);
+
+		size_t step = here();
+		int reg = alloc(1, pos);
+		expression(loop->step, reg);
+		this->free_reg = reg;
+		emit(Instruction::with_bx(opcode::JMP, 0, start), pos);
+		end_loop(step);
+
+		this->scopes.pop_back();
+		this->free_reg = saved;
+	}
+	else if (auto loop = dynamic_cast<const Nodes::ForIter*>(statement))
+	{
+		// R[base] is what we iterate over, R[base+1] is the index and R[base+2] the current element
+		int saved = this->free_reg;
+		this->scopes.emplace_back();
+
+		int base = alloc(3, pos);
+		string name = std::to_string(pos);
+		probe("loop " + name, pos);
+		expression(loop->iterOrNum, base);
+		emit(Instruction::with_bx(opcode::LOADK, base + 1, constant(0.0)), pos);
+		size_t first = emit(Instruction(opcode::JMP, 0, 0, 0), pos);
+
+		size_t body = here();
+		probe("iter " + name, pos);
+		if (auto decl = dynamic_cast<const Nodes::VarDeclExpression*>(loop->init))
+		{
+			this->scopes.back()[decl->name] = Local{(uint16_t)(base + 2), decl->type};
+			if (decl->type == vartypes::INT)
+				emit(Instruction(opcode::TOINT, base + 2, 0, 0), pos);
+		}
+		else if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(loop->init))
+			store(id->name, base + 2, pos);
+		else if (auto assign = dynamic_cast<const Nodes::AssignExpression*>(loop->init))
+			store(assign->name, base + 2, pos);
+		else lexer->error(loop->init->position, "Expected a variable to iterate with");
+
+		this->loops.emplace_back();
+		this->block(loop->body);
+
+		size_t next = here();
+		patch(first, next);
+		emit(Instruction::with_bx(opcode::ITERNEXT, base, body), pos);
+		end_loop(next);
+
+		this->scopes.pop_back();
+		this->free_reg = saved;
+	}
+	else if (auto ret = dynamic_cast<const Nodes::Return*>(statement); ret && !this->inlined.empty())
+	{
+		// Returning from an inlined body writes the result and jumps past the rest of it, the value
+		// can inline more calls so the innermost one is only looked at after it
+		size_t innermost = this->inlined.size() - 1;
+		int dst = this->inlined[innermost].dst;
+		this->expression(ret->value, dst);
+		if (this->program.functions[this->inlined[innermost].id].rType == vartypes::INT)
+			emit(Instruction(opcode::TOINT, dst, 0, 0), pos);
+		this->inlined[innermost].returns.push_back(emit(Instruction(opcode::JMP, 0, 0, 0), pos));
+	}
+	else if (auto ret = dynamic_cast<const Nodes::Return*>(statement))
+	{
+		if (this->function == &this->program.functions[this->program.init])
+			lexer->error(pos, "Can't return outside of a function");
+
+		if (IsType<Nodes::NullLiteralExpression>(ret->value))
+			emit(Instruction(opcode::RETNULL, 0, 0, 0), pos);
+		else if (tail_call(ret->value))
+			;
+		else
+		{
+			int saved = this->free_reg;
+			int reg = any(ret->value);
+			if (this->function->rType == vartypes::INT)
+			{
+				// Don't round the variable itself
+				if (reg < saved)
+				{
+					int tmp = alloc(1, pos);
+					emit(Instruction(opcode::MOVE, tmp, reg, 0), pos);
+					reg = tmp;
+				}
+				emit(Instruction(opcode::TOINT, reg, 0, 0), pos);
+			}
+			emit(Instruction(opcode::RET, reg, 0, 0), pos);
+			this->free_reg = saved;
+		}
+	}
+	else if (IsType<Nodes::Break>(statement) || IsType<Nodes::Continue>(statement))
+	{
+		if (this->loops.empty())
+			lexer->error(pos, "%s outside of a loop", IsType<Nodes::Break>(statement) ? "break" : "continue");
+
+		size_t jump = emit(Instruction(opcode::JMP, 0, 0, 0), pos);
+		if (IsType<Nodes::Break>(statement)) this->loops.back().breaks.push_back(jump);
+		else this->loops.back().continues.push_back(jump);
+	}
+	else if (IsType<Nodes::ImportModule>(statement) || IsType<Nodes::ImportFile>(statement))
+		lexer->warning(pos, "Imports are only put in the program with -flto at the top level of a file, ignoring it");
+	else if (IsType<Nodes::FunctionDecl>(statement))
+		lexer->error(pos, "Functions can only be declared at the top level or in a namespace");
+	else if (IsType<Nodes::NamespaceDecl>(statement))
+		lexer->error(pos, "Namespaces can only be declared at the top level or in a namespace");
+	else if (IsType<Nodes::ClassDecl>(statement))
+		lexer->error(pos, "Classes can only be declared at the top level or in a namespace");
+	// Empty, root and EOF statements do nothing
+}
+
+void BytecodeCompiler::block(const Nodes::StatementBlock* block)
+{
+	int saved = this->free_reg;
+	this->scopes.emplace_back();
+
+	for (auto& statement : block->statements)
+		this->statement(statement);
+
+	this->scopes.pop_back();
+	this->free_reg = saved;
+}
+
+// Patches the jumps of the innermost loop, break goes to the current instruction
+void BytecodeCompiler::end_loop(size_t continue_target)
+{
+	Loop finished = this->loops.back();
+	this->loops.pop_back();
+	for (auto jump : finished.continues) patch(jump, continue_target);
+	for (auto jump : finished.breaks) patch(jump, here());
+}
+
+// Short circuits, ternaries and calls write to their result before they're done reading their operands
+bool BytecodeCompiler::writes_early(const Nodes::Expression* expression) const
+{
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expression))
+		return writes_early(paren->value);
+	if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expression))
+		return binary->op == operators::AND || binary->op == operators::OR;
+	return IsType<Nodes::TernaryExpression>(expression) || IsType<Nodes::AssignExpression>(expression) || IsType<Nodes::IndexAssignExpression>(expression)
+		|| IsType<Nodes::FunctionCallExpression>(expression) || IsType<Nodes::MemberAssignExpression>(expression) || IsType<Nodes::MethodCallExpression>(expression);
+}
+
+void BytecodeCompiler::condition(const Nodes::Expression* expression, vector<size_t>& jumps, bool when)
+{
+	int saved = this->free_reg;
+	int reg = any(expression);
+	jumps.push_back(emit(Instruction(when ? opcode::JMPIF : opcode::JMPIFNOT, reg, 0, 0), expression->position));
+	this->free_reg = saved;
+}
+
+void BytecodeCompiler::declare(const string& name, vartypes type, const Nodes::Expression* value, size_t position)
+{
+	if (at_top_level())
+	{
+		int reg = alloc(1, position);
+		expression(value, reg);
+		if (type == vartypes::INT)
+			emit(Instruction(opcode::TOINT, reg, 0, 0), position);
+		emit(Instruction::with_bx(opcode::SETGLOBAL, reg, this->globals[this->ns + name]), position);
+		this->free_reg = reg;
+		return;
+	}
+
+	if (this->scopes.back().count(name))
+		lexer->error(position, "Variable %s is already defined in this scope", name.c_str());
+
+	// The variable isn't visible in its own initializer, so `int a = a` uses the outer a
+	int reg = alloc(1, position);
+	expression(value, reg);
+	if (type == vartypes::INT)
+		emit(Instruction(opcode::TOINT, reg, 0, 0), position);
+	this->scopes.back()[name] = Local{(uint16_t)reg, type};
+}
+
+void BytecodeCompiler::store(const string& name, int reg, size_t position)
+{
+	if (Local* local = find_local(name))
+	{
+		if (local->reg != reg)
+			emit(Instruction(opcode::MOVE, local->reg, reg, 0), position);
+		if (local->type == vartypes::INT)
+			emit(Instruction(opcode::TOINT, local->reg, 0, 0), position);
+		return;
+	}
+
+	int global = find_global(name);
+	if (global < 0)
+		lexer->error(position, "Undefined variable %s", name.c_str());
+
+	if (this->program.global_types[global] == vartypes::INT)
+		emit(Instruction(opcode::TOINT, reg, 0, 0), position);
+	emit(Instruction::with_bx(opcode::SETGLOBAL, reg, global), position);
+}
+
+// The instruction for a binary operator, AND and OR short circuit so they have none
+static bool binary_opcode(operators op, opcode& out)
+{
+	switch (op)
+	{
+	case operators::PLUS: out = opcode::ADD; return true;
+	case operators::MINUS: out = opcode::SUB; return true;
+	case operators::MUL: out = opcode::MUL; return true;
+	case operators::DIV: out = opcode::DIV; return true;
+	case operators::MOD: out = opcode::MOD; return true;
+	case operators::POW: out = opcode::POW; return true;
+	case operators::EQ: out = opcode::EQ; return true;
+	case operators::NEQ: out = opcode::NEQ; return true;
+	case operators::LT: out = opcode::LT; return true;
+	case operators::LEQ: out = opcode::LEQ; return true;
+	case operators::GT: out = opcode::GT; return true;
+	case operators::GEQ: out = opcode::GEQ; return true;
+	default: return false;
+	}
+}
+
+// Writes the value of the expression into dst, the registers above dst are free to use as temporaries
+// a + b + c is a + (b + c), when a chain like that has a str literal in it, it's most likely
+// building a str, and one CONCAT does that with one allocation instead of one for every +
+static bool concat_chain(const Nodes::BinaryExpression* binary, vector<const Nodes::Expression*>& operands)
+{
+	const Nodes::Expression* rest = binary;
+	while (auto add = dynamic_cast<const Nodes::BinaryExpression*>(rest))
+	{
+		if (add->op != operators::PLUS) break;
+		operands.push_back(add->left);
+		rest = add->right;
+	}
+	operands.push_back(rest);
+
+	if (operands.size() < 3 || operands.size() > 0xffff) return false;
+	for (auto operand : operands)
+		if (IsType<Nodes::StringLiteralExpression>(operand))
+			return true;
+	return false;
+}
+
+void BytecodeCompiler::expression(const Nodes::Expression* expression, int dst)
+{
+	size_t pos = expression->position;
+	int saved = this->free_reg;
+
+	if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expression))
+		emit(Instruction::with_bx(opcode::LOADK, dst, constant(num->value)), pos);
+	else if (auto str = dynamic_cast<const Nodes::StringLiteralExpression*>(expression))
+		emit(Instruction::with_bx(opcode::LOADK, dst, constant(str->value)), pos);
+	else if (auto b = dynamic_cast<const Nodes::BoolLiteralExpression*>(expression))
+		emit(Instruction(b->value ? opcode::LOADTRUE : opcode::LOADFALSE, dst, 0, 0), pos);
+	else if (IsType<Nodes::NullLiteralExpression>(expression) || IsType<Nodes::EmptyExpression>(expression))
+		emit(Instruction(opcode::LOADNULL, dst, 0, 0), pos);
+	else if (Value folded; fold(expression, folded))
+	{
+		if (folded.is_num()) emit(Instruction::with_bx(opcode::LOADK, dst, constant(folded.as_num())), pos);
+		else emit(Instruction(folded.as_bool() ? opcode::LOADTRUE : opcode::LOADFALSE, dst, 0, 0), pos);
+	}
+	else if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expression))
+	{
+		if (Local* local = find_local(id->name))
+		{
+			if (local->reg != dst)
+				emit(Instruction(opcode::MOVE, dst, local->reg, 0), pos);
+		}
+		else
+		{
+			int global = find_global(id->name);
+			if (global < 0)
+				lexer->error(pos, "Undefined variable %s", id->name.c_str());
+			emit(Instruction::with_bx(opcode::GETGLOBAL, dst, global), pos);
+		}
+	}
+	else if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expression))
+		this->expression(paren->value, dst);
+	else if (auto assign = dynamic_cast<const Nodes::AssignExpression*>(expression))
+	{
+		this->expression(assign->value, dst);
+		store(assign->name, dst, pos);
+	}
+	else if (IsType<Nodes::VarDeclExpression>(expression))
+		lexer->error(pos, "Variables can only be declared as a statement or in a for loop");
+	else if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expression))
+	{
+		int reg = any(unary->value);
+		emit(Instruction(unary->op == operators::NOT ? opcode::NOT : opcode::NEG, dst, reg, 0), pos);
+	}
+	else if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expression))
+	{
+		if (binary->op == operators::AND || binary->op == operators::OR)
+		{
+			// Short circuit, the result is always a bool
+			this->expression(binary->left, dst);
+			emit(Instruction(opcode::TEST, dst, dst, 0), pos);
+			size_t skip = emit(Instruction(binary->op == operators::AND ? opcode::JMPIFNOT : opcode::JMPIF, dst, 0, 0), pos);
+			this->expression(binary->right, dst);
+			emit(Instruction(opcode::TEST, dst, dst, 0), pos);
+			patch(skip, here());
+		}
+		else if (overloaded(binary, dst))
+			;
+		else if (vector<const Nodes::Expression*> operands; concat_chain(binary, operands))
+		{
+			int base = alloc(operands.size(), pos);
+			for (size_t i = 0; i < operands.size(); i++)
+				this->expression(operands[i], base + i);
+			emit(Instruction(opcode::CONCAT, dst, base, operands.size()), pos);
+		}
+		else
+		{
+			opcode op;
+			if (!binary_opcode(binary->op, op))
+				lexer->error(pos, "Unknown binary operator %s", getStringFromId(uenum(binary->op)).c_str());
+			int left = any(binary->left);
+			int right = any(binary->right);
+			emit(Instruction(op, dst, left, right), pos);
+		}
+	}
+	else if (auto ternary = dynamic_cast<const Nodes::TernaryExpression*>(expression))
+	{
+		vector<size_t> false_jumps;
+		condition(ternary->condition, false_jumps);
+		this->expression(ternary->true_value, dst);
+		size_t skip = emit(Instruction(opcode::JMP, 0, 0, 0), pos);
+		for (auto jump : false_jumps) patch(jump, here());
+		this->expression(ternary->false_value, dst);
+		patch(skip, here());
+	}
+	else if (auto fcall = dynamic_cast<const Nodes::FunctionCallExpression*>(expression))
+		call(fcall, dst);
+	else if (auto access = dynamic_cast<const Nodes::ArrayAccessExpression*>(expression))
+	{
+		int array = any(access->array);
+		int index = any(access->index);
+		emit(Instruction(access->inBounds ? opcode::GETINBOUNDS : opcode::GETINDEX, dst, array, index), pos);
+	}
+	else if (auto assign = dynamic_cast<const Nodes::IndexAssignExpression*>(expression))
+	{
+		int array = any(assign->array);
+		int index = any(assign->index);
+		this->expression(assign->value, dst);
+		emit(Instruction(opcode::SETINDEX, array, index, dst), pos);
+	}
+	else if (auto array = dynamic_cast<const Nodes::ArrayLiteralExpression*>(expression))
+	{
+		int base = alloc(array->values.size(), pos);
+		for (size_t i = 0; i < array->values.size(); i++)
+			this->expression(array->values[i], base + i);
+		emit(Instruction(opcode::NEWARR, dst, base, array->values.size()), pos);
+	}
+	else if (auto range = dynamic_cast<const Nodes::RangeArrayLiteralExpression*>(expression))
+	{
+		int base = alloc(3, pos);
+		this->expression(range->start, base);
+		this->expression(range->end, base + 1);
+		this->expression(range->step, base + 2);
+		emit(Instruction(opcode::NEWRANGE, dst, base, 0), pos);
+	}
+	else if (IsType<Nodes::MemberAccessExpression>(expression) || IsType<Nodes::MemberAssignExpression>(expression) || IsType<Nodes::MethodCallExpression>(expression))
+		member(expression, dst);
+	else
+		lexer->error(pos, ERROR_WE_DONT_KNOW);
+
+	this->free_reg = saved;
+}
+
+int BytecodeCompiler::any(const Nodes::Expression* expression)
+{
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expression))
+		if (Local* local = find_local(id->name))
+			return local->reg;
+
+	int reg = alloc(1, expression->position);
+	this->expression(expression, reg);
+	return reg;
+}
+
+void BytecodeCompiler::call(const Nodes::FunctionCallExpression* call, int dst)
+{
+	size_t pos = call->position;
+	int id = find_function(call->name);
+
+	if (id < 0)
+	{
+		int builtin = find_builtin(call->name);
+		if (builtin < 0)
+			lexer->error(pos, "Undefined function %s", call->name.c_str());
+
+		const Builtin& b = builtins[builtin];
+		if ((int)call->args.size() < b.min_args || (b.max_args >= 0 && (int)call->args.size() > b.max_args))
+			lexer->error(pos, "Wrong number of arguments for %s, got %zu", b.name, call->args.size());
+
+		int base = call_base(dst, call->args.size(), pos);
+		for (size_t i = 0; i < call->args.size(); i++)
+			this->expression(call->args[i], base + i);
+		emit(Instruction(opcode::CALLBUILTIN, base, builtin, call->args.size()), pos);
+		if (base != dst)
+			emit(Instruction(opcode::MOVE, dst, base, 0), pos);
+		return;
+	}
+
+	call_function(id, call, dst);
+}
+
+void BytecodeCompiler::call_function(int id, const Nodes::FunctionCallExpression* call, int dst)
+{
+	size_t pos = call->position;
+	const Function& callee = this->program.functions[id];
+	if (call->args.size() > callee.args.size())
+	{
+		// this isn't counted for methods
+		size_t receiver = this->callees[id].cls >= 0 ? 1 : 0;
+		lexer->error(pos, "Too many arguments for %s, it takes %zu but got %zu", callee.name.c_str(), callee.args.size() - receiver, call->args.size() - receiver);
+	}
+	if (should_inline(id, call))
+	{
+		inline_call(id, call, dst);
+		return;
+	}
+
+	// The callee's frame starts at the first argument
+	int base = call_base(dst, callee.args.size(), pos);
+	arguments(callee, call, base);
+	emit(Instruction(opcode::CALL, base, id, callee.args.size()), pos);
+	if (base != dst)
+		emit(Instruction(opcode::MOVE, dst, base, 0), pos);
+}
+
+int BytecodeCompiler::class_of(const Nodes::Expression* expression)
+{
+	while (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expression))
+		expression = paren->value;
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expression))
+	{
+		if (!find_local(id->name))
+			return -1;
+		auto found = this->local_classes->find(id->name);
+		return found == this->local_classes->end() ? -1 : found->second;
+	}
+	if (auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(expression))
+	{
+		int function = find_function(call->name);
+		return function < 0 ? -1 : this->callees[function].constructs;
+	}
+	return -1;
+}
+
+// Private and protected members can only be used in the class's own methods, there is no inheritance yet so
+// protected is the same as private
+const BytecodeCompiler::ClassInfo* BytecodeCompiler::known_member(int cls, const string& name, size_t position)
+{
+	const ClassInfo& info = this->classes[cls];
+	const char* class_name = this->program.classes[cls].name.c_str();
+	auto found = info.access.find(name);
+	if (found == info.access.end())
+		lexer->error(position, "%s has no member %s", class_name, name.c_str());
+	if (found->second != Nodes::Access::PUBLIC && this->current_class != cls)
+		lexer->error(position, "%s is %s in %s", name.c_str(), found->second == Nodes::Access::PRIVATE ? "private" : "protected", class_name);
+	return &info;
+}
+
+static int find_field(const Class& cls, const string& name)
+{
+	for (size_t slot = 0; slot < cls.fields.size(); slot++)
+		if (cls.fields[slot] == name)
+			return slot;
+	return -1;
+}
+
+// When the compiler knows the class of the object, a field is at a slot it knows and a method is a function it
+// can call directly, or even inline. Otherwise the member is looked up in the instance's class when it runs
+void BytecodeCompiler::member(const Nodes::Expression* expression, int dst)
+{
+	size_t pos = expression->position;
+	// Every instruction that looks a member up gets a site of its own, and with it its own inline cache
+	auto site = [&](const string& name, bool method)
+	{
+		size_t i = 0;
+		while (i < this->classes.size() && !(method ? this->classes[i].methods.count(name) > 0 : find_field(this->program.classes[i], name) >= 0))
+			i++;
+		if (i == this->classes.size())
+			lexer->error(pos, method ? "No class has a method %s" : "No class has a field %s", name.c_str());
+		if (this->function->sites.size() >= MAX_SITES)
+			lexer->error(pos, "Function %s looks up too many members", this->function->name.c_str());
+		this->function->sites.push_back(this->selectors[name]);
+		return (int)this->function->sites.size() - 1;
+	};
+	auto slot = [&](int cls, const string& name)
+	{
+		known_member(cls, name, pos);
+		int slot = find_field(this->program.classes[cls], name);
+		if (slot < 0)
+			lexer->error(pos, "%s is a method of %s, it can only be called", name.c_str(), this->program.classes[cls].name.c_str());
+		return slot;
+	};
+
+	if (auto access = dynamic_cast<const Nodes::MemberAccessExpression*>(expression))
+	{
+		int cls = class_of(access->object);
+		int field = cls >= 0 ? slot(cls, access->name) : -1;
+		int member = cls >= 0 ? 0 : site(access->name, false);
+		int object = any(access->object);
+		if (cls >= 0)
+			emit(Instruction(opcode::GETFIELD, dst, object, field), pos);
+		else
+			emit(Instruction(opcode::GETMEMBER, dst, object, member), pos);
+	}
+	else if (auto assign = dynamic_cast<const Nodes::MemberAssignExpression*>(expression))
+	{
+		int cls = class_of(assign->object);
+		int field = cls >= 0 ? slot(cls, assign->name) : -1;
+		int member = cls >= 0 ? 0 : site(assign->name, false);
+		int object = any(assign->object);
+		this->expression(assign->value, dst);
+		if (cls >= 0)
+		{
+			if (this->program.classes[cls].ints[field])
+				emit(Instruction(opcode::TOINT, dst, 0, 0), pos);
+			emit(Instruction(opcode::SETFIELD, object, field, dst), pos);
+		}
+		else
+			emit(Instruction(opcode::SETMEMBER, object, dst, member), pos);
+	}
+	else if (auto method = dynamic_cast<const Nodes::MethodCallExpression*>(expression))
+	{
+		// The object is the first argument
+		vector<Nodes::Expression*> args{method->object};
+		args.insert(args.end(), method->args.begin(), method->args.end());
+		Nodes::FunctionCallExpression call{pos, method->name, args};
+
+		int cls = class_of(method->object);
+		if (cls >= 0)
+		{
+			const ClassInfo* info = known_member(cls, method->name, pos);
+			auto found = info->methods.find(method->name);
+			if (found == info->methods.end())
+				lexer->error(pos, "%s is a field of %s, not a method", method->name.c_str(), this->program.classes[cls].name.c_str());
+			call_function(found->second, &call, dst);
+			return;
+		}
+
+		int member = site(method->name, true);
+		int base = call_base(dst, args.size(), pos);
+		for (size_t i = 0; i < args.size(); i++)
+			this->expression(args[i], base + i);
+		emit(Instruction(opcode::INVOKE, base, member, args.size()), pos);
+		if (base != dst)
+			emit(Instruction(opcode::MOVE, dst, base, 0), pos);
+	}
+}
+
+// The operator is a call to the function the class of the left operand overloads it with, a comparison gives
+// a bool like it does when the runtime finds the overload
+bool BytecodeCompiler::overloaded(const Nodes::BinaryExpression* binary, int dst)
+{
+	opcode op;
+	int cls = class_of(binary->left);
+	if (cls < 0 || !binary_opcode(binary->op, op) || this->program.classes[cls].operators[static_cast<uint8_t>(op)] < 0)
+		return false;
+
+	// In a register of its own, the operands can still read dst
+	size_t pos = binary->position;
+	Nodes::FunctionCallExpression call{pos, getStringFromId(uenum(binary->op)), {binary->left, binary->right}};
+	int reg = alloc(1, pos);
+	call_function(this->program.classes[cls].operators[static_cast<uint8_t>(op)], &call, reg);
+	bool comparison = op == opcode::LT || op == opcode::LEQ || op == opcode::GT || op == opcode::GEQ;
+	emit(Instruction(comparison ? opcode::TEST : opcode::MOVE, dst, reg, 0), pos);
+	return true;
+}
+
+// The ones the call leaves out get their default value, or null
+void BytecodeCompiler::arguments(const Function& callee, const Nodes::FunctionCallExpression* call, int base)
+{
+	for (size_t i = 0; i < callee.args.size(); i++)
+	{
+		if (i < call->args.size())
+			this->expression(call->args[i], base + i);
+		else if (callee.args[i].second)
+			this->expression(callee.args[i].second, base + i);
+		else
+			emit(Instruction(opcode::LOADNULL, base + i, 0, 0), call->position);
+	}
+}
+
+// `return f(...)` doesn't need this frame anymore. A call to the function itself puts the new arguments in
+// place and jumps back to the start, so the recursion is a loop, any other call replaces the frame with the
+// callee's. Either way deep recursions don't run out of frames
+bool BytecodeCompiler::tail_call(const Nodes::Expression* value)
+{
+	while (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(value))
+		value = paren->value;
+	auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(value);
+	int id = call ? find_function(call->name) : -1;
+	if (id < 0 || call->args.size() > this->program.functions[id].args.size() || should_inline(id, call))
+		return false;
+
+	// An int function rounds what it returns, the callee has to do it for it
+	const Function& callee = this->program.functions[id];
+	if (this->function->rType == vartypes::INT && callee.rType != vartypes::INT)
+		return false;
+
+	size_t pos = call->position;
+	int saved = this->free_reg;
+	int base = alloc(callee.args.empty() ? 1 : callee.args.size(), pos);
+	arguments(callee, call, base);
+	if (&callee == this->function)
+	{
+		for (size_t i = 0; i < callee.args.size(); i++)
+			emit(Instruction(opcode::MOVE, i, base + i, 0), pos);
+		emit(Instruction::with_bx(opcode::JMP, 0, 0), pos);
+	}
+	else
+		emit(Instruction(opcode::TAILCALL, base, id, callee.args.size()), pos);
+	this->free_reg = saved;
+	return true;
+}
+
+// A call is worth inlining when the body isn't much bigger than the call, the limit grows for every constant
+// argument since the parts of the body that use it fold away, and for functions that are only called once.
+// With a profile, functions that never ran aren't worth growing the caller for and hot ones get a bigger limit
+bool BytecodeCompiler::should_inline(int id, const Nodes::FunctionCallExpression* call)
+{
+	const Callee& callee = this->callees[id];
+	if (this->inline_limit <= 0 || !callee.decl || callee.recursive)
+		return false;
+	if (this->inlined.size() >= INLINE_MAX_DEPTH || this->function->code.size() >= INLINE_MAX_CALLER)
+		return false;
+	for (auto& outer : this->inlined)
+		if (outer.id == id)
+			return false;
+
+	size_t limit = this->inline_limit;
+	Value value;
+	for (auto arg : call->args)
+		if (fold(arg, value))
+			limit += INLINE_CONSTANT_BONUS;
+	if (callee.calls == 1)
+		limit *= INLINE_SINGLE_CALL_FACTOR;
+	if (this->profile)
+	{
+		string name = "fn " + this->program.functions[id].name;
+		if (this->profile->count(name) == 0)
+			return false;
+		if (this->profile->hot(name))
+			limit *= PROFILE_HOT_INLINE_FACTOR;
+	}
+	return callee.size <= limit;
+}
+
+// If the body writes to the variable, an argument for it that's a constant can't be folded into the body
+static bool assigns(const Nodes::StatementBlock* body, const string& name)
+{
+	bool assigned = false;
+	auto block = const_cast<Nodes::StatementBlock*>(body);
+	for_each_expression(block, [&](Nodes::Expression* e)
+	{
+		if (auto assign = dynamic_cast<Nodes::AssignExpression*>(e))
+			assigned |= assign->name == name;
+	});
+	for_each_block(block, [&](Nodes::StatementBlock* b)
+	{
+		for (auto statement : b->statements)
+			if (auto loop = dynamic_cast<Nodes::ForIter*>(statement))
+				if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(loop->init))
+					assigned |= id->name == name;
+	});
+	return assigned;
+}
+
+// If the body reads the variable anywhere
+static bool reads(const Nodes::StatementBlock* body, const string& name)
+{
+	bool read = false;
+	for_each_expression(const_cast<Nodes::StatementBlock*>(body), [&](Nodes::Expression* e)
+	{
+		if (auto id = dynamic_cast<Nodes::IdentifierExpression*>(e))
+			read |= id->name == name;
+	});
+	return read;
+}
+
+static inline bool whole(double d)
+{
+	return d > -9007199254740992.0 && d < 9007199254740992.0 && d == (double)(int64_t)d;
+}
+
+// A loop lowered from a range with a step that's a whole number and a start that's one too only ever holds
+// whole numbers, so it can tell how many times it runs before it starts and then only count down. R[base] is
+// the variable, R[base+1] the end and then the count, R[base+2] the step. The end has to be read only once,
+// so it must be a constant or a local the body doesn't write, and so does the variable
+bool BytecodeCompiler::counted_loop(const Nodes::For* loop)
+{
+	auto decl = dynamic_cast<const Nodes::VarDeclExpression*>(loop->init);
+	auto compare = dynamic_cast<const Nodes::BinaryExpression*>(loop->condition);
+	auto step = dynamic_cast<const Nodes::AssignExpression*>(loop->step);
+	if (!loop->range || !decl || !compare || !step || step->name != decl->name)
+		return false;
+
+	auto increment = dynamic_cast<const Nodes::BinaryExpression*>(step->value);
+	auto var = increment ? dynamic_cast<const Nodes::IdentifierExpression*>(increment->left) : nullptr;
+	double by, start;
+	if (!var || var->name != decl->name || increment->op != operators::PLUS || !get_constant_number(increment->right, by) || by == 0 || !whole(by))
+		return false;
+	auto counter = dynamic_cast<const Nodes::IdentifierExpression*>(compare->left);
+	if (!counter || counter->name != decl->name || compare->op != (by > 0 ? operators::LT : operators::GT))
+		return false;
+	bool constant_start = get_constant_number(decl->value, start) && whole(start);
+	if (decl->type != vartypes::INT && !constant_start)
+		return false;
+
+	double limit;
+	auto end = dynamic_cast<const Nodes::IdentifierExpression*>(compare->right);
+	bool once = get_constant_number(compare->right, limit)
+		|| (end && end->name != decl->name && (end->name[0] == '@' || (find_local(end->name) && !assigns(loop->body, end->name))));
+	if (!once || assigns(loop->body, decl->name))
+		return false;
+
+	string name = std::to_string(loop->position);
+	probe("loop " + name, loop->position);
+	if (constant_start && unroll(loop, start, by))
+		return true;
+
+	size_t pos = loop->position;
+	int saved = this->free_reg;
+	this->scopes.emplace_back();
+
+	int base = alloc(3, pos);
+	expression(decl->value, base);
+	if (decl->type == vartypes::INT && !constant_start)
+		emit(Instruction(opcode::TOINT, base, 0, 0), pos);
+	expression(compare->right, base + 1);
+	emit(Instruction::with_bx(opcode::LOADK, base + 2, constant(by)), pos);
+	this->scopes.back()[decl->name] = Local{(uint16_t)base, decl->type};
+	if (this->vectorize_loops && by == 1)
+		vectorize(loop, base);
+	size_t prep = emit(Instruction::with_bx(opcode::FORPREP, base, 0), pos);
+
+	size_t body = here();
+	probe("iter " + name, pos);
+	this->loops.emplace_back();
+	this->block(loop->body);
+
+	// Nothing but the count has to change when the body never looks at the variable
+	size_t next = here();
+	emit(Instruction::with_bx(reads(loop->body, decl->name) ? opcode::FORLOOP : opcode::FORDEC, base, body), pos);
+	end_loop(next);
+	patch(prep, here());
+
+	this->scopes.pop_back();
+	this->free_reg = saved;
+	return true;
+}
+
+// A loop the profile says is hot that runs a few times known up front is compiled once for every iteration,
+// with its variable as a constant that the body folds, instead of counting and jumping back. It can't have a
+// break or a continue, there's no loop for them to leave
+bool BytecodeCompiler::unroll(const Nodes::For* loop, double start, double by)
+{
+	auto decl = static_cast<const Nodes::VarDeclExpression*>(loop->init);
+	auto compare = static_cast<const Nodes::BinaryExpression*>(loop->condition);
+	size_t pos = loop->position;
+	string name = std::to_string(pos);
+	double limit;
+	if (!this->profile || !this->profile->hot("loop " + name) || !get_constant_number(compare->right, limit))
+		return false;
+	double count = by > 0 ? (start < limit ? ceil((limit - start) / by) : 0) : (start > limit ? ceil((start - limit) / -by) : 0);
+	if (count > PROFILE_UNROLL_MAX || count * tree_size(loop->body) > PROFILE_UNROLL_SIZE)
+		return false;
+	bool jumps = false;
+	for_each_block(const_cast<Nodes::StatementBlock*>(loop->body), [&](Nodes::StatementBlock* b)
+	{
+		for (auto statement : b->statements)
+			jumps |= IsType<Nodes::Break>(statement) || IsType<Nodes::Continue>(statement);
+	});
+	if (jumps)
+		return false;
+
+	bool read = reads(loop->body, decl->name);
+	for (double i = 0; i < count; i++)
+	{
+		int saved = this->free_reg;
+		this->scopes.emplace_back();
+		int reg = alloc(1, pos);
+		double value = start + i * by;
+		if (read)
+			emit(Instruction::with_bx(opcode::LOADK, reg, constant(value)), pos);
+		this->scopes.back()[decl->name] = Local{(uint16_t)reg, decl->type, true, Value::from_num(value)};
+		probe("iter " + name, pos);
+		this->block(loop->body);
+		this->scopes.pop_back();
+		this->free_reg = saved;
+	}
+	return true;
+}
+
+// A counted loop with a step of 1 whose body is only `c[i] = value` or `s = s + value`, where the value is
+// + - * / of arrs indexed by the variable, the variable itself, and numbers and variables the loop doesn't
+// change, gets a kernel that computes it for many elements at once. The VECLOOP before the loop runs it
+// and makes the loop skip itself, unless the arrs and values it gets aren't all numbers
+void BytecodeCompiler::vectorize(const Nodes::For* loop, int base)
+{
+	const string& name = static_cast<const Nodes::VarDeclExpression*>(loop->init)->name;
+	auto statement = loop->body->statements.size() == 1 ? dynamic_cast<const Nodes::ExpressionStatement*>(loop->body->statements[0]) : nullptr;
+	if (!statement)
+		return;
+
+	Kernel kernel{{}, false, false, 0};
+	const Nodes::Expression* value;
+	const Nodes::Expression* target;
+	string written; // The value can't read it, it changes every iteration
+	if (auto store = dynamic_cast<const Nodes::IndexAssignExpression*>(statement->value))
+	{
+		auto array = dynamic_cast<const Nodes::IdentifierExpression*>(store->array);
+		auto index = dynamic_cast<const Nodes::IdentifierExpression*>(store->index);
+		if (!array || !index || index->name != name || array->name == name)
+			return;
+		value = store->value;
+		target = array;
+	}
+	else if (auto assign = dynamic_cast<const Nodes::AssignExpression*>(statement->value))
+	{
+		auto sum = dynamic_cast<const Nodes::BinaryExpression*>(assign->value);
+		auto left = sum ? dynamic_cast<const Nodes::IdentifierExpression*>(sum->left) : nullptr;
+		Local* local = find_local(assign->name);
+		if (!local || !left || sum->op != operators::PLUS || left->name != assign->name || assign->name == name)
+			return;
+		kernel.reduce = true;
+		kernel.truncate = local->type == vartypes::INT;
+		kernel.target = local->reg;
+		value = sum->right;
+		target = nullptr;
+		written = assign->name;
+	}
+	else return;
+
+	// The steps, with the expression that has the register of every ARR and SCALAR
+	vector<pair<KernelOp, const Nodes::Expression*>> steps;
+	std::function<bool(const Nodes::Expression*)> walk = [&](const Nodes::Expression* e)
+	{
+		if (steps.size() >= KERNEL_MAX_STEPS)
+			return false;
+		if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(e))
+			return walk(paren->value);
+		if (auto access = dynamic_cast<const Nodes::ArrayAccessExpression*>(e))
+		{
+			auto array = dynamic_cast<const Nodes::IdentifierExpression*>(access->array);
+			auto index = dynamic_cast<const Nodes::IdentifierExpression*>(access->index);
+			if (!array || !index || index->name != name || array->name == name || array->name == written)
+				return false;
+			steps.push_back({KernelOp::ARR, array});
+			return true;
+		}
+		if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(e))
+		{
+			if (id->name == written)
+				return false;
+			steps.push_back({id->name == name ? KernelOp::INDEX : KernelOp::SCALAR, id});
+			return true;
+		}
+		if (IsType<Nodes::NumLiteralExpression>(e))
+		{
+			steps.push_back({KernelOp::SCALAR, e});
+			return true;
+		}
+		if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(e))
+		{
+			if (unary->op != operators::MINUS || !walk(unary->value))
+				return false;
+			steps.push_back({KernelOp::NEG, nullptr});
+			return true;
+		}
+		auto binary = dynamic_cast<const Nodes::BinaryExpression*>(e);
+		if (!binary || !walk(binary->left) || !walk(binary->right))
+			return false;
+		switch (binary->op)
+		{
+		case operators::PLUS: steps.push_back({KernelOp::ADD, nullptr}); return true;
+		case operators::MINUS: steps.push_back({KernelOp::SUB, nullptr}); return true;
+		case operators::MUL: steps.push_back({KernelOp::MUL, nullptr}); return true;
+		case operators::DIV: steps.push_back({KernelOp::DIV, nullptr}); return true;
+		default: return false;
+		}
+	};
+	if (!walk(value) || steps.size() > KERNEL_MAX_STEPS)
+		return;
+
+	// Nothing in the body can change what's read before the loop, it has no calls
+	int saved = this->free_reg;
+	map<string, int> read;
+	auto reg = [&](const Nodes::Expression* e)
+	{
+		auto id = dynamic_cast<const Nodes::IdentifierExpression*>(e);
+		if (!id) return any(e);
+		auto found = read.find(id->name);
+		return found != read.end() ? found->second : read[id->name] = any(e);
+	};
+	for (auto& step : steps)
+		kernel.code.push_back(KernelStep{step.first, (uint16_t)(step.second && step.first != KernelOp::INDEX ? reg(step.second) : 0)});
+	if (target)
+		kernel.target = reg(target);
+
+	this->program.kernels.push_back(kernel);
+	emit(Instruction::with_bx(opcode::VECLOOP, base, this->program.kernels.size() - 1), loop->position);
+	this->free_reg = saved;
+}
+
+// Compiles the callee's body right into the caller. The arguments are evaluated in order into new registers
+// like they are for a call, and the body sees them, its namespace and the globals, never the caller's locals
+void BytecodeCompiler::inline_call(int id, const Nodes::FunctionCallExpression* call, int dst)
+{
+	size_t pos = call->position;
+	const Function& callee = this->program.functions[id];
+	const Callee& info = this->callees[id];
+
+	map<string, Local> params;
+	int base = alloc(callee.args.size(), pos);
+	for (size_t i = 0; i < callee.args.size(); i++)
+	{
+		auto& arg = callee.args[i];
+		const Nodes::Expression* value = i < call->args.size() ? call->args[i] : arg.second;
+		if (value)
+			this->expression(value, base + i);
+		else
+			emit(Instruction(opcode::LOADNULL, base + i, 0, 0), pos);
+		if (arg.first.first == vartypes::INT)
+			emit(Instruction(opcode::TOINT, base + i, 0, 0), pos);
+
+		Local param{(uint16_t)(base + i), arg.first.first};
+		Value folded;
+		if (value && fold(value, folded) && !assigns(info.decl->body, arg.first.second))
+		{
+			param.constant = true;
+			param.value = arg.first.first == vartypes::INT ? Runtime::toint(folded) : folded;
+		}
+		params[arg.first.second] = param;
+	}
+
+	string outer_ns = this->ns;
+	size_t outer_floor = this->scope_floor;
+	const map<string, int>* outer_classes = this->local_classes;
+	int outer_class = this->current_class;
+	vector<Loop> outer_loops;
+	std::swap(outer_loops, this->loops);
+	this->ns = info.ns;
+	this->local_classes = &info.classes;
+	this->current_class = info.cls;
+	this->scopes.push_back(params);
+	this->scope_floor = this->scopes.size() - 1;
+	this->inlined.push_back(Inlined{id, dst, {}});
+
+	probe("fn " + callee.name, pos);
+	this->block(info.decl->body);
+
+	// A body that ends with a return falls through to the end instead of jumping there
+	Inlined done = this->inlined.back();
+	this->inlined.pop_back();
+	auto& statements = info.decl->body->statements;
+	if (!statements.empty() && IsType<Nodes::Return>(statements.back()) && !done.returns.empty() && done.returns.back() == here() - 1)
+	{
+		this->function->code.pop_back();
+		this->function->positions.pop_back();
+		done.returns.pop_back();
+	}
+	else
+		emit(Instruction(opcode::LOADNULL, dst, 0, 0), pos);
+	for (auto jump : done.returns)
+		patch(jump, here());
+
+	this->scopes.pop_back();
+	this->scope_floor = outer_floor;
+	this->ns = outer_ns;
+	this->local_classes = outer_classes;
+	this->current_class = outer_class;
+	std::swap(outer_loops, this->loops);
+}
+
+// Constant numbers and bools, and the operators on them that always give the same result
+bool BytecodeCompiler::fold(const Nodes::Expression* expression, Value& value)
+{
+	if (auto num = dynamic_cast<const Nodes::NumLiteralExpression*>(expression))
+	{
+		value = Value::from_num(num->value);
+		return true;
+	}
+	if (auto b = dynamic_cast<const Nodes::BoolLiteralExpression*>(expression))
+	{
+		value = Value::from_bool(b->value);
+		return true;
+	}
+	if (auto paren = dynamic_cast<const Nodes::ParenthesisExpression*>(expression))
+		return fold(paren->value, value);
+	if (auto id = dynamic_cast<const Nodes::IdentifierExpression*>(expression))
+	{
+		Local* local = find_local(id->name);
+		if (!local || !local->constant)
+			return false;
+		value = local->value;
+		return true;
+	}
+	if (auto unary = dynamic_cast<const Nodes::UnaryExpression*>(expression))
+	{
+		if (!fold(unary->value, value))
+			return false;
+		if (unary->op == operators::MINUS && value.is_num())
+			value = Value::from_num(-value.as_num());
+		else if (unary->op == operators::NOT && value.is_bool())
+			value = Value::from_bool(!value.as_bool());
+		else
+			return false;
+		return true;
+	}
+	if (auto binary = dynamic_cast<const Nodes::BinaryExpression*>(expression))
+	{
+		Value a, b;
+		opcode op;
+		if (!binary_opcode(binary->op, op) || !fold(binary->left, a) || !fold(binary->right, b))
+			return false;
+
+		if (op == opcode::EQ || op == opcode::NEQ)
+		{
+			value = Value::from_bool(values_equal(a, b) == (op == opcode::EQ));
+			return true;
+		}
+		if (!a.is_num() || !b.is_num())
+			return false;
+
+		double x = a.as_num(), y = b.as_num();
+		switch (op)
+		{
+		case opcode::LT: value = Value::from_bool(x < y); break;
+		case opcode::LEQ: value = Value::from_bool(x <= y); break;
+		case opcode::GT: value = Value::from_bool(x > y); break;
+		case opcode::GEQ: value = Value::from_bool(x >= y); break;
+		default: value = Runtime::arith(op, a, b, nullptr); break;
+		}
+		return true;
+	}
+	return false;
+}
+
+// The arguments go into registers above everything that is in use, if dst is the last register in use the call can start right there
+int BytecodeCompiler::call_base(int dst, size_t argc, size_t position)
+{
+	int count = argc ? argc : 1;
+	if (dst == this->free_reg - 1)
+	{
+		alloc(count - 1, position);
+		return dst;
+	}
+	return alloc(count, position);
+}
+
+void BytecodeCompiler::probe(const string& name, size_t position)
+{
+	if (!this->instrument)
+		return;
+	auto found = this->probes.find(name);
+	if (found == this->probes.end())
+	{
+		found = this->probes.insert({name, this->program.probes.size()}).first;
+		this->program.probes.push_back(name);
+	}
+	emit(Instruction::with_bx(opcode::PROBE, 0, found->second), position);
+}
+
+// A branch that prints something and returns is reporting an error
+static bool reports(const Nodes::StatementBlock* block)
+{
+	if (!block || block->statements.empty() || !IsType<Nodes::Return>(block->statements.back()))
+		return false;
+	for (auto statement : block->statements)
+		if (auto expr = dynamic_cast<const Nodes::ExpressionStatement*>(statement))
+			if (auto call = dynamic_cast<const Nodes::FunctionCallExpression*>(expr->value); call && call->name == "print")
+				return true;
+	return false;
+}
+
+bool BytecodeCompiler::unlikely(const Nodes::Ite* ite, bool then) const
+{
+	// The profile knows, if the if ran at all while it was trained
+	string name = std::to_string(ite->condition->position);
+	uint64_t ran = this->profile ? this->profile->count("if " + name) : 0;
+	if (ran > 0)
+	{
+		uint64_t taken = this->profile->count("then " + name);
+		return (then ? taken : ran - taken) * PROFILE_HOT_RATIO < ran;
+	}
+
+	// Without it, what compilers guess: a value is rarely null and errors are rare
+	auto binary = dynamic_cast<const Nodes::BinaryExpression*>(ite->condition);
+	if (binary && (binary->op == operators::EQ || binary->op == operators::NEQ)
+		&& (IsType<Nodes::NullLiteralExpression>(binary->left) || IsType<Nodes::NullLiteralExpression>(binary->right)))
+		return (binary->op == operators::EQ) == then;
+	return reports(then ? ite->ifBranch : ite->elseBranch);
+}
+
+void BytecodeCompiler::cold(size_t from)
+{
+	if (from < here())
+		this->function->cold.push_back({(uint32_t)from, (uint32_t)here()});
+}
+
+size_t BytecodeCompiler::emit(Instruction ins, size_t position)
+{
+	this->function->code.push_back(ins);
+	this->function->positions.push_back(position);
+	return this->function->code.size() - 1;
+}
+
+void BytecodeCompiler::patch(size_t at, size_t target)
+{
+	this->function->code[at].set_bx(target);
+}
+
+int BytecodeCompiler::alloc(int count, size_t position)
+{
+	int reg = this->free_reg;
+	this->free_reg += count;
+
+	if (this->free_reg > MAX_REGISTERS)
+		lexer->error(position, "Function %s needs too many registers", this->function->name.c_str());
+	if (this->free_reg > this->function->registers)
+		this->function->registers = this->free_reg;
+
+	return reg;
+}
+
+uint32_t BytecodeCompiler::constant(double num)
+{
+	Value value = Value::from_num(num);
+	auto found = this->num_constants.find(value.bits);
+	if (found != this->num_constants.end())
+		return found->second;
+
+	this->function->constants.push_back(value);
+	return this->num_constants[value.bits] = this->function->constants.size() - 1;
+}
+
+uint32_t BytecodeCompiler::constant(const string& str)
+{
+	auto found = this->str_constants.find(str);
+	if (found != this->str_constants.end())
+		return found->second;
+
+	// Every function that uses the same literal shares one str
+	auto& literal = this->strings[str];
+	if (!literal)
+		literal = StrObject::create(str, true);
+	this->function->constants.push_back(Value::from_obj(literal));
+	return this->str_constants[str] = this->function->constants.size() - 1;
+}
+
+BytecodeCompiler::Local* BytecodeCompiler::find_local(const string& name)
+{
+	for (size_t i = this->scopes.size(); i-- > this->scope_floor; )
+	{
+		auto found = this->scopes[i].find(name);
+		if (found != this->scopes[i].end())
+			return &found->second;
+	}
+	return nullptr;
+}
+
+// Drops the innermost namespace, "a::b::" becomes "a::"
+static string outer_namespace(const string& ns)
+{
+	size_t at = ns.size() > 2 ? ns.rfind("::", ns.size() - 3) : string::npos;
+	return at == string::npos ? "" : ns.substr(0, at + 2);
+}
+
+// Names are looked up from the innermost namespace outwards, so math::pi can be used as pi inside math
+int BytecodeCompiler::find_global(const string& name) const
+{
+	for (string ns = this->ns; ; ns = outer_namespace(ns))
+	{
+		auto found = this->globals.find(ns + name);
+		if (found != this->globals.end())
+			return found->second;
+		if (ns.empty())
+			return -1;
+	}
+}
+
+int BytecodeCompiler::find_function(const string& name) const
+{
+	for (string ns = this->ns; ; ns = outer_namespace(ns))
+	{
+		auto found = this->functions.find(ns + name);
+		if (found != this->functions.end())
+			return found->second;
+		if (ns.empty())
+			return -1;
+	}
+}
@@ -0,0 +1,155 @@
+#ifndef VM_COMPILER_HPP
+#define VM_COMPILER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "bytecode.hpp"
+#include "profile.hpp"
+#include "../lexer/lexer.hpp"
+#include "../parser/tree.hpp"
+#include "../macros.hpp"
+
+using std::string;
+using std::vector;
+using std::map;
+
+// The inliner's cost model, sizes are counted in statements and expressions of the function's body
+#define INLINE_DEFAULT_LIMIT 40 // The biggest function that's copied into its callers, -finline-limit sets it
+#define INLINE_CONSTANT_BONUS 10 // Every constant argument lets a bigger function in, parts of it fold away
+#define INLINE_SINGLE_CALL_FACTOR 4 // A function that's called once doesn't grow the program much when it's copied
+#define INLINE_MAX_DEPTH 8 // How many inlined calls can be inside each other
+#define INLINE_MAX_CALLER 8192 // Nothing more is inlined into a function with this many instructions
+
+// Lowers the tree into bytecode for the interpreter
+class BytecodeCompiler
+{
+private:
+	struct Local
+	{
+		uint16_t reg;
+		vartypes type;
+		bool constant = false; // An argument of an inlined call that is a constant and is never assigned
+		Value value = Value::null();
+	};
+	struct Loop
+	{
+		vector<size_t> breaks; // Jumps to patch with the end of the loop
+		vector<size_t> continues; // Jumps to patch with the step of the loop
+	};
+	struct Callee // What the inliner knows about a function
+	{
+		const Nodes::FunctionDecl* decl; // nullptr for @init and constructors
+		string ns;
+		size_t size;
+		int calls; // How many calls to it there are in the whole program
+		bool recursive; // It can call itself, maybe through other functions
+		vector<int> targets = {}; // The functions it calls
+		int cls = -1; // The class of this for methods
+		int constructs = -1; // The class it creates an instance of, for constructors
+		map<string, int> classes = {}; // The class of its locals that only ever hold instances of one, or -1
+	};
+	struct ClassInfo // What the compiler knows about a class besides what the program keeps
+	{
+		const Nodes::ClassDecl* decl;
+		string ns;
+		int constructor;
+		int initialize; // -1 if it has none
+		vector<const Nodes::VarDecl*> fields; // By slot
+		map<string, Nodes::Access> access; // Of every field and method
+		map<string, int> methods; // The function of every method, by name
+		vector<Nodes::FunctionDecl*> functions; // The methods and the special functions, this is their first argument
+	};
+	struct Inlined // A call whose body is being compiled into the caller
+	{
+		int id;
+		int dst;
+		vector<size_t> returns; // Jumps to patch with the end of the body
+	};
+
+	Lexer* lexer;
+	int inline_limit;
+	bool vectorize_loops;
+	bool instrument; // -fprofile-generate, the PROBEs count what runs
+	const Profile* profile; // -fprofile-use, nullptr without one
+	Program program;
+	map<string, int> functions;
+	map<string, int> globals;
+	vector<ClassInfo> classes; // Like the program's
+	map<string, int> selectors; // Of every member name
+	map<string, uint32_t> probes; // The index of every probe by what it counts, inlined bodies share them
+
+	// The function that is being compiled
+	Function* function;
+	string ns; // The namespace we're in, e.g. "math::"
+	vector<map<string, Local>> scopes;
+	int free_reg; // Every register from here on is free
+	vector<Loop> loops;
+	map<uint64_t, uint32_t> num_constants; // By their bits, so -0 isn't 0 and NaN can be found
+	map<string, uint32_t> str_constants;
+	map<string, StrObject*> strings; // The literals of the whole program
+	vector<Callee> callees; // By function id
+	vector<Inlined> inlined; // Innermost last
+	size_t scope_floor; // The scopes below it are the caller's when a call is inlined, its locals aren't visible
+	const map<string, int>* local_classes; // The function's, or the inlined callee's
+	int current_class; // The class whose methods can see its private members, or -1
+public:
+	BytecodeCompiler(Lexer* lexer, int inline_limit = INLINE_DEFAULT_LIMIT, bool vectorize = true, bool instrument = false, const Profile* profile = nullptr);
+
+	Program compile(const Nodes::StatementBlock& program);
+private:
+	void collect(const Nodes::StatementBlock& block, const string& ns);
+	void collect_class(const Nodes::ClassDecl* decl, const string& ns);
+	void layout_classes(); // Fills the tables of the classes once every member name has its selector
+	map<string, int> infer_classes(const Nodes::FunctionDecl* decl, int self);
+	void analyze(const Nodes::StatementBlock& block, const string& ns); // Fills the callees for the inliner
+	void find_recursion();
+	void compile_functions(const Nodes::StatementBlock& block, const string& ns);
+	void compile_top_level(const Nodes::StatementBlock& block, const string& ns);
+	void compile_function(const Nodes::FunctionDecl* decl, const string& ns);
+	void compile_constructor(const ClassInfo& info);
+	void begin_function(int id, const string& ns);
+	void end_function();
+
+	void statement(const Nodes::Statement* statement);
+	void block(const Nodes::StatementBlock* block);
+	void expression(const Nodes::Expression* expression, int dst);
+	int any(const Nodes::Expression* expression); // The register that has the value, without copying locals
+	void call(const Nodes::FunctionCallExpression* call, int dst);
+	void call_function(int id, const Nodes::FunctionCallExpression* call, int dst); // The receiver is the first argument of methods
+	void member(const Nodes::Expression* expression, int dst); // Reads, writes and calls of members
+	bool overloaded(const Nodes::BinaryExpression* binary, int dst); // Compiles a direct call if the left operand's class overloads the operator
+	int class_of(const Nodes::Expression* expression); // -1 if we can't tell
+	const ClassInfo* known_member(int cls, const string& name, size_t position); // Checks the member can be used here
+	bool should_inline(int id, const Nodes::FunctionCallExpression* call);
+	void arguments(const Function& callee, const Nodes::FunctionCallExpression* call, int base);
+	bool tail_call(const Nodes::Expression* value); // Compiles `return value` if it's a call that can reuse the frame
+	void inline_call(int id, const Nodes::FunctionCallExpression* call, int dst);
+	bool fold(const Nodes::Expression* expression, Value& value); // If the expression is a constant number or bool
+	int call_base(int dst, size_t argc, size_t position);
+	void condition(const Nodes::Expression* expression, vector<size_t>& jumps, bool when = false); // Jumps away when the condition is when
+	void declare(const string& name, vartypes type, const Nodes::Expression* value, size_t position);
+	void store(const string& name, int reg, size_t position);
+	void end_loop(size_t continue_target);
+	bool counted_loop(const Nodes::For* loop); // Compiles a range loop that only counts, if it has that shape
+	void vectorize(const Nodes::For* loop, int base); // Adds a VECLOOP before an element-wise counted loop
+	bool unroll(const Nodes::For* loop, double start, double by); // Compiles a hot loop that runs a few known times without the loop
+	void probe(const string& name, size_t position); // Counts it with -fprofile-generate
+	bool unlikely(const Nodes::Ite* ite, bool then) const; // If the branch rarely runs, so it's compiled as cold
+	void cold(size_t from); // Marks the code from there to here as cold
+	bool writes_early(const Nodes::Expression* expression) const;
+
+	size_t emit(Instruction ins, size_t position);
+	void patch(size_t at, size_t target);
+	inline size_t here() const { return this->function->code.size(); }
+	int alloc(int count = 1, size_t position = 0);
+	uint32_t constant(double num);
+	uint32_t constant(const string& str);
+
+	Local* find_local(const string& name);
+	int find_global(const string& name) const;
+	int find_function(const string& name) const;
+	inline bool at_top_level() const { return this->function == &this->program.functions[this->program.init] && this->scopes.size() == 1; }
+};
+
+#endif // VM_COMPILER_HPP
@@ -0,0 +1,180 @@
+#include "gc.hpp"
+#include "../profiler/tracer.hpp"
+
+#include <chrono>
+#include <stdlib.h>
+
+static Value* stack = nullptr;
+static Value* const* top = nullptr;
+static vector<Value>* globals = nullptr;
+
+static Object* young = nullptr;
+static Object* old = nullptr;
+static size_t young_bytes = 0;
+static size_t old_bytes = 0;
+static size_t next_major = GC_MIN_MAJOR_BYTES;
+static vector<Object*> remembered;
+static vector<Object*> gray; // Marked arrs and instances whose elements aren't marked yet
+static GC::Stats totals = {};
+
+static size_t size_of(const Object* object)
+{
+	if (object->type == ObjType::STR)
+		return sizeof(StrObject) + ((const StrObject*)object)->length + 1;
+	if (object->type == ObjType::INSTANCE)
+		return sizeof(InstanceObject) + ((const InstanceObject*)object)->cls->fields.size() * sizeof(Value);
+
+	const ArrObject* arr = (const ArrObject*)object;
+	return sizeof(ArrObject) + (arr->kind == ArrKind::BOOL ? arr->capacity / 8 : arr->capacity * sizeof(Value));
+}
+
+static void free_object(Object* object)
+{
+	if (object->type == ObjType::STR || object->type == ObjType::INSTANCE)
+		free(object); // strs are malloc'd with their characters, instances with their fields
+	else
+	{
+		ArrObject* arr = (ArrObject*)object;
+		free(arr->values);
+		delete arr;
+	}
+}
+
+// Minor collections stop at old objects, whatever they point to is found through the remembered set
+static inline void mark(Value value, bool major)
+{
+	if (!value.is_obj()) return;
+
+	Object* object = value.as_obj();
+	if (object->marked || object->generation == Generation::PERMANENT || (!major && object->generation == Generation::OLD))
+		return;
+	object->marked = true;
+	if (object->type != ObjType::STR)
+		gray.push_back(object);
+}
+
+static void mark_children(Object* object, bool major)
+{
+	if (object->type == ObjType::INSTANCE)
+	{
+		InstanceObject* instance = (InstanceObject*)object;
+		for (size_t i = 0; i < instance->cls->fields.size(); i++)
+			mark(instance->fields()[i], major);
+		return;
+	}
+
+	// NUM and BOOL arrs can't point to anything
+	ArrObject* arr = (ArrObject*)object;
+	if (arr->kind != ArrKind::ANY) return;
+	for (uint32_t i = 0; i < arr->length; i++)
+		mark(arr->values[i], major);
+}
+
+// Frees the unmarked objects of the list, and gives the marked ones to keep
+static size_t sweep(Object* list, Object*& kept)
+{
+	size_t kept_bytes = 0;
+	while (list)
+	{
+		Object* object = list;
+		list = list->next;
+		size_t size = size_of(object);
+		if (object->marked)
+		{
+			object->marked = false;
+			object->generation = Generation::OLD;
+			object->next = kept;
+			kept = object;
+			kept_bytes += size;
+		}
+		else
+		{
+			totals.freed_bytes += size;
+			free_object(object);
+		}
+	}
+	return kept_bytes;
+}
+
+void GC::set_roots(Value* stack, Value* const* top, vector<Value>* globals)
+{
+	::stack = stack;
+	::top = top;
+	::globals = globals;
+}
+
+void GC::track(Object* object, size_t bytes, bool permanent)
+{
+	if (permanent)
+	{
+		object->generation = Generation::PERMANENT;
+		return;
+	}
+
+	if (::top && young_bytes + bytes > GC_NURSERY_BYTES)
+		collect(old_bytes + young_bytes > next_major);
+
+	object->next = young;
+	young = object;
+	young_bytes += bytes;
+}
+
+void GC::grow(Object* object, size_t bytes)
+{
+	if (object->generation == Generation::YOUNG) young_bytes += bytes;
+	else if (object->generation == Generation::OLD) old_bytes += bytes;
+}
+
+void GC::remember(Object* object)
+{
+	object->remembered = true;
+	remembered.push_back(object);
+}
+
+void GC::collect(bool major)
+{
+	TRACE_SCOPE(major ? "gc_major" : "gc_minor");
+	auto start = std::chrono::steady_clock::now();
+
+	for (Value* v = ::stack; v < *::top; v++)
+		mark(*v, major);
+	for (auto& v : *::globals)
+		mark(v, major);
+	if (!major)
+		for (auto object : remembered)
+			mark_children(object, major);
+	while (!gray.empty())
+	{
+		Object* object = gray.back();
+		gray.pop_back();
+		mark_children(object, major);
+	}
+
+	for (auto object : remembered)
+		object->remembered = false;
+	remembered.clear();
+
+	// Survivors become old, so nothing old points to a young object anymore
+	if (major)
+	{
+		Object* kept = nullptr;
+		old_bytes = sweep(old, kept);
+		old_bytes += sweep(young, kept);
+		old = kept;
+		next_major = old_bytes * 2 > GC_MIN_MAJOR_BYTES ? old_bytes * 2 : GC_MIN_MAJOR_BYTES;
+	}
+	else
+		old_bytes += sweep(young, old);
+	young = nullptr;
+	young_bytes = 0;
+
+	uint64_t pause = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	(major ? totals.major_collections : totals.minor_collections)++;
+	totals.total_pause_us += pause;
+	if (pause > totals.max_pause_us) totals.max_pause_us = pause;
+}
+
+const GC::Stats& GC::stats()
+{
+	return totals;
+}
@@ -0,0 +1,60 @@
+#ifndef VM_GC_HPP
+#define VM_GC_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "value.hpp"
+
+using std::vector;
+
+// strs, arrs and instances are collected by a precise, generational mark and sweep that never moves objects.
+// New objects are young. A minor collection only marks the young objects that the roots and the
+// remembered set reach, frees the others and makes the survivors old. The remembered set is the old
+// arrs and instances that were given a young value since the last collection, the write barrier adds them. A major
+// collection marks and sweeps everything, it only runs once the heap has doubled since the last one.
+//
+// The roots are the globals and the registers of the running frames, everything in [stack, *top).
+// Frames null their registers when they start, so every slot below top is a real Value, NaN-boxing
+// makes them say what they are so no stack maps are needed. A collection only starts when an object
+// is created, before it's linked in, and no runtime operation creates more than one object, so the
+// operands it's working on are still in registers.
+// Both can be set when building, tiny values make every allocation collect, to test the roots
+#ifndef GC_NURSERY_BYTES
+#define GC_NURSERY_BYTES (1 << 20) // How much can be allocated between minor collections
+#endif
+#ifndef GC_MIN_MAJOR_BYTES
+#define GC_MIN_MAJOR_BYTES (8 << 20) // The smallest heap a major collection runs for
+#endif
+
+namespace GC
+{
+	struct Stats
+	{
+		size_t minor_collections;
+		size_t major_collections;
+		size_t freed_bytes;
+		uint64_t total_pause_us;
+		uint64_t max_pause_us;
+	};
+
+	// Set by the VM or the JIT before the program starts, nothing is collected before that
+	void set_roots(Value* stack, Value* const* top, vector<Value>* globals);
+
+	// Every object is handed here when it's created, permanent ones are never collected
+	void track(Object* object, size_t bytes, bool permanent = false);
+	// An object allocated more memory, like an arr growing, it counts towards the next collection
+	void grow(Object* object, size_t bytes);
+	void remember(Object* object);
+
+	// The write barrier, whenever a value is stored in an arr or in a field of an instance
+	inline void write(Object* object, Value value)
+	{
+		if (object->generation == Generation::OLD && !object->remembered && value.is_obj() && value.as_obj()->generation == Generation::YOUNG)
+			remember(object);
+	}
+
+	void collect(bool major);
+	const Stats& stats();
+}
+
+#endif // VM_GC_HPP
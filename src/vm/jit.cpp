@@ -0,0 +1,1090 @@
+#include "jit.hpp"
+
+#ifdef DIG_HAS_JIT
+
+#include "builtins.hpp"
+#include "gc.hpp"
+#include "peephole.hpp"
+#include "runtime.hpp"
+#include "x64.hpp"
+#include "../profiler/tracer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+using namespace X64;
+using std::map;
+
+static_assert(sizeof(Value) == 8, "The JIT expects NaN-boxed values");
+
+typedef void (*JitFunction)(JitContext* context, Value* base);
+
+// The helpers compiled code calls for everything it doesn't do itself, they get the frame and the instruction
+static void jit_arith(Value* base, const Instruction* ins) { base[ins->a] = Runtime::arith(ins->op, base[ins->b], base[ins->c], ins); }
+static void jit_concat(Value* base, const Instruction* ins) { base[ins->a] = Runtime::concat(&base[ins->b], ins->c, ins); }
+static void jit_neg(Value* base, const Instruction* ins) { base[ins->a] = Runtime::neg(base[ins->b], ins); }
+static void jit_not(Value* base, const Instruction* ins) { base[ins->a] = Value::from_bool(!is_truthy(base[ins->b])); }
+static void jit_test(Value* base, const Instruction* ins) { base[ins->a] = Value::from_bool(is_truthy(base[ins->b])); }
+static void jit_toint(Value* base, const Instruction* ins) { base[ins->a] = Runtime::toint(base[ins->a]); }
+static void jit_newarr(Value* base, const Instruction* ins) { base[ins->a] = Runtime::newarr(&base[ins->b], ins->c); }
+static void jit_newrange(Value* base, const Instruction* ins) { base[ins->a] = Runtime::newrange(&base[ins->b], ins); }
+static void jit_getindex(Value* base, const Instruction* ins) { base[ins->a] = Runtime::getindex(base[ins->b], base[ins->c], ins); }
+static void jit_setindex(Value* base, const Instruction* ins) { Runtime::setindex(base[ins->a], base[ins->b], base[ins->c], ins); }
+static void jit_callbuiltin(Value* base, const Instruction* ins) { base[ins->a] = builtins[ins->b].fn(&base[ins->a], ins->c); }
+static bool jit_truthy(Value* base, const Instruction* ins) { return is_truthy(base[ins->a]); }
+static bool jit_iternext(Value* base, const Instruction* ins) { return Runtime::iternext(&base[ins->a], ins); }
+static bool jit_forprep(Value* base, const Instruction* ins) { return Runtime::forprep(&base[ins->a], ins); }
+static void jit_vecloop(Value* base, const Instruction* ins) { Runtime::vecloop(base, ins); }
+
+static bool jit_compare(Value* base, const Instruction* ins)
+{
+	Value a = base[ins->b], b = base[ins->c];
+	bool result;
+	if (ins->op == opcode::EQ) result = values_equal(a, b);
+	else if (ins->op == opcode::NEQ) result = !values_equal(a, b);
+	else result = Runtime::compare(ins->op, a, b, ins);
+	base[ins->a] = Value::from_bool(result);
+	return result;
+}
+
+static void jit_stack_overflow(const Instruction* ins, const Function* callee)
+{
+	Runtime::error(ins, "Stack overflow, calling %s", callee->name.c_str());
+}
+
+static void jit_clear(Value* registers, int64_t count)
+{
+	for (int64_t i = 0; i < count; i++)
+		registers[i] = Value::null();
+}
+
+static void jit_tier_up(Jit* jit, int function)
+{
+	jit->tier_up(function);
+}
+
+static void jit_newobj(Value* base, const Instruction* ins) { base[ins->a] = Value::from_obj(InstanceObject::create(&Runtime::program->classes[ins->bx()])); }
+static void jit_setfield(Value* base, const Instruction* ins) { base[ins->a].as_instance()->set(ins->b, base[ins->c]); }
+static void jit_getmember(Value* base, const Instruction* ins, InlineCache* cache) { base[ins->a] = Runtime::getmember(base[ins->b], cache, ins); }
+static void jit_setmember(Value* base, const Instruction* ins, InlineCache* cache) { base[ins->b] = Runtime::setmember(base[ins->a], cache, base[ins->b], ins); }
+static void* const* jit_method(Jit* jit, Value* base, const Instruction* ins, InlineCache* cache) { return jit->method(base, ins, cache); }
+
+static Jit* running = nullptr;
+
+static Value run_function(int function, const Value* args, int argc, const Instruction* ins)
+{
+	return running->call(function, args, argc, ins);
+}
+
+Jit::Jit(Lexer* lexer, const Program& program, bool peephole_pass) : lexer(lexer), program(program), code_bytes(0), cold_bytes(0), tier_ups(0),
+	peephole_pass(peephole_pass), peephole_rewrites(0)
+{
+	Runtime::lexer = lexer;
+	Runtime::program = &program;
+	Runtime::runner = run_function;
+	running = this;
+	this->globals.assign(program.globals.size(), Value::null());
+	Runtime::counts.assign(program.probes.size(), 0);
+	this->stack = (Value*)malloc(VM_STACK_SIZE * sizeof(Value));
+	if (!this->stack) { fprintf(stderr, "Couldn't allocate the interpreter's stack\n"); exit(-1); }
+	this->context = JitContext{this->stack + VM_STACK_SIZE, 0, this->stack};
+	GC::set_roots(this->stack, &this->context.top, &this->globals);
+
+	this->entries.assign(program.functions.size(), nullptr);
+	this->calls.assign(program.functions.size(), 0);
+	this->tiers.assign(program.functions.size(), JIT_BASELINE);
+	for (auto& function : program.functions)
+		this->caches.push_back(Runtime::caches(function));
+
+	// The baseline tier is cheap enough to compile everything up front. The code of a function only depends on
+	// its own bytecode, calls go through entries, so big programs have threads take the functions one by one,
+	// and the code is installed all together after
+	size_t count = program.functions.size();
+	vector<Code> code(count);
+	size_t workers = count >= JIT_PARALLEL_MIN_FUNCTIONS ? std::min<size_t>(std::thread::hardware_concurrency(), JIT_MAX_THREADS) : 1;
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for (size_t i = next++; i < count; i = next++)
+			code[i] = generate(i, JIT_BASELINE);
+	};
+	vector<std::thread> threads;
+	for (size_t i = 1; i < workers; i++)
+		threads.emplace_back(work);
+	work();
+	for (auto& thread : threads)
+		thread.join();
+	lay_out(code);
+}
+
+Jit::~Jit()
+{
+	GC::set_roots(nullptr, nullptr, nullptr);
+	for (auto& region : this->regions)
+		munmap(region.first, region.second);
+	free(this->stack);
+}
+
+Value Jit::run()
+{
+	((JitFunction)this->entries[this->program.init])(&this->context, this->stack);
+
+	if (this->program.main < 0)
+		lexer->error((size_t)0, "There is no main function to run");
+
+	for (size_t i = 0; i < this->program.functions[this->program.main].args.size(); i++)
+		this->stack[i] = Value::null();
+	this->context.top = this->stack;
+	((JitFunction)this->entries[this->program.main])(&this->context, this->stack);
+	return this->stack[0];
+}
+
+void Jit::tier_up(int function)
+{
+	TRACE_SCOPE("jit_tier_up", this->program.functions[function].name);
+
+	this->entries[function] = compile(function, JIT_OPTIMIZED);
+	this->tiers[function] = JIT_OPTIMIZED;
+	this->tier_ups++;
+}
+
+Value Jit::call(int function, const Value* args, int argc, const Instruction* ins)
+{
+	const Function& callee = this->program.functions[function];
+	Value* base = this->context.top;
+	if (this->context.depth >= VM_MAX_FRAMES || base + callee.registers > this->context.stack_end)
+		Runtime::error(ins, "Stack overflow, calling %s", callee.name.c_str());
+
+	for (int i = 0; i < argc; i++)
+		base[i] = args[i];
+	((JitFunction)this->entries[function])(&this->context, base);
+	return base[0];
+}
+
+void* const* Jit::method(Value* base, const Instruction* ins, InlineCache* cache)
+{
+	int function = Runtime::method(base[ins->a], cache, ins->c, ins);
+	const Function& callee = this->program.functions[function];
+	// The same limits as CALL
+	if (this->context.depth > VM_MAX_FRAMES || base + ins->a + callee.registers > this->context.stack_end)
+		jit_stack_overflow(ins, &callee);
+
+	for (size_t i = ins->c; i < callee.args.size(); i++)
+		base[ins->a + i] = callee.defaults[i];
+	return &this->entries[function];
+}
+
+// Pages to copy code into, they're never writable and executable at the same time
+static void* allocate(size_t size)
+{
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) { fprintf(stderr, "Couldn't allocate memory for the JIT\n"); exit(-1); }
+	return memory;
+}
+static void protect(void* memory, size_t size)
+{
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) { fprintf(stderr, "Couldn't make the JIT's code executable\n"); exit(-1); }
+}
+static size_t pages(size_t size)
+{
+	size_t page = 4096;
+	return (size + page - 1) / page * page;
+}
+
+// A function that tiers up gets its own pages, with its cold part right after the hot one
+void* Jit::install(const Code& code)
+{
+	size_t size = pages(code.bytes.size());
+	void* memory = allocate(size);
+	memcpy(memory, code.bytes.data(), code.bytes.size());
+	protect(memory, size);
+
+	this->regions.push_back({memory, size});
+	this->code_bytes += code.bytes.size();
+	this->cold_bytes += code.bytes.size() - code.hot;
+	return memory;
+}
+
+// Which functions call which how much, a call in a loop counts JIT_LOOP_WEIGHT times more for every loop it's
+// in. The loops are the jumps back
+static map<pair<int, int>, uint64_t> call_graph(const Program& program)
+{
+	map<pair<int, int>, uint64_t> edges;
+	for (size_t f = 0; f < program.functions.size(); f++)
+	{
+		const vector<Instruction>& code = program.functions[f].code;
+		vector<pair<size_t, size_t>> loops;
+		for (size_t i = 0; i < code.size(); i++)
+			if ((code[i].op == opcode::JMP || code[i].op == opcode::JMPIF || code[i].op == opcode::JMPIFNOT || code[i].op == opcode::ITERNEXT
+				|| code[i].op == opcode::FORLOOP || code[i].op == opcode::FORDEC) && code[i].bx() <= i)
+				loops.push_back({code[i].bx(), i});
+
+		for (size_t i = 0; i < code.size(); i++)
+		{
+			if (code[i].op != opcode::CALL && code[i].op != opcode::TAILCALL)
+				continue;
+			uint64_t weight = 1;
+			for (auto& loop : loops)
+				if (loop.first <= i && i <= loop.second && weight < UINT32_MAX)
+					weight *= JIT_LOOP_WEIGHT;
+			int callee = code[i].b;
+			if (callee != (int)f)
+				edges[{std::min<int>(f, callee), std::max<int>(f, callee)}] += weight;
+		}
+	}
+	return edges;
+}
+
+// Pettis and Hansen's ordering: every function starts as a chain of its own, and from the heaviest edge down
+// the chains of its two ends are joined, the caller's first. Main's chain goes first and init's after it, they
+// start everything
+static vector<int> affinity_order(const Program& program)
+{
+	size_t count = program.functions.size();
+	vector<vector<int>> chains(count);
+	vector<int> chain_of(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		chains[i] = {(int)i};
+		chain_of[i] = i;
+	}
+
+	auto graph = call_graph(program);
+	vector<pair<uint64_t, pair<int, int>>> edges;
+	for (auto& edge : graph)
+		edges.push_back({edge.second, edge.first});
+	std::sort(edges.begin(), edges.end(), [](auto& x, auto& y) { return x.first != y.first ? x.first > y.first : x.second < y.second; });
+	for (auto& edge : edges)
+	{
+		int from = chain_of[edge.second.first], to = chain_of[edge.second.second];
+		if (from == to)
+			continue;
+		for (int f : chains[to])
+			chain_of[f] = from;
+		chains[from].insert(chains[from].end(), chains[to].begin(), chains[to].end());
+		chains[to].clear();
+	}
+
+	vector<int> order;
+	auto take = [&](int f) {
+		if (f < 0)
+			return;
+		vector<int>& chain = chains[chain_of[f]];
+		order.insert(order.end(), chain.begin(), chain.end());
+		chain.clear();
+	};
+	take(program.main);
+	take(program.init);
+	for (size_t i = 0; i < count; i++)
+		take(i);
+	return order;
+}
+
+void Jit::lay_out(const vector<Code>& code)
+{
+	vector<int> order = affinity_order(this->program);
+	vector<size_t> hot_at(code.size()), cold_at(code.size());
+	size_t size = 0;
+	for (int f : order)
+	{
+		size = (size + JIT_ALIGN - 1) / JIT_ALIGN * JIT_ALIGN;
+		hot_at[f] = size;
+		size += code[f].hot;
+	}
+	for (int f : order)
+	{
+		cold_at[f] = size;
+		size += code[f].bytes.size() - code[f].hot;
+	}
+
+	size_t mapped = pages(size);
+	uint8_t* memory = (uint8_t*)allocate(mapped);
+	memset(memory, 0xcc, mapped); // int3 between the functions
+	for (int f : order)
+	{
+		const Code& c = code[f];
+		memcpy(memory + hot_at[f], c.bytes.data(), c.hot);
+		memcpy(memory + cold_at[f], c.bytes.data() + c.hot, c.bytes.size() - c.hot);
+		// The cold part moved this far from right after the hot part, the jumps between them move the other way
+		int32_t moved = (int32_t)(cold_at[f] - (hot_at[f] + c.hot));
+		for (size_t at : c.crossing)
+		{
+			uint8_t* rel32 = at < c.hot ? memory + hot_at[f] + at : memory + cold_at[f] + (at - c.hot);
+			int32_t rel;
+			memcpy(&rel, rel32, 4);
+			rel += at < c.hot ? moved : -moved;
+			memcpy(rel32, &rel, 4);
+		}
+		this->entries[f] = memory + hot_at[f];
+		this->code_bytes += c.bytes.size();
+		this->cold_bytes += c.bytes.size() - c.hot;
+	}
+	protect(memory, mapped);
+	this->regions.push_back({memory, mapped});
+}
+
+static constexpr int8_t UNKNOWN = -1;
+static constexpr int8_t NUM = static_cast<int8_t>(ValueType::NUM);
+static constexpr int8_t BOOL = static_cast<int8_t>(ValueType::BOOL);
+static constexpr int8_t NUL = static_cast<int8_t>(ValueType::NUL);
+
+// Where the fields of an object are, for the inlined indexing and inline caches. ArrObject and InstanceObject
+// aren't standard layout so offsetof can't tell, it's measured like offsetof does on memory of their size that
+// is never an object. No object is made for it, the collector would free one the JIT can't root
+template <typename T>
+static inline const T* layout()
+{
+	alignas(T) static const char memory[sizeof(T)] = {};
+	return reinterpret_cast<const T*>(memory);
+}
+#define ARR_OFFSET(field) (int32_t)((const char*)&layout<ArrObject>()->field - (const char*)layout<ArrObject>())
+#define INSTANCE_OFFSET(field) (int32_t)((const char*)&layout<InstanceObject>()->field - (const char*)layout<InstanceObject>())
+#define FIELD_OFFSET(slot) (int32_t)(sizeof(InstanceObject) + (slot) * sizeof(Value))
+
+// Register r, rbx is the frame
+static inline Mem V(int r) { return Mem{RBX, r * (int)sizeof(Value)}; }
+
+void* Jit::compile(int id, int tier)
+{
+	return install(generate(id, tier));
+}
+
+Code Jit::generate(int id, int tier)
+{
+	const Function& function = this->program.functions[id];
+	const Instruction* code = function.code.data();
+	bool optimize = tier == JIT_OPTIMIZED;
+
+	Assembler as;
+	vector<int> labels(function.code.size());
+	for (auto& label : labels)
+		label = as.new_label();
+	int epilogue = as.new_label();
+
+	// What we know about the type of every register, forgotten wherever control flow merges
+	vector<bool> targets(function.code.size() + 1, false);
+	for (auto& ins : function.code)
+		if (ins.op == opcode::JMP || ins.op == opcode::JMPIF || ins.op == opcode::JMPIFNOT || ins.op == opcode::ITERNEXT
+			|| ins.op == opcode::FORPREP || ins.op == opcode::FORLOOP || ins.op == opcode::FORDEC)
+			targets[ins.bx()] = true;
+	vector<int8_t> known(function.registers + 1, UNKNOWN);
+	// Except the variable and the step of the counted loops we're in, FORPREP checked they're numbers and
+	// nothing in the loop writes them
+	vector<int8_t> pinned(function.registers + 1, UNKNOWN);
+	vector<pair<size_t, int>> counted; // Where every loop we're in ends, and its registers
+	auto forget = [&](int from) { for (size_t r = from; r < known.size(); r++) known[r] = pinned[r]; };
+
+	// The rarely taken paths go after the function, so the common path falls straight through
+	vector<std::function<void()>> slow_paths;
+
+	// So do the branches the compiler says are cold, they're emitted after the epilogue. The hot instructions
+	// keep their order and fall through to each other, cold or not what falls through to a moved one jumps
+	vector<bool> cold(function.code.size(), false);
+	for (auto& range : function.cold)
+		for (size_t i = range.first; i < range.second; i++)
+			cold[i] = true;
+	vector<size_t> order;
+	for (size_t i = 0; i < function.code.size(); i++)
+		if (!cold[i])
+			order.push_back(i);
+	size_t hot = order.size();
+	for (size_t i = 0; i < function.code.size(); i++)
+		if (cold[i])
+			order.push_back(i);
+	size_t n = 0;
+	// What's emitted right after order[n], nothing falls through from the last hot instruction to the epilogue
+	auto following = [&]() { return n + 1 < order.size() && n + 1 != hot ? order[n + 1] : function.code.size(); };
+	bool turned = false;
+	// A conditional jump at i, taken when cc. When the instruction after it was moved and the target is what's
+	// emitted next, it jumps the other way so the hot path still falls through
+	auto branch = [&](Cond cc, size_t i, size_t target) {
+		turned = target == following() && target != i + 1;
+		if (turned)
+			as.jcc(negate(cc), labels[i + 1]);
+		else
+			as.jcc(cc, labels[target]);
+	};
+
+	// Calls helper(base, ins)
+	auto helper = [&](const void* fn, const Instruction* ins) {
+		as.mov(RDI, RBX);
+		as.mov(RSI, (int64_t)(intptr_t)ins);
+		as.call(fn);
+	};
+	// Calls helper(base, ins, cache) for a site
+	const vector<InlineCache>& caches = this->caches[id];
+	auto cached = [&](const void* fn, const Instruction* ins, int site) {
+		as.mov(RDX, (int64_t)(intptr_t)&caches[site]);
+		helper(fn, ins);
+	};
+	// The classes the site has seen so far, what it's seen in the calls before the tier up is what it'll
+	// most likely see from now on too
+	auto seen = [&](int site) {
+		int ways = 0;
+		while (ways < RUNTIME_CACHE_WAYS && caches[site].classes[ways])
+			ways++;
+		return ways;
+	};
+	// Leaves the instance in rax and its class in rdx, or jumps to the slow path if it isn't an instance
+	auto load_class = [&](int r, int slow) {
+		as.mov(RAX, V(r));
+		as.mov(RCX, (int64_t)VALUE_OBJ);
+		as.mov(RDX, RAX);
+		as.and_(RDX, RCX);
+		as.cmp(RDX, RCX);
+		as.jcc(Cond::NE, slow);
+		as.xor_(RAX, RCX);
+		as.cmp8(Mem{RAX, INSTANCE_OFFSET(type)}, static_cast<int8_t>(ObjType::INSTANCE));
+		as.jcc(Cond::NE, slow);
+		as.mov(RDX, Mem{RAX, INSTANCE_OFFSET(cls)});
+	};
+	// If an instance can give the operator something else than a number
+	auto overloaded = [&](opcode op) {
+		for (auto& cls : this->program.classes)
+			if (cls.operators[static_cast<uint8_t>(op)] >= 0)
+				return true;
+		return false;
+	};
+	// Jumps to the slow path when the register isn't a number, unless we already know it is
+	auto guard_num = [&](int r, int slow) {
+		if (known[r] == NUM)
+			return;
+		as.mov(RAX, V(r));
+		as.mov(RCX, (int64_t)VALUE_QNAN);
+		as.and_(RAX, RCX);
+		as.cmp(RAX, RCX);
+		as.jcc(Cond::E, slow);
+	};
+
+	// Prologue, the frame is in rbx and the context in r12, both are callee saved
+	as.push(RBX);
+	as.push(R12);
+	as.sub(RSP, 8); // Keep the stack aligned to 16 for the calls we make
+	as.mov(R12, RDI);
+	as.mov(RBX, RSI);
+
+	as.inc(Mem{R12, offsetof(JitContext, depth)});
+
+	// Null the registers past the arguments, they might have anything from older frames in them
+	int first = function.args.size();
+	if (function.registers - first > 32)
+	{
+		as.lea(RDI, V(first));
+		as.mov(RSI, (int64_t)(function.registers - first));
+		as.call((const void*)jit_clear);
+	}
+	else if (function.registers > first)
+	{
+		as.mov(RAX, (int64_t)VALUE_NULL);
+		for (int r = first; r < function.registers; r++)
+			as.mov(V(r), RAX);
+	}
+
+	// Move top past this frame's registers, the caller's is kept in the slot that aligns the stack
+	int below = as.new_label();
+	as.mov(RAX, Mem{R12, offsetof(JitContext, top)});
+	as.mov(Mem{RSP, 0}, RAX);
+	as.lea(RCX, V(function.registers));
+	as.cmp(RCX, RAX);
+	as.jcc(Cond::BE, below);
+	as.mov(Mem{R12, offsetof(JitContext, top)}, RCX);
+	as.bind(below);
+
+	if (!optimize)
+	{
+		int counted = as.new_label();
+		as.mov(RAX, (int64_t)(intptr_t)&this->calls[id]);
+		as.inc32(Mem{RAX, 0});
+		as.cmp32(Mem{RAX, 0}, JIT_TIER_UP_CALLS);
+		as.jcc(Cond::NE, counted);
+		as.mov(RDI, (int64_t)(intptr_t)this);
+		as.mov(RSI, (int64_t)id);
+		as.call((const void*)jit_tier_up);
+		as.bind(counted);
+	}
+
+	// The epilogue ends the hot part
+	auto leave = [&]() {
+		as.bind(epilogue);
+		as.dec(Mem{R12, offsetof(JitContext, depth)});
+		as.mov(RAX, Mem{RSP, 0});
+		as.mov(Mem{R12, offsetof(JitContext, top)}, RAX);
+		as.add_(RSP, 8);
+		as.pop(R12);
+		as.pop(RBX);
+		as.ret();
+		as.cold();
+	};
+
+	for (n = 0; n < order.size(); n++)
+	{
+		size_t i = order[n];
+		const Instruction* ins = &code[i];
+		int a = ins->a, b = ins->b, c = ins->c;
+
+		// Code that's jumped to from somewhere else knows nothing, a cold branch isn't in the loops either
+		bool moved = n == hot || (n > 0 && order[n - 1] + 1 != i);
+		if (n == hot)
+			leave();
+		if (moved && n >= hot)
+		{
+			counted.clear();
+			pinned.assign(pinned.size(), UNKNOWN);
+		}
+		while (!counted.empty() && counted.back().first <= i)
+		{
+			pinned[counted.back().second] = pinned[counted.back().second + 2] = UNKNOWN;
+			counted.pop_back();
+		}
+		if (targets[i] || moved)
+			forget(0);
+		as.bind(labels[i]);
+		turned = false;
+
+		switch (ins->op)
+		{
+		case opcode::MOVE:
+			as.mov(RAX, V(b));
+			as.mov(V(a), RAX);
+			known[a] = known[b];
+			break;
+		case opcode::LOADK:
+		{
+			Value k = function.constants[ins->bx()];
+			as.mov(RAX, (int64_t)k.bits);
+			as.mov(V(a), RAX);
+			known[a] = k.is_num() ? NUM : UNKNOWN;
+			break;
+		}
+		case opcode::LOADNULL:
+			as.mov(RAX, (int64_t)VALUE_NULL);
+			as.mov(V(a), RAX);
+			known[a] = NUL;
+			break;
+		case opcode::LOADTRUE: case opcode::LOADFALSE:
+			as.mov(RAX, (int64_t)(ins->op == opcode::LOADTRUE ? VALUE_TRUE : VALUE_FALSE));
+			as.mov(V(a), RAX);
+			known[a] = BOOL;
+			break;
+		case opcode::GETGLOBAL:
+			as.mov(RDX, (int64_t)(intptr_t)&this->globals[ins->bx()]);
+			as.mov(RAX, Mem{RDX, 0});
+			as.mov(V(a), RAX);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::SETGLOBAL:
+			as.mov(RDX, (int64_t)(intptr_t)&this->globals[ins->bx()]);
+			as.mov(RAX, V(a));
+			as.mov(Mem{RDX, 0}, RAX);
+			break;
+
+		case opcode::ADD: case opcode::SUB: case opcode::MUL: case opcode::DIV:
+		{
+			if (!optimize)
+			{
+				helper((const void*)jit_arith, ins);
+				known[a] = UNKNOWN;
+				break;
+			}
+
+			bool both_num = known[b] == NUM && known[c] == NUM;
+			int slow = as.new_label(), resume = as.new_label();
+			guard_num(b, slow);
+			guard_num(c, slow);
+			as.movsd(XMM0, V(b));
+			switch (ins->op)
+			{
+			case opcode::ADD: as.addsd(XMM0, V(c)); break;
+			case opcode::SUB: as.subsd(XMM0, V(c)); break;
+			case opcode::MUL: as.mulsd(XMM0, V(c)); break;
+			default: as.divsd(XMM0, V(c)); break;
+			}
+			as.movsd(V(a), XMM0);
+			as.bind(resume);
+			if (!both_num)
+				slow_paths.push_back([&, ins, slow, resume]() {
+					as.bind(slow);
+					helper((const void*)jit_arith, ins);
+					as.jmp(resume);
+				});
+
+			// Only + works on other types, the rest either give a number or stop the program, unless a class
+			// overloads them
+			known[a] = (ins->op != opcode::ADD && !overloaded(ins->op)) || both_num ? NUM : UNKNOWN;
+			break;
+		}
+		case opcode::MOD: case opcode::POW:
+			helper((const void*)jit_arith, ins);
+			known[a] = overloaded(ins->op) ? UNKNOWN : NUM;
+			break;
+		case opcode::CONCAT:
+			helper((const void*)jit_concat, ins);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::NEG:
+		{
+			if (!optimize)
+			{
+				helper((const void*)jit_neg, ins);
+				known[a] = NUM;
+				break;
+			}
+
+			int slow = as.new_label(), resume = as.new_label();
+			bool num = known[b] == NUM;
+			guard_num(b, slow);
+			as.mov(RAX, V(b));
+			as.mov(RCX, (int64_t)VALUE_SIGN);
+			as.xor_(RAX, RCX);
+			as.mov(V(a), RAX);
+			as.bind(resume);
+			if (!num)
+				slow_paths.push_back([&, ins, slow, resume]() {
+					as.bind(slow);
+					helper((const void*)jit_neg, ins);
+					as.jmp(resume);
+				});
+			known[a] = NUM;
+			break;
+		}
+		case opcode::NOT:
+			helper((const void*)jit_not, ins);
+			known[a] = BOOL;
+			break;
+		case opcode::TEST:
+			helper((const void*)jit_test, ins);
+			known[a] = BOOL;
+			break;
+		case opcode::TOINT:
+		{
+			if (!optimize)
+			{
+				helper((const void*)jit_toint, ins);
+				break;
+			}
+
+			// cvttsd2si can't do NaN, infinities, numbers that don't fit in 64 bits or -0, trunc() does those
+			int slow = as.new_label(), resume = as.new_label();
+			guard_num(a, slow);
+			as.movsd(XMM0, V(a));
+			as.cvttsd2si(RAX, XMM0);
+			as.cmp(RAX, 0);
+			as.jcc(Cond::E, slow);
+			as.mov(RCX, (int64_t)INT64_MIN);
+			as.cmp(RAX, RCX);
+			as.jcc(Cond::E, slow);
+			as.cvtsi2sd(XMM0, RAX);
+			as.movsd(V(a), XMM0);
+			as.bind(resume);
+			slow_paths.push_back([&, ins, slow, resume]() {
+				as.bind(slow);
+				helper((const void*)jit_toint, ins);
+				as.jmp(resume);
+			});
+			break;
+		}
+
+		case opcode::EQ: case opcode::NEQ: case opcode::LT: case opcode::LEQ: case opcode::GT: case opcode::GEQ:
+		{
+			// A comparison that only feeds the next jump branches on the flags directly
+			const Instruction* next = i + 1 < function.code.size() ? &code[i + 1] : nullptr;
+			bool fused = optimize && next && !targets[i + 1] && following() == i + 1 && next->a == a
+				&& (next->op == opcode::JMPIF || next->op == opcode::JMPIFNOT);
+
+			if (!optimize)
+			{
+				helper((const void*)jit_compare, ins);
+				known[a] = BOOL;
+				break;
+			}
+
+			int slow = as.new_label(), resume = as.new_label();
+			guard_num(b, slow);
+			guard_num(c, slow);
+			// ucomisd only has "above" conditions that are false for NaN, so < and <= swap the operands
+			bool swap = ins->op == opcode::LT || ins->op == opcode::LEQ;
+			as.movsd(XMM0, V(swap ? c : b));
+			as.ucomisd(XMM0, V(swap ? b : c));
+			switch (ins->op)
+			{
+			case opcode::EQ: as.setcc(Cond::E, RAX); as.setcc(Cond::NP, RCX); as.and8(RAX, RCX); break;
+			case opcode::NEQ: as.setcc(Cond::NE, RAX); as.setcc(Cond::P, RCX); as.or8(RAX, RCX); break;
+			case opcode::LT: case opcode::GT: as.setcc(Cond::A, RAX); break;
+			default: as.setcc(Cond::AE, RAX); break;
+			}
+			as.bind(resume);
+			// false and true only differ in the lowest bit
+			as.mov(RCX, (int64_t)VALUE_FALSE);
+			as.or8(RCX, RAX);
+			as.mov(V(a), RCX);
+			slow_paths.push_back([&, ins, slow, resume]() {
+				as.bind(slow);
+				helper((const void*)jit_compare, ins);
+				as.jmp(resume);
+			});
+			known[a] = BOOL;
+
+			if (fused)
+			{
+				as.test8(RAX, RAX);
+				i++;
+				n++;
+				as.bind(labels[i]);
+				branch(next->op == opcode::JMPIF ? Cond::NE : Cond::E, i, next->bx());
+			}
+			break;
+		}
+
+		case opcode::JMP:
+			if (ins->bx() != following())
+				as.jmp(labels[ins->bx()]);
+			break;
+		case opcode::JMPIF: case opcode::JMPIFNOT:
+		{
+			Cond jump = ins->op == opcode::JMPIF ? Cond::NE : Cond::E;
+			if (optimize && known[a] == BOOL)
+				as.cmp8(V(a), (int8_t)VALUE_FALSE);
+			else
+			{
+				helper((const void*)jit_truthy, ins);
+				as.test8(RAX, RAX);
+			}
+			branch(jump, i, ins->bx());
+			break;
+		}
+		case opcode::ITERNEXT:
+			helper((const void*)jit_iternext, ins);
+			as.test8(RAX, RAX);
+			as.jcc(Cond::NE, labels[ins->bx()]);
+			forget(a);
+			break;
+		case opcode::FORPREP:
+			helper((const void*)jit_forprep, ins);
+			as.test8(RAX, RAX);
+			as.jcc(Cond::E, labels[ins->bx()]);
+			counted.push_back({ins->bx(), a});
+			pinned[a] = pinned[a + 2] = NUM;
+			known[a] = known[a + 2] = NUM;
+			known[a + 1] = UNKNOWN;
+			break;
+		case opcode::FORLOOP:
+			as.movsd(XMM0, V(a));
+			as.addsd(XMM0, V(a + 2));
+			as.movsd(V(a), XMM0);
+			as.dec(V(a + 1));
+			as.jcc(Cond::NE, labels[ins->bx()]);
+			break;
+		case opcode::FORDEC:
+			as.dec(V(a + 1));
+			as.jcc(Cond::NE, labels[ins->bx()]);
+			break;
+		case opcode::VECLOOP:
+			// It writes the loop's variable and a reduction's, which can be any local
+			helper((const void*)jit_vecloop, ins);
+			forget(0);
+			break;
+
+		case opcode::NEWARR:
+			helper((const void*)jit_newarr, ins);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::NEWRANGE:
+			helper((const void*)jit_newrange, ins);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::GETINDEX: case opcode::GETINBOUNDS:
+		{
+			known[a] = UNKNOWN;
+			if (!optimize)
+			{
+				helper((const void*)jit_getindex, ins);
+				break;
+			}
+
+			// An arr of Values is a type check, a bounds check and a load, everything else goes to the helper
+			int slow = as.new_label(), resume = as.new_label();
+			guard_num(c, slow);
+			as.movsd(XMM0, V(c));
+			as.cvttsd2si(RDX, XMM0);
+			as.mov(RAX, V(b));
+			as.mov(RCX, (int64_t)VALUE_OBJ);
+			as.mov(R8, RAX);
+			as.and_(R8, RCX);
+			as.cmp(R8, RCX);
+			as.jcc(Cond::NE, slow);
+			as.xor_(RAX, RCX); // Leaves the pointer
+			as.cmp8(Mem{RAX, ARR_OFFSET(type)}, static_cast<int8_t>(ObjType::ARR));
+			as.jcc(Cond::NE, slow);
+			as.cmp8(Mem{RAX, ARR_OFFSET(kind)}, static_cast<int8_t>(ArrKind::BOOL));
+			as.jcc(Cond::E, slow);
+			if (ins->op == opcode::GETINDEX)
+			{
+				// Negative indexes and NaN are huge unsigned numbers
+				as.mov32(RCX, Mem{RAX, ARR_OFFSET(length)});
+				as.cmp(RDX, RCX);
+				as.jcc(Cond::AE, slow);
+			}
+			as.mov(RAX, Mem{RAX, ARR_OFFSET(values)});
+			as.shl(RDX, 3);
+			as.add_(RAX, RDX);
+			as.mov(RAX, Mem{RAX, 0});
+			as.mov(V(a), RAX);
+			as.bind(resume);
+			slow_paths.push_back([&, ins, slow, resume]() {
+				as.bind(slow);
+				helper((const void*)jit_getindex, ins);
+				as.jmp(resume);
+			});
+			break;
+		}
+		case opcode::SETINDEX:
+			helper((const void*)jit_setindex, ins);
+			break;
+
+		case opcode::NEWOBJ:
+			helper((const void*)jit_newobj, ins);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::GETFIELD:
+			// The compiler knows it's an instance, the field is a load at a fixed offset from it
+			as.mov(RAX, V(b));
+			as.mov(RCX, (int64_t)VALUE_OBJ);
+			as.xor_(RAX, RCX);
+			as.mov(RAX, Mem{RAX, (int32_t)(sizeof(InstanceObject) + c * sizeof(Value))});
+			as.mov(V(a), RAX);
+			known[a] = UNKNOWN;
+			break;
+		case opcode::SETFIELD:
+			// Numbers never need the write barrier
+			if (known[c] != NUM)
+			{
+				helper((const void*)jit_setfield, ins);
+				break;
+			}
+			as.mov(RAX, V(a));
+			as.mov(RCX, (int64_t)VALUE_OBJ);
+			as.xor_(RAX, RCX);
+			as.mov(RCX, V(c));
+			as.mov(Mem{RAX, (int32_t)(sizeof(InstanceObject) + b * sizeof(Value))}, RCX);
+			break;
+		case opcode::GETMEMBER: case opcode::SETMEMBER:
+		{
+			bool get = ins->op == opcode::GETMEMBER;
+			const void* fn = get ? (const void*)jit_getmember : (const void*)jit_setmember;
+			known[get ? a : b] = UNKNOWN;
+			// Numbers never need the write barrier, like SETFIELD
+			int ways = seen(c);
+			if (!optimize || ways == 0 || (!get && known[b] != NUM))
+			{
+				cached(fn, ins, c);
+				break;
+			}
+
+			// A compare for every class the site has seen, each one with the slot it has in that class
+			int slow = as.new_label(), resume = as.new_label();
+			load_class(get ? b : a, slow);
+			for (int way = 0; way < ways; way++)
+			{
+				int next = way + 1 < ways ? as.new_label() : slow;
+				as.mov(RCX, (int64_t)(intptr_t)caches[c].classes[way]);
+				as.cmp(RDX, RCX);
+				as.jcc(Cond::NE, next);
+				if (get)
+				{
+					as.mov(RCX, Mem{RAX, FIELD_OFFSET(caches[c].targets[way])});
+					as.mov(V(a), RCX);
+				}
+				else
+				{
+					as.mov(RCX, V(b));
+					as.mov(Mem{RAX, FIELD_OFFSET(caches[c].targets[way])}, RCX);
+				}
+				as.jmp(resume);
+				if (next != slow)
+					as.bind(next);
+			}
+			as.bind(resume);
+			slow_paths.push_back([&, ins, fn, slow, resume]() {
+				as.bind(slow);
+				cached(fn, ins, ins->c);
+				as.jmp(resume);
+			});
+			break;
+		}
+
+		case opcode::CALL:
+		{
+			const Function* callee = &this->program.functions[b];
+			int overflow = as.new_label();
+			// The same limits as the interpreter, depth counts this frame too
+			as.mov(RAX, Mem{R12, offsetof(JitContext, depth)});
+			as.cmp(RAX, VM_MAX_FRAMES);
+			as.jcc(Cond::G, overflow);
+			as.lea(RSI, V(a));
+			as.lea(RAX, Mem{RSI, callee->registers * (int)sizeof(Value)});
+			as.mov(RCX, Mem{R12, offsetof(JitContext, stack_end)});
+			as.cmp(RAX, RCX);
+			as.jcc(Cond::A, overflow);
+			as.mov(RDI, R12);
+			as.mov(RAX, (int64_t)(intptr_t)&this->entries[b]);
+			as.call(Mem{RAX, 0});
+			slow_paths.push_back([&, ins, callee, overflow]() {
+				as.bind(overflow);
+				as.mov(RDI, (int64_t)(intptr_t)ins);
+				as.mov(RSI, (int64_t)(intptr_t)callee);
+				as.call((const void*)jit_stack_overflow);
+			});
+			forget(a);
+			break;
+		}
+		case opcode::TAILCALL:
+		{
+			// The arguments go to the start of the frame, then this frame is taken down like the epilogue
+			// does and the callee is jumped to, so it returns straight to our caller
+			const Function* callee = &this->program.functions[b];
+			int overflow = as.new_label();
+			as.lea(RAX, V(callee->registers));
+			as.mov(RCX, Mem{R12, offsetof(JitContext, stack_end)});
+			as.cmp(RAX, RCX);
+			as.jcc(Cond::A, overflow);
+			for (int arg = 0; arg < c; arg++)
+			{
+				as.mov(RAX, V(a + arg));
+				as.mov(V(arg), RAX);
+			}
+			as.mov(RDI, R12);
+			as.mov(RSI, RBX);
+			as.dec(Mem{R12, offsetof(JitContext, depth)});
+			as.mov(RAX, Mem{RSP, 0});
+			as.mov(Mem{R12, offsetof(JitContext, top)}, RAX);
+			as.add_(RSP, 8);
+			as.pop(R12);
+			as.pop(RBX);
+			as.mov(RAX, (int64_t)(intptr_t)&this->entries[b]);
+			as.jmp(Mem{RAX, 0});
+			slow_paths.push_back([&, ins, callee, overflow]() {
+				as.bind(overflow);
+				as.mov(RDI, (int64_t)(intptr_t)ins);
+				as.mov(RSI, (int64_t)(intptr_t)callee);
+				as.call((const void*)jit_stack_overflow);
+			});
+			break;
+		}
+		case opcode::INVOKE:
+		{
+			// The classes the site has seen call their method like CALL does, with the defaults as constants
+			int ways = optimize ? seen(b) : 0;
+			int slow = as.new_label(), done = as.new_label();
+			if (ways > 0)
+				load_class(a, slow);
+			for (int way = 0; way < ways; way++)
+			{
+				const Function* callee = &this->program.functions[caches[b].targets[way]];
+				int next = way + 1 < ways ? as.new_label() : slow, overflow = as.new_label();
+				as.mov(RCX, (int64_t)(intptr_t)caches[b].classes[way]);
+				as.cmp(RDX, RCX);
+				as.jcc(Cond::NE, next);
+				as.mov(RAX, Mem{R12, offsetof(JitContext, depth)});
+				as.cmp(RAX, VM_MAX_FRAMES);
+				as.jcc(Cond::G, overflow);
+				as.lea(RSI, V(a));
+				as.lea(RAX, Mem{RSI, callee->registers * (int)sizeof(Value)});
+				as.mov(RCX, Mem{R12, offsetof(JitContext, stack_end)});
+				as.cmp(RAX, RCX);
+				as.jcc(Cond::A, overflow);
+				for (size_t arg = c; arg < callee->args.size(); arg++)
+				{
+					as.mov(RAX, (int64_t)callee->defaults[arg].bits);
+					as.mov(V(a + arg), RAX);
+				}
+				as.mov(RDI, R12);
+				as.mov(RAX, (int64_t)(intptr_t)&this->entries[caches[b].targets[way]]);
+				as.call(Mem{RAX, 0});
+				as.jmp(done);
+				slow_paths.push_back([&, ins, callee, overflow]() {
+					as.bind(overflow);
+					as.mov(RDI, (int64_t)(intptr_t)ins);
+					as.mov(RSI, (int64_t)(intptr_t)callee);
+					as.call((const void*)jit_stack_overflow);
+				});
+				if (next != slow)
+					as.bind(next);
+			}
+
+			// Anything else, the helper looks it up and checks the frame fits
+			as.bind(slow);
+			as.mov(RDI, (int64_t)(intptr_t)this);
+			as.mov(RSI, RBX);
+			as.mov(RDX, (int64_t)(intptr_t)ins);
+			as.mov(RCX, (int64_t)(intptr_t)&caches[b]);
+			as.call((const void*)jit_method);
+			as.mov(RDI, R12);
+			as.lea(RSI, V(a));
+			as.call(Mem{RAX, 0});
+			as.bind(done);
+			forget(a);
+			break;
+		}
+		case opcode::CALLBUILTIN:
+			helper((const void*)jit_callbuiltin, ins);
+			forget(a);
+			break;
+		case opcode::RET:
+			if (a != 0)
+			{
+				as.mov(RAX, V(a));
+				as.mov(V(0), RAX);
+			}
+			as.jmp(epilogue);
+			break;
+		case opcode::RETNULL:
+			as.mov(RAX, (int64_t)VALUE_NULL);
+			as.mov(V(0), RAX);
+			as.jmp(epilogue);
+			break;
+
+		case opcode::PROBE:
+			// Every tier counts in the same place, a function that tiers up keeps counting
+			as.mov(RAX, (int64_t)(intptr_t)&Runtime::counts[ins->bx()]);
+			as.inc(Mem{RAX, 0});
+			break;
+		default:
+			lexer->error(function.position, ERROR_WE_DONT_KNOW);
+		}
+
+		opcode op = code[i].op;
+		if (!turned && following() != i + 1 && i + 1 < function.code.size()
+			&& op != opcode::JMP && op != opcode::RET && op != opcode::RETNULL && op != opcode::TAILCALL)
+			as.jmp(labels[i + 1]);
+	}
+	if (hot == order.size())
+		leave();
+
+	for (auto& slow : slow_paths)
+		slow();
+
+	if (this->peephole_pass)
+		this->peephole_rewrites += peephole(as);
+	return as.encode();
+}
+
+#else
+
+// There is no JIT on this platform, main runs the interpreter instead
+Jit::Jit(Lexer* lexer, const Program& program, bool peephole_pass) : lexer(lexer), program(program), stack(nullptr), context{nullptr, 0}, code_bytes(0),
+	cold_bytes(0), tier_ups(0), peephole_pass(peephole_pass), peephole_rewrites(0) {}
+Jit::~Jit() {}
+Value Jit::run() { return Value::null(); }
+void Jit::tier_up(int function) {}
+void* Jit::compile(int function, int tier) { return nullptr; }
+X64::Code Jit::generate(int function, int tier) { return {}; }
+void* Jit::install(const X64::Code& code) { return nullptr; }
+void Jit::lay_out(const vector<X64::Code>& code) {}
+
+#endif // DIG_HAS_JIT
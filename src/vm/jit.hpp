@@ -0,0 +1,90 @@
+#ifndef VM_JIT_HPP
+#define VM_JIT_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "bytecode.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+#include "vm.hpp"
+#include "x64.hpp"
+#include "../lexer/lexer.hpp"
+#include "../macros.hpp"
+
+using std::vector;
+using std::pair;
+
+// The JIT writes x86-64 straight into executable memory, so it only exists where we know the ABI
+#if defined(__x86_64__) && defined(__linux__)
+#define DIG_HAS_JIT 1
+#endif
+
+// Every function starts in the baseline tier, which calls a helper for most instructions,
+// and is recompiled by the optimizing tier after this many calls
+#define JIT_TIER_UP_CALLS 1000
+#define JIT_BASELINE 0
+#define JIT_OPTIMIZED 1
+// Programs with at least this many functions have their baseline code generated by more than one thread
+#define JIT_PARALLEL_MIN_FUNCTIONS 64
+#define JIT_MAX_THREADS 16
+// The baseline code goes in one region, the hot parts of the functions ordered so callers are next to what they
+// call the most and the cold parts after all of them. A call in a loop weighs this much more for every loop
+#define JIT_LOOP_WEIGHT 8
+#define JIT_ALIGN 16 // Where every function's hot part starts
+
+// What compiled code gets in rdi, it stays in r12 for the whole function
+struct JitContext
+{
+	Value* stack_end;
+	int64_t depth;
+	Value* top; // Like the interpreter's, every frame moves it past its registers and puts it back when it returns
+};
+
+class Jit
+{
+private:
+	Lexer* lexer;
+	const Program& program;
+	vector<Value> globals;
+	Value* stack;
+	JitContext context;
+
+	vector<void*> entries; // The current code of every function, calls go through here so tiering up only has to swap it
+	vector<uint32_t> calls;
+	vector<int> tiers;
+	vector<vector<InlineCache>> caches; // By function, one for each of its sites, the optimizing tier inlines what they've seen
+	vector<pair<void*, size_t>> regions;
+	size_t code_bytes;
+	size_t cold_bytes;
+	size_t tier_ups;
+	bool peephole_pass; // Off with -fno-peephole
+	std::atomic<size_t> peephole_rewrites;
+public:
+	Jit(Lexer* lexer, const Program& program, bool peephole_pass = true);
+	~Jit();
+
+	// Runs the top level statements and then main, returns what main returned
+	Value run();
+	void tier_up(int function);
+	// Runs a function in a new frame past the running ones, for the runtime's calls like operators of classes
+	Value call(int function, const Value* args, int argc, const Instruction* ins);
+	// Finds the method an INVOKE in the frame calls and gives it its defaults, returns where its code is
+	void* const* method(Value* base, const Instruction* ins, InlineCache* cache);
+
+	inline size_t get_code_bytes() const { return this->code_bytes; }
+	inline size_t get_cold_bytes() const { return this->cold_bytes; }
+	inline size_t get_tier_ups() const { return this->tier_ups; }
+	inline size_t get_peephole_rewrites() const { return this->peephole_rewrites; }
+private:
+	void* compile(int function, int tier);
+	// The machine code of the function, it can run in many threads at once, it only reads the program
+	X64::Code generate(int function, int tier);
+	void* install(const X64::Code& code);
+	// Installs the baseline code of every function, see JIT_LOOP_WEIGHT
+	void lay_out(const vector<X64::Code>& code);
+};
+
+#endif // VM_JIT_HPP
@@ -0,0 +1,130 @@
+#include "output.hpp"
+#include "runtime.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+namespace Output
+{
+static thread_local char buffer[OUTPUT_BUFFER_SIZE];
+static thread_local size_t used = 0;
+static int terminal = -1; // If stdout is a terminal, -1 until the first line
+
+void flush()
+{
+	size_t written = 0;
+	while (written < used)
+	{
+		ssize_t n = ::write(STDOUT_FILENO, buffer + written, used - written);
+		if (n <= 0) break; // Nowhere to write it, like a closed pipe, it's dropped
+		written += n;
+	}
+	used = 0;
+}
+
+// Makes room for length characters, flushing what's there if they don't fit
+static inline char* reserve(size_t length)
+{
+	static bool registered = false;
+	if (!registered) { atexit(flush); registered = true; }
+
+	if (used + length > OUTPUT_BUFFER_SIZE)
+		flush();
+	return buffer + used;
+}
+
+void write(const char* chars, size_t length)
+{
+	if (length > OUTPUT_BUFFER_SIZE)
+	{
+		// Bigger than the buffer, it goes out on its own
+		flush();
+		size_t written = 0;
+		while (written < length)
+		{
+			ssize_t n = ::write(STDOUT_FILENO, chars + written, length - written);
+			if (n <= 0) break;
+			written += n;
+		}
+		return;
+	}
+	memcpy(reserve(length), chars, length);
+	used += length;
+}
+
+void put(char c)
+{
+	*reserve(1) = c;
+	used++;
+}
+
+// An arr that holds itself somewhere inside prints as [...] there instead of forever, open has the
+// arrs being printed around this one
+static void arr(ArrObject* a, std::vector<ArrObject*>& open)
+{
+	if (std::find(open.begin(), open.end(), a) != open.end())
+	{
+		write("[...]", 5);
+		return;
+	}
+	open.push_back(a);
+	put('[');
+	for (uint32_t i = 0; i < a->length; i++)
+	{
+		Value element = a->get(i);
+		if (i) write(", ", 2);
+		if (element.is_arr()) arr(element.as_arr(), open);
+		else if (element.is_str())
+		{
+			put('"');
+			value(element);
+			put('"');
+		}
+		else value(element);
+	}
+	put(']');
+	open.pop_back();
+}
+
+void value(Value v)
+{
+	if (v.is_num())
+	{
+		used += format_num(v.as_num(), reserve(VALUE_NUM_CHARS));
+		return;
+	}
+	if (v.is_str())
+	{
+		write(v.as_str()->chars(), v.as_str()->length);
+		return;
+	}
+	if (v.is_instance())
+	{
+		string text = Runtime::tostr(v);
+		write(text.data(), text.size());
+		return;
+	}
+	if (!v.is_arr())
+	{
+		if (v.is_null()) write("null", 4);
+		else if (v.as_bool()) write("true", 4);
+		else write("false", 5);
+		return;
+	}
+
+	std::vector<ArrObject*> open;
+	arr(v.as_arr(), open);
+}
+
+void line()
+{
+	put('\n');
+	if (terminal < 0)
+		terminal = isatty(STDOUT_FILENO);
+	if (terminal)
+		flush();
+}
+}
@@ -0,0 +1,23 @@
+#ifndef VM_OUTPUT_HPP
+#define VM_OUTPUT_HPP
+
+#include <stddef.h>
+#include "value.hpp"
+
+#define OUTPUT_BUFFER_SIZE (64 << 10)
+
+// What the program prints goes through a buffer of each thread that's written to stdout with a single
+// write() when it fills up, or at every new line when stdout is a terminal so it still shows up as it's
+// printed. Values are formatted straight into it, printing never builds a std::string or calls printf
+namespace Output
+{
+	void write(const char* chars, size_t length);
+	void put(char c);
+	void value(Value v); // How print shows it, strs inside arrs are quoted
+	void line(); // Ends a line, and flushes it for a terminal
+
+	// Writes everything that's buffered, before the process exits or something else writes to stdout
+	void flush();
+}
+
+#endif // VM_OUTPUT_HPP
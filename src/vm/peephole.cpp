@@ -0,0 +1,461 @@
+#include "peephole.hpp"
+
+namespace X64
+{
+// What every instruction does with r1, r2 and the flags, by MOp. Only r1 is ever written
+enum : uint8_t { NONE = 0, READ = 1, WRITE = 2, BOTH = 3, XMM = 4 };
+enum : uint8_t { KEEPS, READS, WRITES, SOME }; // SOME writes some of the flags and leaves the others
+struct Effect
+{
+	uint8_t r1, r2, flags;
+};
+
+static const Effect effects[] = {
+	{NONE, NONE, KEEPS},			// LABEL
+	{WRITE, READ, KEEPS},			// MOV_RR
+	{WRITE, READ, KEEPS},			// MOV_RM
+	{READ, READ, KEEPS},			// MOV_MR
+	{WRITE, READ, KEEPS},			// MOV32_RM
+	{WRITE, NONE, KEEPS},			// MOV_RI
+	{READ, NONE, KEEPS},			// MOV_MI
+	{READ, NONE, KEEPS},			// MOV8_MI
+	{READ, READ, KEEPS},			// MOV8_MR
+	{WRITE, READ, KEEPS},			// LEA
+	{BOTH, READ, WRITES},			// ADD_RR
+	{BOTH, NONE, WRITES},			// ADD_RI
+	{BOTH, NONE, WRITES},			// SUB_RI
+	{BOTH, READ, WRITES},			// AND_RR
+	{BOTH, READ, WRITES},			// XOR_RR
+	{BOTH, NONE, WRITES},			// SHL_RI, unless it shifts by 0
+	{READ, READ, WRITES},			// CMP_RR
+	{READ, NONE, WRITES},			// CMP_RI
+	{READ, NONE, WRITES},			// CMP8_MI
+	{READ, NONE, WRITES},			// CMP32_MI
+	{READ, NONE, SOME},				// INC32_M, inc and dec leave the carry
+	{READ, NONE, SOME},				// INC_M
+	{READ, NONE, SOME},				// DEC_M
+	{BOTH, READ, WRITES},			// AND8_RR
+	{BOTH, READ, WRITES},			// OR8_RR
+	{READ, READ, WRITES},			// TEST8_RR
+	{BOTH, NONE, READS},			// SETCC, only the low byte so the rest is still there
+	{WRITE | XMM, READ, KEEPS},		// MOVSD_XM
+	{READ, READ | XMM, KEEPS},		// MOVSD_MX
+	{WRITE | XMM, READ, KEEPS},		// MOVQ_XR
+	{BOTH | XMM, READ, KEEPS},		// ADDSD_XM
+	{BOTH | XMM, READ, KEEPS},		// SUBSD_XM
+	{BOTH | XMM, READ, KEEPS},		// MULSD_XM
+	{BOTH | XMM, READ, KEEPS},		// DIVSD_XM
+	{BOTH | XMM, READ | XMM, KEEPS},	// ADDSD_XX
+	{READ | XMM, READ, WRITES},		// UCOMISD_XM
+	{WRITE, READ | XMM, KEEPS},		// CVTTSD2SI
+	{BOTH | XMM, READ, KEEPS},		// CVTSI2SD, the upper half of the xmm register stays
+	{READ, NONE, KEEPS},			// PUSH
+	{WRITE, NONE, KEEPS},			// POP
+	{READ, NONE, WRITES},			// CALL_R, nothing expects the flags to survive a call
+	{READ, NONE, WRITES},			// CALL_M
+	{NONE, NONE, KEEPS},			// JMP
+	{READ, NONE, KEEPS},			// JMP_M
+	{NONE, NONE, READS},			// JCC
+	{NONE, NONE, KEEPS},			// RET
+	{NONE, NONE, KEEPS},			// NOP
+};
+static_assert(sizeof(effects) / sizeof(effects[0]) == static_cast<size_t>(MOp::NOP) + 1, "Every MOp needs its effect");
+
+static inline const Effect& effect(const MInst& ins) { return effects[static_cast<uint8_t>(ins.op)]; }
+
+static inline bool is_call(const MInst& ins) { return ins.op == MOp::CALL_R || ins.op == MOp::CALL_M; }
+
+// If the instruction writes the general purpose register, a call writes all the ones the callee doesn't save
+static bool writes(const MInst& ins, uint8_t reg)
+{
+	if (is_call(ins))
+		return reg != RBX && reg != RBP && reg != R12 && reg != R13 && reg != R14 && reg != R15;
+	if (reg == RSP && (ins.op == MOp::PUSH || ins.op == MOp::POP))
+		return true;
+	uint8_t r1 = effect(ins).r1;
+	return (r1 & WRITE) && !(r1 & XMM) && ins.r1 == reg;
+}
+
+// The memory the instruction writes is [r1 + disp], or it writes none
+static bool writes_memory(const MInst& ins)
+{
+	switch (ins.op)
+	{
+	case MOp::MOV_MR: case MOp::MOV_MI: case MOp::MOV8_MI: case MOp::MOV8_MR:
+	case MOp::INC32_M: case MOp::INC_M: case MOp::DEC_M: case MOp::MOVSD_MX:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Ends the straight-line code before an instruction, looking back
+static inline bool ends(const MInst& ins)
+{
+	return ins.op == MOp::LABEL || ins.op == MOp::JMP || ins.op == MOp::JMP_M || ins.op == MOp::RET;
+}
+
+size_t Peephole::next(size_t at) const
+{
+	for (size_t i = at + 1; i < this->code.size(); i++)
+	{
+		if (i == this->split)
+			break;
+		if (this->code[i].op != MOp::NOP)
+			return i;
+	}
+	return this->code.size();
+}
+
+size_t Peephole::target(int label) const
+{
+	size_t at = this->bound[label];
+	while (at < this->code.size() && (this->code[at].op == MOp::LABEL || this->code[at].op == MOp::NOP))
+		at = next(at);
+	return at;
+}
+
+bool Peephole::flags_dead(size_t at) const
+{
+	// A label doesn't read them, whatever jumps there is another path
+	for (size_t i = at; i < this->code.size(); i = next(i))
+	{
+		const MInst& ins = this->code[i];
+		if (ins.op == MOp::RET)
+			return true;
+		if (ins.op == MOp::JMP || ins.op == MOp::JMP_M)
+			return false;
+		if (ins.op == MOp::SHL_RI && ins.imm == 0)
+			continue;
+		switch (effect(ins).flags)
+		{
+		case READS: case SOME: return false;
+		case WRITES: return true;
+		default: break;
+		}
+	}
+	return false;
+}
+
+bool Peephole::constant(size_t at, uint8_t reg, int64_t& value) const
+{
+	for (size_t i = at, steps = 0; i-- > 0 && steps < PEEPHOLE_SCAN; )
+	{
+		if (at >= this->split && i < this->split)
+			return false;
+		const MInst& ins = this->code[i];
+		if (ins.op == MOp::NOP)
+			continue;
+		steps++;
+		if (ends(ins))
+			return false;
+		if (!writes(ins, reg))
+			continue;
+		if (ins.op == MOp::MOV_RI)
+			value = ins.imm;
+		else if (ins.op == MOp::XOR_RR && ins.r2 == reg)
+			value = 0;
+		else return false;
+		return true;
+	}
+	return false;
+}
+
+bool Peephole::stored(size_t at, Mem mem, int64_t& value) const
+{
+	for (size_t i = at, steps = 0; i-- > 0 && steps < PEEPHOLE_SCAN; )
+	{
+		if (at >= this->split && i < this->split)
+			return false;
+		const MInst& ins = this->code[i];
+		if (ins.op == MOp::NOP)
+			continue;
+		steps++;
+		// What a call writes could be anywhere
+		if (ends(ins) || is_call(ins) || writes(ins, mem.base))
+			return false;
+		if (!writes_memory(ins))
+			continue;
+
+		bool same = ins.r1 == mem.base && ins.disp == mem.disp;
+		if (same && ins.op == MOp::MOV_MR)
+			return constant(i, ins.r2, value);
+		if (same && ins.op == MOp::MOV_MI)
+		{
+			value = ins.imm;
+			return true;
+		}
+		// Another base could be the same memory, the same base at another displacement can't be if it's 8 away
+		if (ins.r1 != mem.base || (ins.disp > mem.disp - 8 && ins.disp < mem.disp + 8))
+			return false;
+	}
+	return false;
+}
+
+// If cmp a, b with operands that many bits wide leaves cc true
+static bool holds(Cond cc, int64_t a, int64_t b, int bits)
+{
+	uint64_t mask = bits == 64 ? ~0ull : (1ull << bits) - 1, sign = 1ull << (bits - 1);
+	uint64_t x = (uint64_t)a & mask, y = (uint64_t)b & mask, r = (x - y) & mask;
+	bool zf = r == 0, cf = x < y, sf = (r & sign) != 0, of = ((x ^ y) & (x ^ r) & sign) != 0;
+	bool pf = !__builtin_parity((unsigned)(r & 0xff));
+
+	bool result;
+	switch (static_cast<Cond>(static_cast<uint8_t>(cc) & ~1))
+	{
+	case Cond::O: result = of; break;
+	case Cond::B: result = cf; break;
+	case Cond::E: result = zf; break;
+	case Cond::BE: result = cf || zf; break;
+	case Cond::S: result = sf; break;
+	case Cond::P: result = pf; break;
+	case Cond::L: result = sf != of; break;
+	default: result = zf || sf != of; break; // LE
+	}
+	// The odd conditions are the opposite of the even ones before them
+	return (static_cast<uint8_t>(cc) & 1) ? !result : result;
+}
+
+// If the labels bound right after at, before any other instruction, are the label
+static bool falls_to(const Peephole& p, size_t at, int label)
+{
+	for (size_t i = p.next(at); i < p.code.size() && p.code[i].op == MOp::LABEL; i = p.next(i))
+		if (p.code[i].label == label)
+			return true;
+	return false;
+}
+
+static bool self_move(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	if (ins.op != MOp::MOV_RR || ins.r1 != ins.r2)
+		return false;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool add_zero(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	if ((ins.op != MOp::ADD_RI && ins.op != MOp::SUB_RI) || ins.imm != 0 || !p.flags_dead(p.next(at)))
+		return false;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool lea_zero(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	if (ins.op != MOp::LEA || ins.disp != 0)
+		return false;
+	ins.op = ins.r1 == ins.r2 ? MOp::NOP : MOp::MOV_RR;
+	return true;
+}
+
+static bool move_add(Peephole& p, size_t at)
+{
+	size_t add = p.next(at);
+	if (add == p.code.size())
+		return false;
+	MInst& mov = p.code[at];
+	MInst& ins = p.code[add];
+	if (mov.op != MOp::MOV_RR || ins.op != MOp::ADD_RI || ins.r1 != mov.r1 || !p.flags_dead(p.next(add)))
+		return false;
+	mov.op = MOp::LEA;
+	mov.disp = (int32_t)ins.imm;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool reload(Peephole& p, size_t at)
+{
+	size_t load = p.next(at);
+	if (load == p.code.size())
+		return false;
+	MInst& store = p.code[at];
+	MInst& ins = p.code[load];
+	if (store.op != MOp::MOV_MR || ins.op != MOp::MOV_RM || ins.r2 != store.r1 || ins.disp != store.disp)
+		return false;
+	if (ins.r1 == store.r2)
+		ins.op = MOp::NOP;
+	else
+	{
+		ins.op = MOp::MOV_RR;
+		ins.r2 = store.r2;
+		ins.disp = 0;
+	}
+	return true;
+}
+
+static bool store_back(Peephole& p, size_t at)
+{
+	size_t store = p.next(at);
+	if (store == p.code.size())
+		return false;
+	MInst& load = p.code[at];
+	MInst& ins = p.code[store];
+	if (load.op != MOp::MOV_RM || load.r1 == load.r2 || ins.op != MOp::MOV_MR
+		|| ins.r1 != load.r2 || ins.disp != load.disp || ins.r2 != load.r1)
+		return false;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool same_constant(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	int64_t value;
+	if (ins.op != MOp::MOV_RI || !p.constant(at, ins.r1, value) || value != ins.imm)
+		return false;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool push_pop(Peephole& p, size_t at)
+{
+	size_t pop = p.next(at);
+	if (pop == p.code.size())
+		return false;
+	MInst& push = p.code[at];
+	MInst& ins = p.code[pop];
+	if (push.op != MOp::PUSH || ins.op != MOp::POP)
+		return false;
+	if (push.r1 == ins.r1)
+		push.op = MOp::NOP;
+	else
+	{
+		push.op = MOp::MOV_RR;
+		push.r2 = push.r1;
+		push.r1 = ins.r1;
+	}
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool setcc_branch(Peephole& p, size_t at)
+{
+	const MInst& set = p.code[at];
+	if (set.op != MOp::SETCC)
+		return false;
+	// Whatever is between has to leave both the register and the flags alone
+	size_t test = p.next(at);
+	while (test < p.code.size() && p.code[test].op != MOp::TEST8_RR)
+	{
+		const MInst& ins = p.code[test];
+		if (ends(ins) || is_call(ins) || effect(ins).flags != KEEPS || writes(ins, set.r1))
+			return false;
+		test = p.next(test);
+	}
+	size_t jump = test < p.code.size() ? p.next(test) : test;
+	if (jump == p.code.size())
+		return false;
+	MInst& ins = p.code[jump];
+	if (p.code[test].r1 != set.r1 || p.code[test].r2 != set.r1 || ins.op != MOp::JCC || (ins.cc != Cond::E && ins.cc != Cond::NE)
+		|| !p.flags_dead(p.next(jump)) || !p.flags_dead(p.bound[ins.label]))
+		return false;
+	// test r, r sets ZF when the condition didn't hold
+	ins.cc = ins.cc == Cond::NE ? set.cc : negate(set.cc);
+	p.code[test].op = MOp::NOP;
+	return true;
+}
+
+static bool constant_branch(Peephole& p, size_t at)
+{
+	const MInst& cmp = p.code[at];
+	size_t jump = p.next(at);
+	if (jump == p.code.size() || p.code[jump].op != MOp::JCC)
+		return false;
+	MInst& ins = p.code[jump];
+
+	int64_t value;
+	int bits;
+	if (cmp.op == MOp::CMP_RI && p.constant(at, cmp.r1, value))
+		bits = 64;
+	else if ((cmp.op == MOp::CMP8_MI || cmp.op == MOp::CMP32_MI) && p.stored(at, Mem{(Reg)cmp.r1, cmp.disp}, value))
+		bits = cmp.op == MOp::CMP8_MI ? 8 : 32;
+	else return false;
+	if (!p.flags_dead(p.next(jump)) || !p.flags_dead(p.bound[ins.label]))
+		return false;
+
+	ins.op = holds(ins.cc, value, cmp.imm, bits) ? MOp::JMP : MOp::NOP;
+	p.code[at].op = MOp::NOP;
+	return true;
+}
+
+static bool jump_next(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	if ((ins.op != MOp::JMP && ins.op != MOp::JCC) || !falls_to(p, at, ins.label))
+		return false;
+	ins.op = MOp::NOP;
+	return true;
+}
+
+static bool branch_over(Peephole& p, size_t at)
+{
+	size_t jump = p.next(at);
+	if (jump == p.code.size())
+		return false;
+	MInst& ins = p.code[at];
+	MInst& jmp = p.code[jump];
+	if (ins.op != MOp::JCC || jmp.op != MOp::JMP || !falls_to(p, jump, ins.label))
+		return false;
+	ins.cc = negate(ins.cc);
+	ins.label = jmp.label;
+	jmp.op = MOp::NOP;
+	return true;
+}
+
+static bool jump_chain(Peephole& p, size_t at)
+{
+	MInst& ins = p.code[at];
+	if (ins.op != MOp::JMP && ins.op != MOp::JCC)
+		return false;
+	size_t target = p.target(ins.label);
+	if (target == p.code.size() || p.code[target].op != MOp::JMP || p.code[target].label == ins.label)
+		return false;
+	ins.label = p.code[target].label;
+	return true;
+}
+
+#define PEEPHOLE(name, pattern) { #name, pattern, name },
+const PeepholeRule peephole_rules[] = {
+#include "peephole.inc"
+};
+#undef PEEPHOLE
+const size_t peephole_rule_count = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+size_t peephole(Assembler& as)
+{
+	vector<MInst>& code = as.instructions();
+	Peephole p{code, as.cold_start(), {}};
+	size_t rewrites = 0;
+
+	for (int round = 0; round < PEEPHOLE_ROUNDS; round++)
+	{
+		// The labels nothing jumps to anymore are gone, they only get in the way
+		vector<bool> used(as.label_count(), false);
+		for (auto& ins : code)
+			if (ins.op == MOp::JMP || ins.op == MOp::JCC)
+				used[ins.label] = true;
+		p.bound.assign(as.label_count(), code.size());
+		for (size_t i = 0; i < code.size(); i++)
+		{
+			if (code[i].op != MOp::LABEL)
+				continue;
+			if (used[code[i].label])
+				p.bound[code[i].label] = i;
+			else
+				code[i].op = MOp::NOP;
+		}
+
+		size_t before = rewrites;
+		for (size_t i = 0; i < code.size(); i++)
+			for (size_t rule = 0; rule < peephole_rule_count && code[i].op != MOp::NOP; rule++)
+				rewrites += peephole_rules[rule].rewrite(p, i);
+		if (rewrites == before)
+			break;
+	}
+	return rewrites;
+}
+}
@@ -0,0 +1,56 @@
+#ifndef VM_PEEPHOLE_HPP
+#define VM_PEEPHOLE_HPP
+
+#include "x64.hpp"
+
+// A peephole pass over the machine instructions, after the JIT generates them and before they're encoded. The
+// JIT generates every bytecode instruction on its own, so where one ends and the next starts there are moves
+// that are already done, constants loaded twice, jumps to the next instruction and so on.
+//
+// The rules are in peephole.inc, each one a function that looks at the instructions from an index on and
+// rewrites them if they match. They can be run on their own from the table. What a rule removes becomes a NOP,
+// so indexes and where the cold part starts stay right. The pass runs them all everywhere until none of them
+// changes anything.
+//
+// The rules only look at straight-line code in one part. A label that something jumps to is where control flow
+// merges, so it ends what a rule looks at, and a label nothing jumps to is removed first. A rule that removes
+// or changes a write to the flags first checks that nothing reads them after it
+
+#define PEEPHOLE_ROUNDS 8 // At most this many times over the code, every time can open up more
+#define PEEPHOLE_SCAN 32 // How far back a rule looks for what's in a register or the memory
+
+namespace X64
+{
+// The code a rule looks at
+struct Peephole
+{
+	vector<MInst>& code;
+	size_t split; // Where the cold part starts, nothing falls through from one part to the other
+	vector<size_t> bound; // Where every label is bound
+
+	// The next instruction after at that isn't a NOP, code.size() if there's none in the same part
+	size_t next(size_t at) const;
+	// Where the first instruction at or after the label that isn't a label or a NOP is
+	size_t target(int label) const;
+	// If the instructions from at on write the flags before anything reads them
+	bool flags_dead(size_t at) const;
+	// What's in the register or the memory right before at, if straight-line code before it put a constant there
+	bool constant(size_t at, uint8_t reg, int64_t& value) const;
+	bool stored(size_t at, Mem mem, int64_t& value) const;
+};
+
+struct PeepholeRule
+{
+	const char* name;
+	const char* pattern;
+	bool (*rewrite)(Peephole& p, size_t at); // True if it changed something
+};
+
+extern const PeepholeRule peephole_rules[];
+extern const size_t peephole_rule_count;
+
+// Runs every rule until nothing changes, returns how many rewrites they made
+size_t peephole(Assembler& as);
+}
+
+#endif // VM_PEEPHOLE_HPP
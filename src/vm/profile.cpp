@@ -0,0 +1,102 @@
+#include "profile.hpp"
+#include "runtime.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PROFILE_HEADER "dig-profile"
+
+uint64_t Profile::hash(const string& source)
+{
+	// FNV-1a, it only has to be the same on every run
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (unsigned char c : source)
+		h = (h ^ c) * 0x100000001b3ull;
+	return h;
+}
+
+// The counts in the file by probe, false if it isn't a profile of the source
+static bool read(const string& path, uint64_t source, map<string, uint64_t>& counts)
+{
+	std::ifstream f(path);
+	string header;
+	uint64_t hash;
+	if (!(f >> header >> std::hex >> hash >> std::dec) || header != PROFILE_HEADER || hash != source)
+		return false;
+
+	uint64_t count;
+	string probe;
+	while (f >> count && std::getline(f >> std::ws, probe))
+		counts[probe] += count;
+	return true;
+}
+
+bool Profile::load(const string& path, uint64_t source)
+{
+	if (!std::ifstream(path).good())
+	{
+		fprintf(stderr, "Warning: there is no profile %s, compiling without it\n", path.c_str());
+		return false;
+	}
+	if (!read(path, source, this->counts))
+	{
+		fprintf(stderr, "Warning: %s isn't a profile of this source, compiling without it\n", path.c_str());
+		this->counts.clear();
+		return false;
+	}
+
+	for (auto& probe : this->counts)
+	{
+		uint64_t& hottest = this->hottest[probe.first.substr(0, probe.first.find(' '))];
+		if (probe.second > hottest)
+			hottest = probe.second;
+	}
+	return true;
+}
+
+// What write_at_exit has to write, the program is gone by the time it does
+static string out_path;
+static uint64_t out_source;
+static vector<string> out_probes;
+
+static void write()
+{
+	map<string, uint64_t> counts;
+	read(out_path, out_source, counts);
+	for (size_t i = 0; i < out_probes.size() && i < Runtime::counts.size(); i++)
+		counts[out_probes[i]] += Runtime::counts[i];
+
+	FILE* f = fopen(out_path.c_str(), "w");
+	if (!f)
+	{
+		fprintf(stderr, "Warning: can't write the profile %s\n", out_path.c_str());
+		return;
+	}
+	fprintf(f, PROFILE_HEADER " %llx\n", (unsigned long long)out_source);
+	for (auto& probe : counts)
+		fprintf(f, "%llu %s\n", (unsigned long long)probe.second, probe.first.c_str());
+	fclose(f);
+}
+
+void Profile::write_at_exit(const string& path, uint64_t source, const vector<string>& probes)
+{
+	out_path = path;
+	out_source = source;
+	out_probes = probes;
+	atexit(write);
+}
+
+uint64_t Profile::count(const string& probe) const
+{
+	auto found = this->counts.find(probe);
+	return found != this->counts.end() ? found->second : 0;
+}
+
+bool Profile::hot(const string& probe) const
+{
+	auto hottest = this->hottest.find(probe.substr(0, probe.find(' ')));
+	uint64_t count = this->count(probe);
+	return count > 0 && hottest != this->hottest.end() && count * PROFILE_HOT_RATIO >= hottest->second;
+}
@@ -0,0 +1,46 @@
+#ifndef VM_PROFILE_HPP
+#define VM_PROFILE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+using std::map;
+
+// -fprofile-generate compiles a PROBE at the entry of every function, before every if, at the start of its first
+// branch, before every loop and at the start of every iteration of it. When the program exits, how many times
+// each one ran is written to the profile. -fprofile-use reads it back so the compiler knows what's hot.
+//
+// A probe is named by what it counts: "fn <function>" the calls, "if <position>" how many times the if ran and
+// "then <position>" how many times it took the first branch, "loop <position>" how many times the loop started
+// and "iter <position>" its iterations. The position is the condition's for ifs, so elifs are told apart, and
+// the loop's for loops. A body that's inlined in many places counts in the same probes
+
+#define PROFILE_HOT_RATIO 100 // Something is hot if it ran at least 1/this as often as the hottest of its kind
+#define PROFILE_HOT_INLINE_FACTOR 4 // A hot function gets this much bigger a limit from the inliner
+#define PROFILE_UNROLL_MAX 8 // A hot counted loop that runs at most this many times is unrolled
+#define PROFILE_UNROLL_SIZE 256 // As long as all the copies of its body together are at most this big
+
+class Profile
+{
+private:
+	map<string, uint64_t> counts;
+	map<string, uint64_t> hottest; // By kind, the part of the name before the space
+public:
+	// Of the preprocessed source, a profile of any other source is ignored since its positions mean nothing
+	static uint64_t hash(const string& source);
+
+	// Reads the file, warns and returns false if it can't or it's a profile of another source
+	bool load(const string& path, uint64_t source);
+	// Writes the counts of the probes to the file when the program exits, even from a runtime error. A profile
+	// of the same source that's already there is added to, so it can be trained with more than one run
+	static void write_at_exit(const string& path, uint64_t source, const vector<string>& probes);
+
+	uint64_t count(const string& probe) const;
+	bool hot(const string& probe) const;
+};
+
+#endif // VM_PROFILE_HPP
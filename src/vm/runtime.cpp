@@ -0,0 +1,403 @@
+#include "runtime.hpp"
+#include "output.hpp"
+#include "vector.hpp"
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+void Runtime::error(const Instruction* ins, const char* format, ...)
+{
+	// Find the function the instruction is in to get its position
+	size_t position = 0;
+	for (auto& function : program->functions)
+		if (ins >= function.code.data() && ins < function.code.data() + function.code.size())
+			position = function.positions[ins - function.code.data()];
+
+	// What was printed before the error comes first
+	Output::flush();
+
+	va_list args;
+	va_start(args, format);
+	lexer->error(position, format, args);
+	va_end(args);
+}
+
+// The function the class of the left operand overloads the operator with, or -1
+static inline int overload(opcode op, Value a)
+{
+	return a.is_instance() ? a.as_instance()->cls->operators[static_cast<uint8_t>(op)] : -1;
+}
+
+Value Runtime::arith(opcode op, Value a, Value b, const Instruction* ins)
+{
+	if (int function = overload(op, a); function >= 0)
+	{
+		Value operands[] = { a, b };
+		return call(function, operands, 2, ins);
+	}
+
+	if (a.is_num() && b.is_num())
+	{
+		double x = a.as_num(), y = b.as_num();
+		switch (op)
+		{
+		case opcode::ADD: return Value::from_num(x + y);
+		case opcode::SUB: return Value::from_num(x - y);
+		case opcode::MUL: return Value::from_num(x * y);
+		case opcode::DIV: return Value::from_num(x / y);
+		case opcode::MOD: return Value::from_num(fmod(x, y));
+		case opcode::POW: return Value::from_num(pow(x, y));
+		default: break;
+		}
+	}
+	else if (op == opcode::ADD && (a.is_str() || b.is_str()))
+	{
+		Value operands[] = { a, b };
+		return concat(operands, 2, ins);
+	}
+	else if (op == opcode::ADD && a.is_arr() && b.is_arr())
+	{
+		ArrObject* arr = ArrObject::create(a.as_arr()->kind, (size_t)a.as_arr()->length + b.as_arr()->length);
+		arr->append(a.as_arr());
+		arr->append(b.as_arr());
+		return Value::from_obj(arr);
+	}
+
+	static const char* symbols[] = { "+", "-", "*", "/", "%", "^" };
+	error(ins, "Can't use %s on %s and %s", symbols[static_cast<uint8_t>(op) - static_cast<uint8_t>(opcode::ADD)], value_typename(a), value_typename(b));
+	return Value::null();
+}
+
+bool Runtime::compare(opcode op, Value a, Value b, const Instruction* ins)
+{
+	if (int function = overload(op, a); function >= 0)
+	{
+		Value operands[] = { a, b };
+		return is_truthy(call(function, operands, 2, ins));
+	}
+
+	int cmp = 0;
+	if (a.is_num() && b.is_num()) cmp = a.as_num() < b.as_num() ? -1 : a.as_num() > b.as_num() ? 1 : 0;
+	else if (a.is_str() && b.is_str()) cmp = a.as_str()->view().compare(b.as_str()->view());
+	else error(ins, "Can't compare %s and %s", value_typename(a), value_typename(b));
+
+	// NaN is never smaller, bigger or equal
+	if (a.is_num() && b.is_num() && (isnan(a.as_num()) || isnan(b.as_num())))
+		return false;
+
+	switch (op)
+	{
+	case opcode::LT: return cmp < 0;
+	case opcode::LEQ: return cmp <= 0;
+	case opcode::GT: return cmp > 0;
+	default: return cmp >= 0;
+	}
+}
+
+Value Runtime::neg(Value v, const Instruction* ins)
+{
+	if (!v.is_num())
+		error(ins, "Can't negate %s", value_typename(v));
+	return Value::from_num(-v.as_num());
+}
+
+Value Runtime::toint(Value v)
+{
+	return v.is_num() ? Value::from_num(trunc(v.as_num())) : v;
+}
+
+bool Runtime::iternext(Value* r, const Instruction* ins)
+{
+	Value iterable = r[0];
+	double index = r[1].as_num();
+
+	if (iterable.is_num())
+	{
+		if (index >= iterable.as_num()) return false;
+		r[2] = Value::from_num(index);
+	}
+	else if (iterable.is_arr())
+	{
+		ArrObject* arr = iterable.as_arr();
+		if (index >= arr->length) return false;
+		r[2] = arr->get((size_t)index);
+	}
+	else if (iterable.is_str())
+	{
+		StrObject* str = iterable.as_str();
+		if (index >= str->length) return false;
+		r[2] = Value::from_obj(StrObject::character(str->chars()[(size_t)index]));
+	}
+	else error(ins, "Can't iterate over %s", value_typename(iterable));
+
+	r[1] = Value::from_num(index + 1);
+	return true;
+}
+
+// The loop runs while start + k * step hasn't passed end, start and step are integers so every step is exact
+bool Runtime::forprep(Value* r, const Instruction* ins)
+{
+	Value start = r[0], end = r[1], step = r[2];
+	if (!start.is_num() || !end.is_num())
+		error(ins, "A range needs numbers, got [%s:%s:%s]", value_typename(start), value_typename(end), value_typename(step));
+
+	double s = start.as_num(), e = end.as_num(), d = step.as_num();
+	double count = d > 0 ? (s < e ? ceil((e - s) / d) : 0) : (s > e ? ceil((s - e) / -d) : 0);
+	// More iterations than that never finish anyway
+	r[1].bits = count < (double)(1ull << 62) ? (uint64_t)count : 1ull << 62;
+	return r[1].bits != 0;
+}
+
+void Runtime::vecloop(Value* base, const Instruction* ins)
+{
+	Value* r = &base[ins->a];
+	if (Vector::run(program->kernels[ins->bx()], base, r))
+		r[0] = r[1];
+}
+
+Value Runtime::concat(Value* r, int count, const Instruction* ins)
+{
+	// + groups to the right, so add from the end until one side is a str and no instance that overloads +
+	// is left, from there on every + makes a longer str and all that's left is to know the pieces. What's
+	// added up so far goes back in the registers, so a collection while adding more can't free it
+	int overloaded = count;
+	for (int j = count - 1; j >= 0; j--)
+		if (overload(opcode::ADD, r[j]) >= 0)
+			overloaded = j;
+
+	int i = count - 1;
+	Value right = r[i];
+	while (i > 0 && (i > overloaded || (!right.is_str() && !r[i - 1].is_str())))
+	{
+		i--;
+		right = r[i] = arith(opcode::ADD, r[i], right, ins);
+	}
+	if (i == 0)
+		return right;
+
+	// Numbers and arrs are turned into text first, strs are copied straight from where they are
+	vector<string> texts;
+	vector<std::string_view> pieces;
+	texts.reserve(i + 1);
+	for (int j = 0; j <= i; j++)
+	{
+		Value v = j == i ? right : r[j];
+		if (v.is_str())
+			pieces.push_back(v.as_str()->view());
+		else
+		{
+			texts.push_back(tostr(v));
+			pieces.push_back(texts.back());
+		}
+	}
+
+	size_t length = 0;
+	for (auto& piece : pieces)
+		length += piece.size();
+
+	StrObject* str = StrObject::allocate(length);
+	char* out = str->chars();
+	for (auto& piece : pieces)
+	{
+		memcpy(out, piece.data(), piece.size());
+		out += piece.size();
+	}
+	return Value::from_obj(str);
+}
+
+Value Runtime::newarr(const Value* r, int count)
+{
+	return Value::from_obj(ArrObject::create(r, count));
+}
+
+Value Runtime::newrange(const Value* r, const Instruction* ins)
+{
+	Value start = r[0], end = r[1], step = r[2];
+	if (!start.is_num() || !end.is_num() || !step.is_num())
+		error(ins, "A range needs numbers, got [%s:%s:%s]", value_typename(start), value_typename(end), value_typename(step));
+	if (step.as_num() == 0)
+		error(ins, "The step of a range can't be 0");
+
+	ArrObject* arr = ArrObject::create(ArrKind::NUM);
+	for (double i = start.as_num(); step.as_num() > 0 ? i < end.as_num() : i > end.as_num(); i += step.as_num())
+		arr->push(Value::from_num(i));
+	return Value::from_obj(arr);
+}
+
+Value Runtime::getindex(Value object, Value index, const Instruction* ins)
+{
+	if (!index.is_num())
+		error(ins, "Can't index with %s", value_typename(index));
+
+	// Indexes are truncated like the JIT's cvttsd2si does, the negated checks catch NaN
+	double i = trunc(index.as_num());
+	if (object.is_arr())
+	{
+		ArrObject* arr = object.as_arr();
+		if (!(i >= 0 && i < arr->length))
+			error(ins, "Index %g is out of range, the arr has %u elements", index.as_num(), arr->length);
+		return arr->get((size_t)i);
+	}
+	else if (object.is_str())
+	{
+		StrObject* str = object.as_str();
+		if (!(i >= 0 && i < str->length))
+			error(ins, "Index %g is out of range, the str has %u characters", index.as_num(), str->length);
+		return Value::from_obj(StrObject::character(str->chars()[(size_t)i]));
+	}
+
+	error(ins, "Can't index %s", value_typename(object));
+	return Value::null();
+}
+
+void Runtime::setindex(Value object, Value index, Value value, const Instruction* ins)
+{
+	if (!object.is_arr())
+		error(ins, object.is_str() ? "A str can't be changed, build a new one instead" : "Can't index %s", value_typename(object));
+	if (!index.is_num())
+		error(ins, "Can't index with %s", value_typename(index));
+
+	ArrObject* arr = object.as_arr();
+	double i = trunc(index.as_num());
+	if (!(i >= 0 && i < arr->length))
+		error(ins, "Index %g is out of range, the arr has %u elements, use push to add more", index.as_num(), arr->length);
+	arr->set((size_t)i, value);
+}
+
+vector<InlineCache> Runtime::caches(const Function& function)
+{
+	vector<InlineCache> caches(function.sites.size());
+	for (size_t i = 0; i < caches.size(); i++)
+		caches[i] = InlineCache{function.sites[i], {}, {}};
+	return caches;
+}
+
+// Once every way is taken the cache keeps what it has, the classes never change so none of it goes stale
+static void remember(InlineCache* cache, const Class* cls, int32_t target)
+{
+	for (int way = 0; way < RUNTIME_CACHE_WAYS; way++)
+	{
+		if (cache->classes[way] == nullptr)
+		{
+			cache->classes[way] = cls;
+			cache->targets[way] = target;
+			return;
+		}
+	}
+}
+
+Value Runtime::getmember(Value object, InlineCache* cache, const Instruction* ins)
+{
+	const string& name = program->members[cache->member];
+	if (!object.is_instance())
+		error(ins, "Can't read %s of %s", name.c_str(), value_typename(object));
+
+	InstanceObject* instance = object.as_instance();
+	int slot = cache->find(instance->cls);
+	if (slot >= 0)
+		return instance->fields()[slot];
+
+	slot = instance->cls->slots[cache->member];
+	if (slot < 0 && instance->cls->methods[cache->member] >= 0)
+		error(ins, "%s is a method of %s, it can only be called", name.c_str(), instance->cls->name.c_str());
+	if (slot < 0)
+		error(ins, "%s has no public field %s", instance->cls->name.c_str(), name.c_str());
+	remember(cache, instance->cls, slot);
+	return instance->fields()[slot];
+}
+
+Value Runtime::setmember(Value object, InlineCache* cache, Value value, const Instruction* ins)
+{
+	const string& name = program->members[cache->member];
+	if (!object.is_instance())
+		error(ins, "Can't set %s of %s", name.c_str(), value_typename(object));
+
+	InstanceObject* instance = object.as_instance();
+	int slot = cache->find(instance->cls);
+	if (slot < 0)
+	{
+		slot = instance->cls->slots[cache->member];
+		if (slot < 0)
+			error(ins, "%s has no public field %s", instance->cls->name.c_str(), name.c_str());
+		// What's stored in an int field is rounded first, so the caches only have the others
+		if (instance->cls->ints[slot])
+			value = toint(value);
+		else
+			remember(cache, instance->cls, slot);
+	}
+	instance->set(slot, value);
+	return value;
+}
+
+int Runtime::method(Value object, InlineCache* cache, int argc, const Instruction* ins)
+{
+	const string& name = program->members[cache->member];
+	if (!object.is_instance())
+		error(ins, "Can't call %s on %s", name.c_str(), value_typename(object));
+
+	const Class* cls = object.as_instance()->cls;
+	int function = cache->find(cls);
+	if (function >= 0)
+		return function;
+
+	function = cls->methods[cache->member];
+	if (function < 0)
+		error(ins, "%s has no public method %s", cls->name.c_str(), name.c_str());
+	// The instance is the first argument. Every call of the site has as many, so a hit needs no check
+	const Function& callee = program->functions[function];
+	if ((size_t)argc > callee.args.size())
+		error(ins, "Too many arguments for %s, it takes %zu but got %d", callee.name.c_str(), callee.args.size() - 1, argc - 1);
+	remember(cache, cls, function);
+	return function;
+}
+
+// Operators and __str__ can be called from inside each other without any frame of the program in between,
+// so the native stack is what runs out, the limit turns that into an error
+Value Runtime::call(int function, const Value* args, int argc, const Instruction* ins)
+{
+	static int nested = 0;
+	if (nested >= RUNTIME_MAX_NESTED_CALLS)
+		error(ins, "Stack overflow, calling %s", program->functions[function].name.c_str());
+
+	nested++;
+	Value result = runner(function, args, argc, ins);
+	nested--;
+	return result;
+}
+
+// The elements can be instances too. An arr that holds itself is [...] where it comes back around, open has
+// the arrs around this one
+static string arr_tostr(const ArrObject* arr, std::vector<const ArrObject*>& open)
+{
+	if (std::find(open.begin(), open.end(), arr) != open.end())
+		return "[...]";
+	open.push_back(arr);
+	string out = "[";
+	for (uint32_t i = 0; i < arr->length; i++)
+	{
+		Value element = arr->get(i);
+		if (i) out += ", ";
+		if (element.is_arr()) out += arr_tostr(element.as_arr(), open);
+		else out += element.is_str() ? "\"" + Runtime::tostr(element) + "\"" : Runtime::tostr(element);
+	}
+	open.pop_back();
+	return out + "]";
+}
+
+string Runtime::tostr(Value v)
+{
+	if (v.is_instance() && v.as_instance()->cls->str >= 0)
+	{
+		Value result = call(v.as_instance()->cls->str, &v, 1, nullptr);
+		// Nothing roots the result, so it's not given to another __str__
+		return value_tostr(result);
+	}
+	if (!v.is_arr())
+		return value_tostr(v);
+
+	std::vector<const ArrObject*> open;
+	return arr_tostr(v.as_arr(), open);
+}
@@ -0,0 +1,71 @@
+#ifndef VM_RUNTIME_HPP
+#define VM_RUNTIME_HPP
+
+#include "bytecode.hpp"
+#include "value.hpp"
+#include "../lexer/lexer.hpp"
+
+// How many calls the runtime itself makes, like to the operators of classes, can be inside each other
+#define RUNTIME_MAX_NESTED_CALLS (1 << 12)
+
+// How many classes an inline cache remembers, a site that sees more looks the others up every time
+#define RUNTIME_CACHE_WAYS 4
+
+// Every instance of a class has the same fields at the same slots, the class is its shape. A site that looks
+// up a member keeps what it found in the classes it has seen, so for those it's a compare of the class and a
+// load from the slot or a call of the method
+struct InlineCache
+{
+	int32_t member; // The selector
+	const Class* classes[RUNTIME_CACHE_WAYS]; // nullptr past the ones it has seen
+	int32_t targets[RUNTIME_CACHE_WAYS]; // In each of them, the slot of the field or the function of the method
+
+	// -1 if it hasn't seen the class
+	inline int32_t find(const Class* cls) const
+	{
+		for (int way = 0; way < RUNTIME_CACHE_WAYS; way++)
+			if (this->classes[way] == cls)
+				return this->targets[way];
+		return -1;
+	}
+};
+
+// The operations the interpreter and the JIT share, these handle every type
+// and the callers only do the cases with two numbers themselves
+namespace Runtime
+{
+	inline Lexer* lexer = nullptr; // Runtime errors are reported like compile errors
+	inline const Program* program = nullptr;
+	inline vector<uint64_t> counts; // How many times every PROBE ran, set up by the VM or the JIT
+	// Set by the VM or the JIT, runs a function in a new frame past the running ones and returns what it returned
+	inline Value (*runner)(int function, const Value* args, int argc, const Instruction* ins) = nullptr;
+
+	// Reports an error at the source of the instruction and exits
+	void error(const Instruction* ins, const char* format, ...);
+
+	Value arith(opcode op, Value a, Value b, const Instruction* ins); // ADD, SUB, MUL, DIV, MOD and POW
+	Value concat(Value* r, int count, const Instruction* ins); // r[0] + (r[1] + (... + r[count - 1])) in one allocation, r are temporaries
+	bool compare(opcode op, Value a, Value b, const Instruction* ins); // LT, LEQ, GT and GEQ
+	Value neg(Value v, const Instruction* ins);
+	Value toint(Value v);
+
+	bool iternext(Value* r, const Instruction* ins); // r is R[a], returns if there's another element
+	bool forprep(Value* r, const Instruction* ins); // r is R[a], returns if the loop runs at all
+	void vecloop(Value* base, const Instruction* ins); // Runs the loop's kernel if it can, base is R[0]
+	Value newarr(const Value* r, int count);
+	Value newrange(const Value* r, const Instruction* ins); // r is R[b]
+	Value getindex(Value object, Value index, const Instruction* ins);
+	void setindex(Value object, Value index, Value value, const Instruction* ins);
+
+	// An instance whose class the compiler couldn't tell, its members are looked up by selector when the cache of
+	// the site hasn't seen its class, and the cache remembers what was found
+	vector<InlineCache> caches(const Function& function); // Empty ones for the sites of the function
+	Value getmember(Value object, InlineCache* cache, const Instruction* ins);
+	Value setmember(Value object, InlineCache* cache, Value value, const Instruction* ins); // Returns what was stored
+	int method(Value object, InlineCache* cache, int argc, const Instruction* ins); // The function INVOKE calls
+
+	Value call(int function, const Value* args, int argc, const Instruction* ins);
+	string tostr(Value v); // What print shows, instances with a __str__ are what it returns
+}
+
+#endif // VM_RUNTIME_HPP
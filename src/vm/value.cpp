@@ -0,0 +1,264 @@
+#include "value.hpp"
+#include "gc.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <charconv>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+StrObject* StrObject::allocate(size_t length, bool permanent)
+{
+	if (length > UINT32_MAX) { fprintf(stderr, "A str can't be longer than %u characters\n", UINT32_MAX); exit(-1); }
+
+	void* memory = malloc(sizeof(StrObject) + length + 1);
+	if (!memory) { fprintf(stderr, "Out of memory\n"); exit(-1); }
+	StrObject* str = new (memory) StrObject(length);
+	str->chars()[length] = '\0';
+	GC::track(str, sizeof(StrObject) + length + 1, permanent);
+	return str;
+}
+
+StrObject* StrObject::create(const char* chars, size_t length, bool permanent)
+{
+	StrObject* str = allocate(length, permanent);
+	memcpy(str->chars(), chars, length);
+	return str;
+}
+
+StrObject* StrObject::character(char c)
+{
+	static StrObject* characters[256] = {};
+	StrObject*& str = characters[(uint8_t)c];
+	if (!str) str = create(&c, 1, true);
+	return str;
+}
+
+// FNV-1a
+uint32_t StrObject::hash() const
+{
+	if (this->cached_hash) return this->cached_hash;
+
+	uint32_t h = 2166136261u;
+	for (uint32_t i = 0; i < this->length; i++)
+		h = (h ^ (uint8_t)chars()[i]) * 16777619u;
+	return this->cached_hash = h ? h : 1;
+}
+
+bool StrObject::equals(const StrObject* other) const
+{
+	if (this == other) return true;
+	if (this->length != other->length) return false;
+	// Only compare the hashes if both are there already, computing them costs more than memcmp
+	if (this->cached_hash && other->cached_hash && this->cached_hash != other->cached_hash) return false;
+	return memcmp(chars(), other->chars(), this->length) == 0;
+}
+
+static ArrKind kind_of(Value v)
+{
+	return v.is_num() ? ArrKind::NUM : v.is_bool() ? ArrKind::BOOL : ArrKind::ANY;
+}
+
+ArrObject* ArrObject::create(ArrKind kind, size_t capacity)
+{
+	ArrObject* arr = new ArrObject(kind);
+	GC::track(arr, sizeof(ArrObject));
+	arr->reserve(capacity);
+	return arr;
+}
+
+ArrObject* ArrObject::create(const Value* values, size_t count)
+{
+	ArrKind kind = count ? kind_of(values[0]) : ArrKind::NUM;
+	for (size_t i = 1; i < count && kind != ArrKind::ANY; i++)
+		if (kind_of(values[i]) != kind)
+			kind = ArrKind::ANY;
+
+	ArrObject* arr = create(kind, count);
+	for (size_t i = 0; i < count; i++)
+		arr->push(values[i]);
+	return arr;
+}
+
+void ArrObject::reserve(size_t capacity)
+{
+	if (capacity <= this->capacity) return;
+	if (capacity > UINT32_MAX) { fprintf(stderr, "An arr can't have more than %u elements\n", UINT32_MAX); exit(-1); }
+
+	// Bits are allocated in whole words, so a BOOL arr's capacity is always a multiple of 64
+	size_t bytes = this->kind == ArrKind::BOOL ? (capacity + 63) / 64 * sizeof(uint64_t) : capacity * sizeof(Value);
+	size_t old_bytes = this->kind == ArrKind::BOOL ? this->capacity / 8 : this->capacity * sizeof(Value);
+	void* memory = realloc(this->values, bytes);
+	if (!memory && bytes) { fprintf(stderr, "Out of memory\n"); exit(-1); }
+	this->values = (Value*)memory;
+	this->capacity = this->kind == ArrKind::BOOL ? (capacity + 63) / 64 * 64 : capacity;
+	GC::grow(this, bytes - old_bytes);
+}
+
+void ArrObject::generalize()
+{
+	if (this->kind == ArrKind::ANY) return;
+
+	if (this->kind == ArrKind::BOOL)
+	{
+		Value* values = (Value*)malloc(this->capacity * sizeof(Value));
+		if (!values && this->capacity) { fprintf(stderr, "Out of memory\n"); exit(-1); }
+		for (uint32_t i = 0; i < this->length; i++)
+			values[i] = get(i);
+		free(this->bits);
+		this->values = values;
+		GC::grow(this, this->capacity * sizeof(Value) - this->capacity / 8);
+	}
+	this->kind = ArrKind::ANY;
+}
+
+void ArrObject::set(size_t i, Value v)
+{
+	if (!fits(v))
+		generalize();
+	GC::write(this, v);
+
+	if (this->kind != ArrKind::BOOL) this->values[i] = v;
+	else if (v.as_bool()) this->bits[i / 64] |= 1ull << (i % 64);
+	else this->bits[i / 64] &= ~(1ull << (i % 64));
+}
+
+void ArrObject::push(Value v)
+{
+	if (!fits(v))
+	{
+		// An empty arr hasn't really committed to a kind yet
+		if (this->length == 0)
+		{
+			free(this->values);
+			this->values = nullptr;
+			this->capacity = 0;
+			this->kind = kind_of(v);
+		}
+		else generalize();
+	}
+
+	if (this->length == this->capacity)
+		reserve(this->capacity < 8 ? 8 : (size_t)this->capacity * 2);
+	this->length++;
+	set(this->length - 1, v);
+}
+
+void ArrObject::append(const ArrObject* other)
+{
+	reserve((size_t)this->length + other->length);
+	for (uint32_t i = 0; i < other->length; i++)
+		push(other->get(i));
+}
+
+InstanceObject* InstanceObject::create(const Class* cls)
+{
+	size_t bytes = sizeof(InstanceObject) + cls->fields.size() * sizeof(Value);
+	void* memory = malloc(bytes);
+	if (!memory) { fprintf(stderr, "Out of memory\n"); exit(-1); }
+	InstanceObject* instance = new (memory) InstanceObject(cls);
+	for (size_t i = 0; i < cls->fields.size(); i++)
+		instance->fields()[i] = Value::null();
+	GC::track(instance, bytes);
+	return instance;
+}
+
+void InstanceObject::set(size_t slot, Value v)
+{
+	GC::write(this, v);
+	fields()[slot] = v;
+}
+
+bool is_truthy(Value v)
+{
+	switch (v.type())
+	{
+	case ValueType::NUL: return false;
+	case ValueType::BOOL: return v.as_bool();
+	case ValueType::NUM: return v.as_num() != 0;
+	case ValueType::OBJ:
+		if (v.is_str()) return v.as_str()->length != 0;
+		if (v.is_instance()) return true;
+		return v.as_arr()->length != 0;
+	}
+	return false;
+}
+
+bool values_equal(Value a, Value b)
+{
+	if (a.type() != b.type()) return false;
+
+	switch (a.type())
+	{
+	case ValueType::NUL: return true;
+	case ValueType::BOOL: return a.as_bool() == b.as_bool();
+	case ValueType::NUM: return a.as_num() == b.as_num();
+	case ValueType::OBJ:
+		if (a.is_str() && b.is_str()) return a.as_str()->equals(b.as_str());
+		return a.as_obj() == b.as_obj();
+	}
+	return false;
+}
+
+// An arr that holds itself somewhere inside is [...] there instead of going on forever, open has the
+// arrs being turned into a string around this one
+static string arr_tostr(const ArrObject* arr, std::vector<const ArrObject*>& open)
+{
+	if (std::find(open.begin(), open.end(), arr) != open.end())
+		return "[...]";
+	open.push_back(arr);
+	string s = "[";
+	for (uint32_t i = 0; i < arr->length; i++)
+	{
+		Value element = arr->get(i);
+		if (i) s += ", ";
+		if (element.is_arr()) s += arr_tostr(element.as_arr(), open);
+		else s += element.is_str() ? "\"" + value_tostr(element) + "\"" : value_tostr(element);
+	}
+	open.pop_back();
+	return s + "]";
+}
+
+string value_tostr(Value v)
+{
+	switch (v.type())
+	{
+	case ValueType::NUL: return "null";
+	case ValueType::BOOL: return v.as_bool() ? "true" : "false";
+	case ValueType::NUM:
+	{
+		char buf[VALUE_NUM_CHARS];
+		return string(buf, format_num(v.as_num(), buf));
+	}
+	case ValueType::OBJ:
+		if (v.is_str()) return string(v.as_str()->view());
+		if (v.is_instance()) return "<" + v.as_instance()->cls->name + ">";
+		{
+			std::vector<const ArrObject*> open;
+			return arr_tostr(v.as_arr(), open);
+		}
+	}
+	return "";
+}
+
+size_t format_num(double d, char* out)
+{
+	// Most numbers programs print are integers, they don't need the shortest digits search
+	if (d > -1e15 && d < 1e15 && d == (int64_t)d && (d != 0 || !signbit(d)))
+		return std::to_chars(out, out + VALUE_NUM_CHARS, (int64_t)d).ptr - out;
+	return std::to_chars(out, out + VALUE_NUM_CHARS, d).ptr - out;
+}
+
+const char* value_typename(Value v)
+{
+	switch (v.type())
+	{
+	case ValueType::NUL: return "null";
+	case ValueType::BOOL: return "bool";
+	case ValueType::NUM: return "num";
+	case ValueType::OBJ: return v.is_str() ? "str" : v.is_instance() ? v.as_instance()->cls->name.c_str() : "arr";
+	}
+	return "?";
+}
@@ -0,0 +1,191 @@
+#ifndef VM_VALUE_HPP
+#define VM_VALUE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+// Everything the interpreter works with is a Value, numbers, bools and null are stored
+// in it directly, strings, arrays and instances of classes live on the heap as Objects
+enum class ValueType : uint8_t
+{
+	NUL,
+	BOOL,
+	NUM,
+	OBJ,
+};
+
+enum class ObjType : uint8_t
+{
+	STR,
+	ARR,
+	INSTANCE,
+};
+
+// Which collections look at an object, see gc.hpp
+enum class Generation : uint8_t
+{
+	YOUNG,
+	OLD,
+	PERMANENT, // Never collected, for the program's literals
+};
+
+struct Object
+{
+	ObjType type;
+	Generation generation;
+	bool marked;
+	bool remembered; // If it's an old object in the remembered set
+	Object* next; // The next object of the same generation
+
+	Object(ObjType type) : type(type), generation(Generation::YOUNG), marked(false), remembered(false), next(nullptr) {}
+};
+
+// NaN-boxed, a Value is one 64 bit word. Doubles are stored as they are, and everything else hides
+// in the quiet NaNs no arithmetic produces: null and bools are small payloads in them, and objects
+// also set the sign bit and keep their 48 bit pointer in the low bits
+#define VALUE_QNAN		0x7ffc000000000000ull
+#define VALUE_SIGN		0x8000000000000000ull
+#define VALUE_NULL		(VALUE_QNAN | 1)
+#define VALUE_FALSE		(VALUE_QNAN | 2)
+#define VALUE_TRUE		(VALUE_QNAN | 3)
+#define VALUE_OBJ		(VALUE_SIGN | VALUE_QNAN)
+
+struct Value
+{
+	uint64_t bits;
+
+	static inline Value null() { return Value{VALUE_NULL}; }
+	static inline Value from_bool(bool b) { return Value{VALUE_FALSE | (uint64_t)b}; }
+	static inline Value from_num(double d) { Value v; memcpy(&v.bits, &d, sizeof(d)); return v; }
+	static inline Value from_obj(Object* o) { return Value{VALUE_OBJ | (uint64_t)(uintptr_t)o}; }
+
+	inline bool is_null() const { return bits == VALUE_NULL; }
+	inline bool is_bool() const { return (bits | 1) == VALUE_TRUE; }
+	inline bool is_num() const { return (bits & VALUE_QNAN) != VALUE_QNAN; }
+	inline bool is_obj() const { return (bits & VALUE_OBJ) == VALUE_OBJ; }
+	inline bool is_str() const { return is_obj() && as_obj()->type == ObjType::STR; }
+	inline bool is_arr() const { return is_obj() && as_obj()->type == ObjType::ARR; }
+	inline bool is_instance() const { return is_obj() && as_obj()->type == ObjType::INSTANCE; }
+
+	inline ValueType type() const
+	{
+		if (is_num()) return ValueType::NUM;
+		if (is_obj()) return ValueType::OBJ;
+		return is_null() ? ValueType::NUL : ValueType::BOOL;
+	}
+
+	inline bool as_bool() const { return bits == VALUE_TRUE; }
+	inline double as_num() const { double d; memcpy(&d, &bits, sizeof(d)); return d; }
+	inline Object* as_obj() const { return (Object*)(uintptr_t)(bits & ~VALUE_OBJ); }
+	inline struct StrObject* as_str() const { return (struct StrObject*)as_obj(); }
+	inline struct ArrObject* as_arr() const { return (struct ArrObject*)as_obj(); }
+	inline struct InstanceObject* as_instance() const { return (struct InstanceObject*)as_obj(); }
+};
+
+// Strings are immutable, and the characters follow the object in the same allocation, so
+// building one is a single malloc however long it is. The hash is computed the first time
+// something needs it and kept
+struct StrObject : public Object
+{
+	uint32_t length;
+	mutable uint32_t cached_hash; // 0 until it's computed
+
+	// The characters are uninitialized, fill them in through chars() before anyone sees the string
+	// Permanent strs are never collected, the program's literals are
+	static StrObject* allocate(size_t length, bool permanent = false);
+	static StrObject* create(const char* chars, size_t length, bool permanent = false);
+	static inline StrObject* create(const string& s, bool permanent = false) { return create(s.data(), s.size(), permanent); }
+	// The strings of one character are shared, indexing and iterating over a str never allocate
+	static StrObject* character(char c);
+
+	inline char* chars() { return (char*)(this + 1); }
+	inline const char* chars() const { return (const char*)(this + 1); }
+	inline std::string_view view() const { return std::string_view(chars(), length); }
+	uint32_t hash() const;
+	bool equals(const StrObject* other) const;
+private:
+	StrObject(uint32_t length) : Object(ObjType::STR), length(length), cached_hash(0) {}
+};
+
+enum class ArrKind : uint8_t
+{
+	NUM,	// Every element is a number
+	BOOL,	// Every element is a bool, one bit each
+	ANY,
+};
+
+// An arr keeps its elements as specialized as they allow, so reading an arr of numbers never has
+// to check what it got. It starts with the kind of its first elements and becomes an arr of any
+// Values the first time something else is stored in it. NUM and ANY both keep Values, a NaN-boxed
+// number already is its double
+struct ArrObject : public Object
+{
+	ArrKind kind;
+	uint32_t length;
+	uint32_t capacity;
+	union { Value* values; uint64_t* bits; };
+
+	static ArrObject* create(ArrKind kind, size_t capacity = 0);
+	static ArrObject* create(const Value* values, size_t count); // Picks the kind that fits all of them
+
+	inline Value get(size_t i) const
+	{
+		if (kind == ArrKind::BOOL) return Value::from_bool((bits[i / 64] >> (i % 64)) & 1);
+		return values[i];
+	}
+	void set(size_t i, Value v);
+	void push(Value v);
+	void append(const ArrObject* other);
+private:
+	ArrObject(ArrKind kind) : Object(ObjType::ARR), kind(kind), length(0), capacity(0), values(nullptr) {}
+
+	void reserve(size_t capacity);
+	void generalize(); // Turns it into an arr of any Values
+	inline bool fits(Value v) const { return kind == ArrKind::ANY || (kind == ArrKind::NUM ? v.is_num() : v.is_bool()); }
+};
+
+// What all the instances of a class share, the compiler makes one for every class of the program. Members
+// are looked up by selector, every member name in the program has one, so finding a member of an object
+// whose class the compiler doesn't know is indexing two tables
+struct Class
+{
+	string name;
+	vector<string> fields; // In the order they're laid out in the instances
+	vector<bool> ints; // The fields declared int, what's stored in them is rounded
+	vector<int32_t> slots; // By selector, the field with that name or -1
+	vector<int32_t> methods; // By selector, the function that implements the method or -1, the class's vtable
+	vector<int32_t> operators; // By opcode, the function that overloads it or -1
+	int32_t str; // __str__, or -1 if it has none
+};
+
+// An instance of a class, its fields follow the object in the same allocation in the order the class
+// lays them out, so a field the compiler knows the slot of is a load at a fixed offset from the object
+struct InstanceObject : public Object
+{
+	const Class* cls;
+
+	// The fields start as null
+	static InstanceObject* create(const Class* cls);
+
+	inline Value* fields() { return (Value*)(this + 1); }
+	inline const Value* fields() const { return (const Value*)(this + 1); }
+	void set(size_t slot, Value v);
+private:
+	InstanceObject(const Class* cls) : Object(ObjType::INSTANCE), cls(cls) {}
+};
+
+bool is_truthy(Value v);
+bool values_equal(Value a, Value b);
+string value_tostr(Value v);
+// Writes the shortest digits that read back as exactly d and returns how many, out needs VALUE_NUM_CHARS
+#define VALUE_NUM_CHARS 32
+size_t format_num(double d, char* out);
+const char* value_typename(Value v);
+
+#endif // VM_VALUE_HPP
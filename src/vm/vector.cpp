@@ -0,0 +1,286 @@
+#include "vector.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+#define KERNEL_INLINE __attribute__((always_inline)) inline
+#else
+#define KERNEL_INLINE inline
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+// The templates are only ever inlined, into the AVX2 function for 256 bit vectors, their ABI never matters
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// The arrs hold NaN-boxed Values, a number's bits are its double, reading them as doubles is fine
+typedef double element __attribute__((may_alias));
+typedef double v2d __attribute__((vector_size(16)));
+typedef int64_t v2i __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+typedef int64_t v4i __attribute__((vector_size(32)));
+
+// Whole numbers below 2^53 add up to the same sum in any order, that's when a reduction can be split
+// over the lanes. x + 1.5 * 2^52 - 1.5 * 2^52 is x only if x is whole
+#define KERNEL_EXACT 9007199254740992.0
+#define KERNEL_ROUND 6755399441055744.0
+
+// What a step pushed, either values for the whole block or one scalar for every element
+struct Operand
+{
+	const element* values; // nullptr for a scalar
+	double scalar;
+};
+
+template <typename V>
+static KERNEL_INLINE V load(const element* p) { V v; memcpy(&v, p, sizeof(V)); return v; }
+template <typename V>
+static KERNEL_INLINE void store(element* p, V v) { memcpy(p, &v, sizeof(V)); }
+template <typename V>
+static KERNEL_INLINE V broadcast(double d)
+{
+	V v{};
+	for (size_t lane = 0; lane < sizeof(V) / sizeof(double); lane++)
+		v[lane] = d;
+	return v;
+}
+
+// out[j] = f(a[j], b[j]) with whole vectors, and the rest one by one
+template <typename V, typename F>
+static KERNEL_INLINE void each(element* out, const Operand& a, const Operand& b, size_t n, F f)
+{
+	constexpr size_t lanes = sizeof(V) / sizeof(double);
+	V sa = broadcast<V>(a.scalar), sb = broadcast<V>(b.scalar);
+	size_t j = 0;
+	for (; j + lanes <= n; j += lanes)
+		store<V>(out + j, f(a.values ? load<V>(a.values + j) : sa, b.values ? load<V>(b.values + j) : sb));
+	for (; j < n; j++)
+		out[j] = f(a.values ? a.values[j] : a.scalar, b.values ? b.values[j] : b.scalar);
+}
+
+// The operations work on vectors and on doubles alike, and are inlined into the AVX2 code too
+struct Add { template <typename T> KERNEL_INLINE T operator()(T x, T y) const { return x + y; } };
+struct Sub { template <typename T> KERNEL_INLINE T operator()(T x, T y) const { return x - y; } };
+struct Mul { template <typename T> KERNEL_INLINE T operator()(T x, T y) const { return x * y; } };
+struct Div { template <typename T> KERNEL_INLINE T operator()(T x, T y) const { return x / y; } };
+struct Neg { template <typename T> KERNEL_INLINE T operator()(T x, T) const { return -x; } };
+
+template <typename V>
+static KERNEL_INLINE void binary(KernelOp op, element* out, const Operand& a, const Operand& b, size_t n)
+{
+	switch (op)
+	{
+	case KernelOp::ADD: each<V>(out, a, b, n, Add()); break;
+	case KernelOp::SUB: each<V>(out, a, b, n, Sub()); break;
+	case KernelOp::MUL: each<V>(out, a, b, n, Mul()); break;
+	case KernelOp::DIV: each<V>(out, a, b, n, Div()); break;
+	default: break;
+	}
+}
+
+static inline double scalar(KernelOp op, double x, double y)
+{
+	switch (op)
+	{
+	case KernelOp::ADD: return x + y;
+	case KernelOp::SUB: return x - y;
+	case KernelOp::MUL: return x * y;
+	case KernelOp::DIV: return x / y;
+	default: return x;
+	}
+}
+
+// Adds up the block into the lanes of total, and their magnitudes into the lanes of magnitude, returns
+// false if one of them isn't a whole number
+template <typename V, typename I>
+static KERNEL_INLINE bool sum(const element* x, size_t n, V& total, V& magnitude)
+{
+	constexpr size_t lanes = sizeof(V) / sizeof(double);
+	V round = broadcast<V>(KERNEL_ROUND);
+	I bits = (I)broadcast<V>(-0.0), fractions = (I)broadcast<V>(0.0);
+	size_t j = 0;
+	for (; j + lanes <= n; j += lanes)
+	{
+		V v = load<V>(x + j);
+		total += v;
+		magnitude += (V)((I)v & ~bits);
+		fractions |= ((v + round) - round) != v;
+	}
+	bool whole = true;
+	for (size_t lane = 0; lane < lanes; lane++)
+		whole &= fractions[lane] == 0;
+	for (; j < n; j++)
+	{
+		total[0] += x[j];
+		magnitude[0] += fabs(x[j]);
+		whole &= (x[j] + KERNEL_ROUND) - KERNEL_ROUND == x[j];
+	}
+	return whole;
+}
+
+// Computes the block of elements from first on, it's either in one of the temporaries or it's a scalar
+template <typename V>
+static KERNEL_INLINE Operand evaluate(const Kernel& kernel, const Value* base, size_t first, size_t n, double (*temps)[KERNEL_BLOCK])
+{
+	Operand stack[KERNEL_MAX_STEPS];
+	int top = 0;
+	for (auto& step : kernel.code)
+	{
+		switch (step.op)
+		{
+		case KernelOp::ARR:
+			stack[top++] = Operand{(const element*)base[step.reg].as_arr()->values + first, 0};
+			break;
+		case KernelOp::INDEX:
+			for (size_t j = 0; j < n; j++)
+				temps[top][j] = (double)(first + j);
+			stack[top] = Operand{temps[top], 0};
+			top++;
+			break;
+		case KernelOp::SCALAR:
+			stack[top++] = Operand{nullptr, base[step.reg].as_num()};
+			break;
+		case KernelOp::NEG:
+		{
+			Operand& x = stack[top - 1];
+			if (!x.values) x.scalar = -x.scalar;
+			else
+			{
+				// 0 - x isn't -x for 0, flip the sign bit like the interpreter does
+				Operand zero{nullptr, 0};
+				each<V>(temps[top - 1], x, zero, n, Neg());
+				x = Operand{temps[top - 1], 0};
+			}
+			break;
+		}
+		default:
+		{
+			Operand b = stack[--top];
+			Operand& a = stack[top - 1];
+			if (!a.values && !b.values)
+				a.scalar = scalar(step.op, a.scalar, b.scalar);
+			else
+			{
+				binary<V>(step.op, temps[top - 1], a, b, n);
+				a = Operand{temps[top - 1], 0};
+			}
+			break;
+		}
+		}
+	}
+	return stack[0];
+}
+
+template <typename V, typename I>
+static KERNEL_INLINE void execute(const Kernel& kernel, Value* base, size_t start, size_t count)
+{
+	double temps[KERNEL_MAX_STEPS][KERNEL_BLOCK];
+
+	if (!kernel.reduce)
+	{
+		element* out = (element*)base[kernel.target].as_arr()->values + start;
+		for (size_t done = 0; done < count; done += KERNEL_BLOCK)
+		{
+			size_t n = count - done < KERNEL_BLOCK ? count - done : KERNEL_BLOCK;
+			Operand result = evaluate<V>(kernel, base, start + done, n, temps);
+			if (result.values) memmove(out + done, result.values, n * sizeof(double));
+			else for (size_t j = 0; j < n; j++) out[done + j] = result.scalar;
+		}
+		return;
+	}
+
+	// Split over the lanes if that gets the very same sum, -0 is what adds nothing even to -0
+	double initial = base[kernel.target].as_num();
+	V total = broadcast<V>(-0.0), magnitude = broadcast<V>(0.0);
+	bool exact = initial + KERNEL_ROUND - KERNEL_ROUND == initial;
+	for (size_t done = 0; done < count && exact; done += KERNEL_BLOCK)
+	{
+		size_t n = count - done < KERNEL_BLOCK ? count - done : KERNEL_BLOCK;
+		Operand result = evaluate<V>(kernel, base, start + done, n, temps);
+		if (!result.values)
+		{
+			for (size_t j = 0; j < n; j++) temps[0][j] = result.scalar;
+			result.values = temps[0];
+		}
+		exact = sum<V, I>(result.values, n, total, magnitude);
+	}
+
+	double acc = initial, bound = fabs(initial);
+	for (size_t lane = 0; lane < sizeof(V) / sizeof(double); lane++)
+		bound += magnitude[lane];
+	if (exact && bound < KERNEL_EXACT)
+	{
+		for (size_t lane = 0; lane < sizeof(V) / sizeof(double); lane++)
+			acc += total[lane];
+		base[kernel.target] = Value::from_num(acc);
+		return;
+	}
+
+	// Otherwise in order, the values are still computed a block at a time
+	acc = initial;
+	for (size_t done = 0; done < count; done += KERNEL_BLOCK)
+	{
+		size_t n = count - done < KERNEL_BLOCK ? count - done : KERNEL_BLOCK;
+		Operand result = evaluate<V>(kernel, base, start + done, n, temps);
+		for (size_t j = 0; j < n; j++)
+		{
+			acc += result.values ? result.values[j] : result.scalar;
+			if (kernel.truncate) acc = trunc(acc);
+		}
+	}
+	base[kernel.target] = Value::from_num(acc);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2"))) static void execute_avx2(const Kernel& kernel, Value* base, size_t start, size_t count)
+{
+	execute<v4d, v4i>(kernel, base, start, count);
+}
+#endif
+
+static void execute_sse2(const Kernel& kernel, Value* base, size_t start, size_t count)
+{
+	execute<v2d, v2i>(kernel, base, start, count);
+}
+
+namespace Vector
+{
+static bool fits(Value v, size_t end)
+{
+	return v.is_arr() && v.as_arr()->kind == ArrKind::NUM && v.as_arr()->length >= end;
+}
+
+bool run(const Kernel& kernel, Value* base, const Value* r)
+{
+	if (!r[0].is_num() || !r[1].is_num())
+		return false;
+	double first = r[0].as_num(), end = r[1].as_num();
+	if (!(first >= 0 && first < KERNEL_EXACT && first == trunc(first) && end > first))
+		return false;
+	double last = ceil(end);
+	if (!(last <= UINT32_MAX))
+		return false;
+	size_t start = (size_t)first, count = (size_t)last - start;
+
+	// Everything it reads is checked before it writes anything, so the loop can still run as it is
+	for (auto& step : kernel.code)
+	{
+		if (step.op == KernelOp::ARR && !fits(base[step.reg], start + count)) return false;
+		if (step.op == KernelOp::SCALAR && !base[step.reg].is_num()) return false;
+	}
+	if (kernel.reduce ? !base[kernel.target].is_num() : !fits(base[kernel.target], start + count))
+		return false;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2)
+	{
+		execute_avx2(kernel, base, start, count);
+		return true;
+	}
+#endif
+	execute_sse2(kernel, base, start, count);
+	return true;
+}
+}
@@ -0,0 +1,19 @@
+#ifndef VM_VECTOR_HPP
+#define VM_VECTOR_HPP
+
+#include "bytecode.hpp"
+#include "value.hpp"
+
+#define KERNEL_BLOCK 256 // How many elements every step of a kernel works on at once
+
+// Runs the kernels of element-wise loops with SIMD instructions, AVX2 when the CPU has it and SSE2
+// otherwise, one block of elements at a time and the elements that don't fill a vector one by one
+namespace Vector
+{
+	// r is the loop's registers, R[a] the first index and R[a+1] the end, the step is 1. Returns false
+	// without changing anything if the loop has to run as it is: some arr isn't all numbers or is too
+	// short, or some scalar isn't a number
+	bool run(const Kernel& kernel, Value* base, const Value* r);
+}
+
+#endif // VM_VECTOR_HPP
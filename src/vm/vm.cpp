@@ -0,0 +1,372 @@
+#include "vm.hpp"
+#include "builtins.hpp"
+#include "gc.hpp"
+#include "runtime.hpp"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+static VM* running = nullptr;
+
+static Value run_function(int function, const Value* args, int argc, const Instruction* ins)
+{
+	return running->call(function, args, argc, ins);
+}
+
+VM::VM(Lexer* lexer, const Program& program) : lexer(lexer), program(program)
+{
+	Runtime::lexer = lexer;
+	Runtime::program = &program;
+	Runtime::runner = run_function;
+	running = this;
+	this->globals.assign(program.globals.size(), Value::null());
+	Runtime::counts.assign(program.probes.size(), 0);
+	// The pages are only touched when a frame gets there, so most of it is never really allocated
+	this->stack = (Value*)malloc(VM_STACK_SIZE * sizeof(Value));
+	if (!this->stack) { fprintf(stderr, "Couldn't allocate the interpreter's stack\n"); exit(-1); }
+	this->top = this->stack;
+	for (auto& function : program.functions)
+		this->caches.push_back(Runtime::caches(function));
+	GC::set_roots(this->stack, &this->top, &this->globals);
+}
+
+VM::~VM()
+{
+	GC::set_roots(nullptr, nullptr, nullptr);
+	free(this->stack);
+}
+
+Value VM::run()
+{
+	execute(&this->program.functions[this->program.init], this->stack);
+
+	if (this->program.main < 0)
+		lexer->error((size_t)0, "There is no main function to run");
+
+	const Function* main = &this->program.functions[this->program.main];
+	for (size_t i = 0; i < main->args.size(); i++)
+		this->stack[i] = Value::null();
+	this->top = this->stack;
+	return execute(main, this->stack);
+}
+
+Value VM::call(int id, const Value* args, int argc, const Instruction* ins)
+{
+	const Function* function = &this->program.functions[id];
+	Value* base = this->top;
+	if (this->frames.size() >= VM_MAX_FRAMES || base + function->registers > this->stack + VM_STACK_SIZE)
+		Runtime::error(ins, "Stack overflow, calling %s", function->name.c_str());
+
+	for (int i = 0; i < argc; i++)
+		base[i] = args[i];
+	Value result = execute(function, base);
+	this->top = base;
+	return result;
+}
+
+Value VM::execute(const Function* function, Value* base)
+{
+	size_t entry_frames = this->frames.size();
+	const Instruction* ip = function->code.data();
+	const Instruction* ins;
+	const Value* K = function->constants.data();
+	InlineCache* C = caches_of(function);
+	enter(function, base);
+
+#define R(x) base[x]
+#define ARITH(expr_op) \
+	if (R(ins->b).is_num() && R(ins->c).is_num()) \
+		R(ins->a) = Value::from_num(R(ins->b).as_num() expr_op R(ins->c).as_num()); \
+	else R(ins->a) = Runtime::arith(ins->op, R(ins->b), R(ins->c), ins);
+#define COMPARE(expr_op) \
+	if (R(ins->b).is_num() && R(ins->c).is_num()) \
+		R(ins->a) = Value::from_bool(R(ins->b).as_num() expr_op R(ins->c).as_num()); \
+	else R(ins->a) = Value::from_bool(Runtime::compare(ins->op, R(ins->b), R(ins->c), ins));
+
+	// Threaded dispatch, every instruction jumps straight to the next one's handler
+#if defined(__GNUC__)
+	static const void* labels[] = {
+#define OPCODE(id, fmt) &&L_##id,
+#include "opcodes.inc"
+#undef OPCODE
+	};
+#define DISPATCH() do { ins = ip++; goto *labels[static_cast<uint8_t>(ins->op)]; } while (0)
+#define CASE(id) L_##id
+#else
+#define DISPATCH() goto dispatch
+#define CASE(id) case opcode::id
+#endif
+
+#if defined(__GNUC__)
+	DISPATCH();
+	{
+#else
+dispatch:
+	ins = ip++;
+	switch (ins->op)
+	{
+#endif
+	CASE(MOVE):
+		R(ins->a) = R(ins->b);
+		DISPATCH();
+	CASE(LOADK):
+		R(ins->a) = K[ins->bx()];
+		DISPATCH();
+	CASE(LOADNULL):
+		R(ins->a) = Value::null();
+		DISPATCH();
+	CASE(LOADTRUE):
+		R(ins->a) = Value::from_bool(true);
+		DISPATCH();
+	CASE(LOADFALSE):
+		R(ins->a) = Value::from_bool(false);
+		DISPATCH();
+	CASE(GETGLOBAL):
+		R(ins->a) = this->globals[ins->bx()];
+		DISPATCH();
+	CASE(SETGLOBAL):
+		this->globals[ins->bx()] = R(ins->a);
+		DISPATCH();
+
+	CASE(ADD):
+		ARITH(+)
+		DISPATCH();
+	CASE(SUB):
+		ARITH(-)
+		DISPATCH();
+	CASE(MUL):
+		ARITH(*)
+		DISPATCH();
+	CASE(DIV):
+		ARITH(/)
+		DISPATCH();
+	CASE(MOD):
+	CASE(POW):
+		R(ins->a) = Runtime::arith(ins->op, R(ins->b), R(ins->c), ins);
+		DISPATCH();
+	CASE(CONCAT):
+		R(ins->a) = Runtime::concat(&R(ins->b), ins->c, ins);
+		DISPATCH();
+	CASE(NEG):
+		R(ins->a) = Runtime::neg(R(ins->b), ins);
+		DISPATCH();
+	CASE(NOT):
+		R(ins->a) = Value::from_bool(!is_truthy(R(ins->b)));
+		DISPATCH();
+	CASE(TEST):
+		R(ins->a) = Value::from_bool(is_truthy(R(ins->b)));
+		DISPATCH();
+	CASE(TOINT):
+		R(ins->a) = Runtime::toint(R(ins->a));
+		DISPATCH();
+
+	CASE(EQ):
+		R(ins->a) = Value::from_bool(values_equal(R(ins->b), R(ins->c)));
+		DISPATCH();
+	CASE(NEQ):
+		R(ins->a) = Value::from_bool(!values_equal(R(ins->b), R(ins->c)));
+		DISPATCH();
+	CASE(LT):
+		COMPARE(<)
+		DISPATCH();
+	CASE(LEQ):
+		COMPARE(<=)
+		DISPATCH();
+	CASE(GT):
+		COMPARE(>)
+		DISPATCH();
+	CASE(GEQ):
+		COMPARE(>=)
+		DISPATCH();
+
+	CASE(JMP):
+		ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(JMPIF):
+		if (is_truthy(R(ins->a)))
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(JMPIFNOT):
+		if (!is_truthy(R(ins->a)))
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(ITERNEXT):
+		if (Runtime::iternext(&R(ins->a), ins))
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+
+	CASE(FORPREP):
+		if (!Runtime::forprep(&R(ins->a), ins))
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(FORLOOP):
+		R(ins->a) = Value::from_num(R(ins->a).as_num() + R(ins->a + 2).as_num());
+		if (--R(ins->a + 1).bits)
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(FORDEC):
+		if (--R(ins->a + 1).bits)
+			ip = function->code.data() + ins->bx();
+		DISPATCH();
+	CASE(VECLOOP):
+		Runtime::vecloop(base, ins);
+		DISPATCH();
+
+	CASE(NEWARR):
+		R(ins->a) = Runtime::newarr(&R(ins->b), ins->c);
+		DISPATCH();
+	CASE(NEWRANGE):
+		R(ins->a) = Runtime::newrange(&R(ins->b), ins);
+		DISPATCH();
+	CASE(GETINDEX):
+		if (R(ins->b).is_arr() && R(ins->c).is_num())
+		{
+			ArrObject* arr = R(ins->b).as_arr();
+			double i = R(ins->c).as_num();
+			if (i >= 0 && i < arr->length)
+			{
+				R(ins->a) = arr->get((size_t)i);
+				DISPATCH();
+			}
+		}
+		R(ins->a) = Runtime::getindex(R(ins->b), R(ins->c), ins);
+		DISPATCH();
+	CASE(GETINBOUNDS):
+		if (R(ins->b).is_arr())
+			R(ins->a) = R(ins->b).as_arr()->get((size_t)R(ins->c).as_num());
+		else
+			R(ins->a) = Runtime::getindex(R(ins->b), R(ins->c), ins);
+		DISPATCH();
+	CASE(SETINDEX):
+		Runtime::setindex(R(ins->a), R(ins->b), R(ins->c), ins);
+		DISPATCH();
+
+	CASE(NEWOBJ):
+		R(ins->a) = Value::from_obj(InstanceObject::create(&this->program.classes[ins->bx()]));
+		DISPATCH();
+	CASE(GETFIELD):
+		R(ins->a) = R(ins->b).as_instance()->fields()[ins->c];
+		DISPATCH();
+	CASE(SETFIELD):
+		R(ins->a).as_instance()->set(ins->b, R(ins->c));
+		DISPATCH();
+	CASE(GETMEMBER):
+		// A class the site has seen is a load from the slot it found there
+		if (R(ins->b).is_instance())
+		{
+			InstanceObject* instance = R(ins->b).as_instance();
+			int32_t slot = C[ins->c].find(instance->cls);
+			if (slot >= 0)
+			{
+				R(ins->a) = instance->fields()[slot];
+				DISPATCH();
+			}
+		}
+		R(ins->a) = Runtime::getmember(R(ins->b), &C[ins->c], ins);
+		DISPATCH();
+	CASE(SETMEMBER):
+		if (R(ins->a).is_instance())
+		{
+			InstanceObject* instance = R(ins->a).as_instance();
+			int32_t slot = C[ins->c].find(instance->cls);
+			if (slot >= 0)
+			{
+				instance->set(slot, R(ins->b));
+				DISPATCH();
+			}
+		}
+		R(ins->b) = Runtime::setmember(R(ins->a), &C[ins->c], R(ins->b), ins);
+		DISPATCH();
+
+	CASE(CALL):
+	{
+		const Function* callee = &this->program.functions[ins->b];
+		if (this->frames.size() >= VM_MAX_FRAMES || base + ins->a + callee->registers > this->stack + VM_STACK_SIZE)
+			Runtime::error(ins, "Stack overflow, calling %s", callee->name.c_str());
+
+		this->frames.push_back(Frame{function, ip, base, this->top});
+		function = callee;
+		base += ins->a;
+		enter(function, base);
+		ip = function->code.data();
+		K = function->constants.data();
+		C = caches_of(function);
+		DISPATCH();
+	}
+	CASE(TAILCALL):
+	{
+		// Nothing is left to do in this frame, so the callee takes its place and returns to our caller
+		const Function* callee = &this->program.functions[ins->b];
+		if (base + callee->registers > this->stack + VM_STACK_SIZE)
+			Runtime::error(ins, "Stack overflow, calling %s", callee->name.c_str());
+
+		for (int i = 0; i < ins->c; i++)
+			base[i] = base[ins->a + i];
+		function = callee;
+		enter(function, base);
+		ip = function->code.data();
+		K = function->constants.data();
+		C = caches_of(function);
+		DISPATCH();
+	}
+	CASE(INVOKE):
+	{
+		int32_t id = R(ins->a).is_instance() ? C[ins->b].find(R(ins->a).as_instance()->cls) : -1;
+		const Function* callee = &this->program.functions[id >= 0 ? id : Runtime::method(R(ins->a), &C[ins->b], ins->c, ins)];
+		if (this->frames.size() >= VM_MAX_FRAMES || base + ins->a + callee->registers > this->stack + VM_STACK_SIZE)
+			Runtime::error(ins, "Stack overflow, calling %s", callee->name.c_str());
+		// The arguments the call left out get the method's defaults
+		for (size_t i = ins->c; i < callee->args.size(); i++)
+			R(ins->a + i) = callee->defaults[i];
+
+		this->frames.push_back(Frame{function, ip, base, this->top});
+		function = callee;
+		base += ins->a;
+		enter(function, base);
+		ip = function->code.data();
+		K = function->constants.data();
+		C = caches_of(function);
+		DISPATCH();
+	}
+	CASE(CALLBUILTIN):
+		R(ins->a) = builtins[ins->b].fn(&R(ins->a), ins->c);
+		DISPATCH();
+	CASE(RET):
+	CASE(RETNULL):
+	{
+		Value result = ins->op == opcode::RET ? R(ins->a) : Value::null();
+		if (this->frames.size() == entry_frames)
+			return result;
+
+		// The callee's frame started at the register the caller wants the result in
+		base[0] = result;
+		Frame frame = this->frames.back();
+		this->frames.pop_back();
+		function = frame.function;
+		ip = frame.ip;
+		base = frame.base;
+		this->top = frame.top;
+		K = function->constants.data();
+		C = caches_of(function);
+		DISPATCH();
+	}
+
+	CASE(PROBE):
+		Runtime::counts[ins->bx()]++;
+		DISPATCH();
+#if !defined(__GNUC__)
+	default:
+		break;
+#endif
+	}
+
+#undef R
+#undef ARITH
+#undef COMPARE
+#undef DISPATCH
+#undef CASE
+
+	lexer->error(function->position, ERROR_WE_DONT_KNOW);
+	return Value::null();
+}
@@ -0,0 +1,61 @@
+#ifndef VM_VM_HPP
+#define VM_VM_HPP
+
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+#include "../lexer/lexer.hpp"
+#include "../macros.hpp"
+
+using std::string;
+using std::vector;
+
+// How many registers all the frames together can use, and how deep the calls can go
+#define VM_STACK_SIZE (1 << 20)
+#define VM_MAX_FRAMES (1 << 16)
+
+// Runs the bytecode, runtime errors point at the source like compile errors do
+class VM
+{
+private:
+	struct Frame
+	{
+		const Function* function;
+		const Instruction* ip; // Where to continue when the callee returns
+		Value* base;
+		Value* top; // The caller's top
+	};
+
+	Lexer* lexer;
+	const Program& program;
+	vector<Value> globals;
+	Value* stack;
+	Value* top; // The end of the registers the running frames use, the collector scans up to here
+	vector<Frame> frames;
+	vector<vector<InlineCache>> caches; // By function, one for each of its sites
+public:
+	VM(Lexer* lexer, const Program& program);
+	~VM();
+
+	// Runs the top level statements and then main, returns what main returned
+	Value run();
+	// Runs a function in a new frame past the running ones, for the runtime's calls like operators of classes
+	Value call(int function, const Value* args, int argc, const Instruction* ins);
+private:
+	Value execute(const Function* function, Value* base);
+
+	inline InlineCache* caches_of(const Function* function) { return this->caches[function - this->program.functions.data()].data(); }
+
+	// A frame is starting, its registers past the arguments might have anything from older frames in them
+	inline void enter(const Function* function, Value* base)
+	{
+		for (int i = function->args.size(); i < function->registers; i++)
+			base[i] = Value::null();
+		if (base + function->registers > this->top)
+			this->top = base + function->registers;
+	}
+};
+
+#endif // VM_VM_HPP
@@ -0,0 +1,176 @@
+#include "x64.hpp"
+
+#include <string.h>
+
+namespace X64
+{
+// Writes the bytes of one instruction, with the REX prefix and ModRM the operands need
+class Encoder
+{
+public:
+	vector<uint8_t> out;
+
+	inline void byte(uint8_t b) { out.push_back(b); }
+	inline void dword(uint32_t d) { for (int i = 0; i < 4; i++) byte(d >> (i * 8)); }
+	inline void qword(uint64_t q) { for (int i = 0; i < 8; i++) byte(q >> (i * 8)); }
+
+	// force makes byte registers 4-7 mean spl, bpl, sil and dil instead of ah, ch, dh and bh
+	inline void rex(bool w, uint8_t reg, uint8_t rm, bool force = false)
+	{
+		uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+		if (r != 0x40 || force)
+			byte(r);
+	}
+
+	// reg, [base + disp]
+	inline void mem(uint8_t reg, uint8_t base, int32_t disp)
+	{
+		uint8_t mod = disp == 0 && (base & 7) != RBP ? 0 : (disp >= -128 && disp <= 127 ? 1 : 2);
+		byte((mod << 6) | ((reg & 7) << 3) | (base & 7));
+		if ((base & 7) == RSP)
+			byte(0x24); // SIB with no index
+		if (mod == 1) byte((uint8_t)disp);
+		else if (mod == 2) dword(disp);
+	}
+
+	// reg, rm both registers
+	inline void regs(uint8_t reg, uint8_t rm)
+	{
+		byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// An SSE instruction: prefix, REX, 0F opcode and a memory or register operand
+	inline void sse_mem(uint8_t prefix, bool w, uint8_t opcode, uint8_t reg, uint8_t base, int32_t disp)
+	{
+		byte(prefix);
+		rex(w, reg, base);
+		byte(0x0f);
+		byte(opcode);
+		mem(reg, base, disp);
+	}
+	inline void sse_regs(uint8_t prefix, bool w, uint8_t opcode, uint8_t reg, uint8_t rm)
+	{
+		byte(prefix);
+		rex(w, reg, rm);
+		byte(0x0f);
+		byte(opcode);
+		regs(reg, rm);
+	}
+};
+
+Code Assembler::encode() const
+{
+	Encoder e;
+	vector<size_t> label_at(this->labels, (size_t)-1);
+	vector<bool> label_cold(this->labels, false);
+	vector<pair<size_t, int>> fixups; // Where a rel32 to a label is, and the label
+	size_t hot = (size_t)-1;
+
+	for (size_t i = 0; i < this->code.size(); i++)
+	{
+		const MInst& ins = this->code[i];
+		if (i == this->split)
+			hot = e.out.size();
+		switch (ins.op)
+		{
+		case MOp::LABEL: label_at[ins.label] = e.out.size(); label_cold[ins.label] = i >= this->split; break;
+		case MOp::NOP: break;
+		case MOp::MOV_RR: e.rex(true, ins.r2, ins.r1); e.byte(0x89); e.regs(ins.r2, ins.r1); break;
+		case MOp::MOV_RM: e.rex(true, ins.r1, ins.r2); e.byte(0x8b); e.mem(ins.r1, ins.r2, ins.disp); break;
+		case MOp::MOV_MR: e.rex(true, ins.r2, ins.r1); e.byte(0x89); e.mem(ins.r2, ins.r1, ins.disp); break;
+		case MOp::MOV32_RM: e.rex(false, ins.r1, ins.r2); e.byte(0x8b); e.mem(ins.r1, ins.r2, ins.disp); break;
+		case MOp::MOV_RI:
+			if (ins.imm >= 0 && ins.imm <= 0xffffffffll)
+			{
+				// mov r32, imm32 clears the upper half
+				e.rex(false, 0, ins.r1);
+				e.byte(0xb8 + (ins.r1 & 7));
+				e.dword(ins.imm);
+			}
+			else if (ins.imm >= INT32_MIN && ins.imm <= INT32_MAX)
+			{
+				e.rex(true, 0, ins.r1);
+				e.byte(0xc7);
+				e.regs(0, ins.r1);
+				e.dword(ins.imm);
+			}
+			else
+			{
+				e.rex(true, 0, ins.r1);
+				e.byte(0xb8 + (ins.r1 & 7));
+				e.qword(ins.imm);
+			}
+			break;
+		case MOp::MOV_MI: e.rex(true, 0, ins.r1); e.byte(0xc7); e.mem(0, ins.r1, ins.disp); e.dword(ins.imm); break;
+		case MOp::MOV8_MI: e.rex(false, 0, ins.r1); e.byte(0xc6); e.mem(0, ins.r1, ins.disp); e.byte(ins.imm); break;
+		case MOp::MOV8_MR: e.rex(false, ins.r2, ins.r1, ins.r2 >= 4); e.byte(0x88); e.mem(ins.r2, ins.r1, ins.disp); break;
+		case MOp::LEA: e.rex(true, ins.r1, ins.r2); e.byte(0x8d); e.mem(ins.r1, ins.r2, ins.disp); break;
+		case MOp::ADD_RR: e.rex(true, ins.r2, ins.r1); e.byte(0x01); e.regs(ins.r2, ins.r1); break;
+		case MOp::ADD_RI: case MOp::SUB_RI: case MOp::CMP_RI:
+		{
+			uint8_t ext = ins.op == MOp::ADD_RI ? 0 : ins.op == MOp::SUB_RI ? 5 : 7;
+			e.rex(true, 0, ins.r1);
+			if (ins.imm >= -128 && ins.imm <= 127) { e.byte(0x83); e.regs(ext, ins.r1); e.byte(ins.imm); }
+			else { e.byte(0x81); e.regs(ext, ins.r1); e.dword(ins.imm); }
+			break;
+		}
+		case MOp::AND_RR: e.rex(true, ins.r2, ins.r1); e.byte(0x21); e.regs(ins.r2, ins.r1); break;
+		case MOp::XOR_RR: e.rex(true, ins.r2, ins.r1); e.byte(0x31); e.regs(ins.r2, ins.r1); break;
+		case MOp::SHL_RI: e.rex(true, 0, ins.r1); e.byte(0xc1); e.regs(4, ins.r1); e.byte(ins.imm); break;
+		case MOp::CMP_RR: e.rex(true, ins.r2, ins.r1); e.byte(0x39); e.regs(ins.r2, ins.r1); break;
+		case MOp::CMP8_MI: e.rex(false, 0, ins.r1); e.byte(0x80); e.mem(7, ins.r1, ins.disp); e.byte(ins.imm); break;
+		case MOp::CMP32_MI: e.rex(false, 0, ins.r1); e.byte(0x81); e.mem(7, ins.r1, ins.disp); e.dword(ins.imm); break;
+		case MOp::INC32_M: e.rex(false, 0, ins.r1); e.byte(0xff); e.mem(0, ins.r1, ins.disp); break;
+		case MOp::INC_M: e.rex(true, 0, ins.r1); e.byte(0xff); e.mem(0, ins.r1, ins.disp); break;
+		case MOp::DEC_M: e.rex(true, 0, ins.r1); e.byte(0xff); e.mem(1, ins.r1, ins.disp); break;
+		case MOp::AND8_RR: e.rex(false, ins.r2, ins.r1, true); e.byte(0x20); e.regs(ins.r2, ins.r1); break;
+		case MOp::OR8_RR: e.rex(false, ins.r2, ins.r1, true); e.byte(0x08); e.regs(ins.r2, ins.r1); break;
+		case MOp::TEST8_RR: e.rex(false, ins.r2, ins.r1, true); e.byte(0x84); e.regs(ins.r2, ins.r1); break;
+		case MOp::SETCC: e.rex(false, 0, ins.r1, true); e.byte(0x0f); e.byte(0x90 + static_cast<uint8_t>(ins.cc)); e.regs(0, ins.r1); break;
+		case MOp::MOVSD_XM: e.sse_mem(0xf2, false, 0x10, ins.r1, ins.r2, ins.disp); break;
+		case MOp::MOVSD_MX: e.sse_mem(0xf2, false, 0x11, ins.r2, ins.r1, ins.disp); break;
+		case MOp::MOVQ_XR: e.sse_regs(0x66, true, 0x6e, ins.r1, ins.r2); break;
+		case MOp::ADDSD_XM: e.sse_mem(0xf2, false, 0x58, ins.r1, ins.r2, ins.disp); break;
+		case MOp::SUBSD_XM: e.sse_mem(0xf2, false, 0x5c, ins.r1, ins.r2, ins.disp); break;
+		case MOp::MULSD_XM: e.sse_mem(0xf2, false, 0x59, ins.r1, ins.r2, ins.disp); break;
+		case MOp::DIVSD_XM: e.sse_mem(0xf2, false, 0x5e, ins.r1, ins.r2, ins.disp); break;
+		case MOp::ADDSD_XX: e.sse_regs(0xf2, false, 0x58, ins.r1, ins.r2); break;
+		case MOp::UCOMISD_XM: e.sse_mem(0x66, false, 0x2e, ins.r1, ins.r2, ins.disp); break;
+		case MOp::CVTTSD2SI: e.sse_regs(0xf2, true, 0x2c, ins.r1, ins.r2); break;
+		case MOp::CVTSI2SD: e.sse_regs(0xf2, true, 0x2a, ins.r1, ins.r2); break;
+		case MOp::PUSH: e.rex(false, 0, ins.r1); e.byte(0x50 + (ins.r1 & 7)); break;
+		case MOp::POP: e.rex(false, 0, ins.r1); e.byte(0x58 + (ins.r1 & 7)); break;
+		case MOp::CALL_R: e.rex(false, 0, ins.r1); e.byte(0xff); e.regs(2, ins.r1); break;
+		case MOp::CALL_M: e.rex(false, 0, ins.r1); e.byte(0xff); e.mem(2, ins.r1, ins.disp); break;
+		case MOp::JMP:
+			e.byte(0xe9);
+			fixups.push_back({e.out.size(), ins.label});
+			e.dword(0);
+			break;
+		case MOp::JMP_M: e.rex(false, 0, ins.r1); e.byte(0xff); e.mem(4, ins.r1, ins.disp); break;
+		case MOp::JCC:
+			e.byte(0x0f);
+			e.byte(0x80 + static_cast<uint8_t>(ins.cc));
+			fixups.push_back({e.out.size(), ins.label});
+			e.dword(0);
+			break;
+		case MOp::RET: e.byte(0xc3); break;
+		}
+	}
+
+	if (hot == (size_t)-1)
+		hot = e.out.size();
+
+	// rel32 is relative to the end of the instruction, which is right after it
+	vector<size_t> crossing;
+	for (auto& fixup : fixups)
+	{
+		int32_t rel = (int32_t)(label_at[fixup.second] - (fixup.first + 4));
+		memcpy(&e.out[fixup.first], &rel, 4);
+		if ((fixup.first >= hot) != label_cold[fixup.second])
+			crossing.push_back(fixup.first);
+	}
+
+	return Code{e.out, hot, crossing};
+}
+}
@@ -0,0 +1,189 @@
+#ifndef VM_X64_HPP
+#define VM_X64_HPP
+
+#include <vector>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+using std::vector;
+using std::pair;
+
+// A tiny x86-64 assembler for the JIT, code is built as a list of machine instructions
+// first so passes can look at it, and only then encoded into bytes
+namespace X64
+{
+enum Reg : uint8_t
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+};
+// The xmm registers use the same numbers
+enum Xmm : uint8_t
+{
+	XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+};
+enum class Cond : uint8_t
+{
+	O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G,
+};
+
+inline Cond negate(Cond cc) { return static_cast<Cond>(static_cast<uint8_t>(cc) ^ 1); }
+
+// [base + disp]
+struct Mem
+{
+	Reg base;
+	int32_t disp;
+};
+
+enum class MOp : uint8_t
+{
+	LABEL,			// label:
+	MOV_RR,			// mov r1, r2
+	MOV_RM,			// mov r1, qword [r2 + disp]
+	MOV_MR,			// mov qword [r1 + disp], r2
+	MOV32_RM,		// mov r1d, dword [r2 + disp], clears the upper half
+	MOV_RI,			// mov r1, imm
+	MOV_MI,			// mov qword [r1 + disp], imm32
+	MOV8_MI,		// mov byte [r1 + disp], imm8
+	MOV8_MR,		// mov byte [r1 + disp], r2b
+	LEA,			// lea r1, [r2 + disp]
+	ADD_RR,			// add r1, r2
+	ADD_RI,			// add r1, imm32
+	SUB_RI,			// sub r1, imm32
+	AND_RR,			// and r1, r2
+	XOR_RR,			// xor r1, r2
+	SHL_RI,			// shl r1, imm8
+	CMP_RR,			// cmp r1, r2
+	CMP_RI,			// cmp r1, imm32
+	CMP8_MI,		// cmp byte [r1 + disp], imm8
+	CMP32_MI,		// cmp dword [r1 + disp], imm32
+	INC32_M,		// inc dword [r1 + disp]
+	INC_M,			// inc qword [r1 + disp]
+	DEC_M,			// dec qword [r1 + disp]
+	AND8_RR,		// and r1b, r2b
+	OR8_RR,			// or r1b, r2b
+	TEST8_RR,		// test r1b, r2b
+	SETCC,			// setcc r1b
+	MOVSD_XM,		// movsd x1, [r2 + disp]
+	MOVSD_MX,		// movsd [r1 + disp], x2
+	MOVQ_XR,		// movq x1, r2
+	ADDSD_XM,		// addsd x1, [r2 + disp]
+	SUBSD_XM,		// subsd x1, [r2 + disp]
+	MULSD_XM,		// mulsd x1, [r2 + disp]
+	DIVSD_XM,		// divsd x1, [r2 + disp]
+	ADDSD_XX,		// addsd x1, x2
+	UCOMISD_XM,		// ucomisd x1, [r2 + disp]
+	CVTTSD2SI,		// cvttsd2si r1, x2
+	CVTSI2SD,		// cvtsi2sd x1, r2
+	PUSH,			// push r1
+	POP,			// pop r1
+	CALL_R,			// call r1
+	CALL_M,			// call qword [r1 + disp]
+	JMP,			// jmp label
+	JMP_M,			// jmp qword [r1 + disp]
+	JCC,			// jcc label
+	RET,			// ret
+	NOP,			// Nothing, what passes leave behind when they remove an instruction
+};
+
+struct MInst
+{
+	MOp op;
+	uint8_t r1;
+	uint8_t r2;
+	Cond cc;
+	int32_t disp;
+	int64_t imm;
+	int label;
+};
+
+// Encoded machine code in two parts, the hot one and then the cold one. Installing them apart only has to fix
+// the jumps from one to the other by how far they moved
+struct Code
+{
+	vector<uint8_t> bytes;
+	size_t hot; // The size of the hot part, the cold one is the rest
+	vector<size_t> crossing; // Where the rel32 of every jump from one part to the other is
+};
+
+class Assembler
+{
+private:
+	vector<MInst> code;
+	int labels;
+	size_t split; // The first instruction of the cold part
+public:
+	Assembler() : labels(0), split((size_t)-1) {}
+
+	inline int new_label() { return this->labels++; }
+	inline int label_count() const { return this->labels; }
+	inline vector<MInst>& instructions() { return this->code; }
+	inline const vector<MInst>& instructions() const { return this->code; }
+	inline size_t cold_start() const { return this->split; }
+
+	inline void bind(int label) { add(MOp::LABEL, 0, 0, 0, 0, label); }
+	inline void mov(Reg dst, Reg src) { add(MOp::MOV_RR, dst, src); }
+	inline void mov(Reg dst, Mem src) { add(MOp::MOV_RM, dst, src.base, src.disp); }
+	inline void mov(Mem dst, Reg src) { add(MOp::MOV_MR, dst.base, src, dst.disp); }
+	inline void mov32(Reg dst, Mem src) { add(MOp::MOV32_RM, dst, src.base, src.disp); }
+	inline void mov(Reg dst, int64_t imm) { add(MOp::MOV_RI, dst, 0, 0, imm); }
+	inline void mov(Mem dst, int32_t imm) { add(MOp::MOV_MI, dst.base, 0, dst.disp, imm); }
+	inline void mov8(Mem dst, int8_t imm) { add(MOp::MOV8_MI, dst.base, 0, dst.disp, imm); }
+	inline void mov8(Mem dst, Reg src) { add(MOp::MOV8_MR, dst.base, src, dst.disp); }
+	inline void lea(Reg dst, Mem src) { add(MOp::LEA, dst, src.base, src.disp); }
+	inline void add_(Reg dst, Reg src) { add(MOp::ADD_RR, dst, src); }
+	inline void add_(Reg dst, int32_t imm) { add(MOp::ADD_RI, dst, 0, 0, imm); }
+	inline void sub(Reg dst, int32_t imm) { add(MOp::SUB_RI, dst, 0, 0, imm); }
+	inline void and_(Reg dst, Reg src) { add(MOp::AND_RR, dst, src); }
+	inline void xor_(Reg dst, Reg src) { add(MOp::XOR_RR, dst, src); }
+	inline void shl(Reg dst, int8_t imm) { add(MOp::SHL_RI, dst, 0, 0, imm); }
+	inline void cmp(Reg a, Reg b) { add(MOp::CMP_RR, a, b); }
+	inline void cmp(Reg a, int32_t imm) { add(MOp::CMP_RI, a, 0, 0, imm); }
+	inline void cmp8(Mem a, int8_t imm) { add(MOp::CMP8_MI, a.base, 0, a.disp, imm); }
+	inline void cmp32(Mem a, int32_t imm) { add(MOp::CMP32_MI, a.base, 0, a.disp, imm); }
+	inline void inc32(Mem a) { add(MOp::INC32_M, a.base, 0, a.disp); }
+	inline void inc(Mem a) { add(MOp::INC_M, a.base, 0, a.disp); }
+	inline void dec(Mem a) { add(MOp::DEC_M, a.base, 0, a.disp); }
+	inline void and8(Reg dst, Reg src) { add(MOp::AND8_RR, dst, src); }
+	inline void or8(Reg dst, Reg src) { add(MOp::OR8_RR, dst, src); }
+	inline void test8(Reg a, Reg b) { add(MOp::TEST8_RR, a, b); }
+	inline void setcc(Cond cc, Reg dst) { add(MOp::SETCC, dst, 0, 0, 0, 0, cc); }
+	inline void movsd(Xmm dst, Mem src) { add(MOp::MOVSD_XM, dst, src.base, src.disp); }
+	inline void movsd(Mem dst, Xmm src) { add(MOp::MOVSD_MX, dst.base, src, dst.disp); }
+	inline void movq(Xmm dst, Reg src) { add(MOp::MOVQ_XR, dst, src); }
+	inline void addsd(Xmm dst, Mem src) { add(MOp::ADDSD_XM, dst, src.base, src.disp); }
+	inline void subsd(Xmm dst, Mem src) { add(MOp::SUBSD_XM, dst, src.base, src.disp); }
+	inline void mulsd(Xmm dst, Mem src) { add(MOp::MULSD_XM, dst, src.base, src.disp); }
+	inline void divsd(Xmm dst, Mem src) { add(MOp::DIVSD_XM, dst, src.base, src.disp); }
+	inline void addsd(Xmm dst, Xmm src) { add(MOp::ADDSD_XX, dst, src); }
+	inline void ucomisd(Xmm a, Mem b) { add(MOp::UCOMISD_XM, a, b.base, b.disp); }
+	inline void cvttsd2si(Reg dst, Xmm src) { add(MOp::CVTTSD2SI, dst, src); }
+	inline void cvtsi2sd(Xmm dst, Reg src) { add(MOp::CVTSI2SD, dst, src); }
+	inline void push(Reg r) { add(MOp::PUSH, r); }
+	inline void pop(Reg r) { add(MOp::POP, r); }
+	inline void call(Reg r) { add(MOp::CALL_R, r); }
+	inline void call(Mem m) { add(MOp::CALL_M, m.base, 0, m.disp); }
+	inline void jmp(int label) { add(MOp::JMP, 0, 0, 0, 0, label); }
+	inline void jmp(Mem m) { add(MOp::JMP_M, m.base, 0, m.disp); }
+	inline void jcc(Cond cc, int label) { add(MOp::JCC, 0, 0, 0, 0, label, cc); }
+	inline void ret() { add(MOp::RET); }
+
+	// Calls a C function at a fixed address, the arguments have to be in place already
+	inline void call(const void* fn) { mov(RAX, (int64_t)(intptr_t)fn); call(RAX); }
+
+	// Everything from here on is cold
+	inline void cold() { this->split = this->code.size(); }
+
+	// Turns the list into machine code, jumps to labels are resolved here
+	Code encode() const;
+private:
+	inline void add(MOp op, uint8_t r1 = 0, uint8_t r2 = 0, int32_t disp = 0, int64_t imm = 0, int label = -1, Cond cc = Cond::O)
+	{
+		this->code.push_back(MInst{op, r1, r2, cc, disp, imm, label});
+	}
+};
+}
+
+#endif // VM_X64_HPP
@@ -0,0 +1,444 @@
+// Runs every rule of the JIT's peephole pass on its own, on instructions it has to rewrite and on ones it
+// has to leave alone, usage:
+//	rules
+// A case that doesn't rewrite has to leave every instruction as it was. Prints the cases that fail and exits
+// with 1 if there's any, or if a rule has no case of either kind
+
+#include "../../src/vm/peephole.hpp"
+
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+
+using namespace X64;
+
+typedef std::function<void(Assembler&)> Build;
+typedef std::function<bool(const vector<MInst>&)> Check;
+
+static int cases = 0;
+static int failures = 0;
+static vector<int> matching(peephole_rule_count, 0);
+static vector<int> other(peephole_rule_count, 0);
+
+static size_t find_rule(const char* name)
+{
+	for (size_t i = 0; i < peephole_rule_count; i++)
+		if (strcmp(peephole_rules[i].name, name) == 0)
+			return i;
+	fprintf(stderr, "There's no peephole rule %s\n", name);
+	exit(1);
+}
+
+static bool same(const MInst& a, const MInst& b)
+{
+	return a.op == b.op && a.r1 == b.r1 && a.r2 == b.r2 && a.cc == b.cc && a.disp == b.disp && a.imm == b.imm && a.label == b.label;
+}
+
+// Binds the labels like the pass does and runs the rule once at every instruction
+static size_t run(const PeepholeRule& rule, Assembler& as)
+{
+	vector<MInst>& code = as.instructions();
+	Peephole p{code, as.cold_start(), {}};
+	p.bound.assign(as.label_count(), code.size());
+	for (size_t i = 0; i < code.size(); i++)
+		if (code[i].op == MOp::LABEL)
+			p.bound[code[i].label] = i;
+
+	size_t rewrites = 0;
+	for (size_t i = 0; i < code.size(); i++)
+		if (code[i].op != MOp::NOP)
+			rewrites += rule.rewrite(p, i);
+	return rewrites;
+}
+
+// The rule has to rewrite the code and check has to hold for what it leaves
+static void rewrites(const char* name, const char* what, const Build& build, const Check& check)
+{
+	size_t rule = find_rule(name);
+	Assembler as;
+	build(as);
+	cases++;
+	matching[rule]++;
+	if (run(peephole_rules[rule], as) == 0 || !check(as.instructions()))
+	{
+		printf("%s: %s, expected a rewrite\n", name, what);
+		failures++;
+	}
+}
+
+// The rule can't change anything
+static void keeps(const char* name, const char* what, const Build& build)
+{
+	size_t rule = find_rule(name);
+	Assembler as;
+	build(as);
+	vector<MInst> before = as.instructions();
+	cases++;
+	other[rule]++;
+	size_t count = run(peephole_rules[rule], as);
+	bool changed = count != 0;
+	for (size_t i = 0; i < before.size(); i++)
+		changed |= !same(before[i], as.instructions()[i]);
+	if (changed)
+	{
+		printf("%s: %s, expected nothing to change\n", name, what);
+		failures++;
+	}
+}
+
+static bool is(const MInst& ins, MOp op) { return ins.op == op; }
+
+static void self_move()
+{
+	rewrites("self_move", "mov rax, rax", [](Assembler& as) { as.mov(RAX, RAX); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::NOP); });
+	keeps("self_move", "mov rax, rcx", [](Assembler& as) { as.mov(RAX, RCX); as.ret(); });
+}
+
+static void add_zero()
+{
+	rewrites("add_zero", "add rsp, 0 before a ret", [](Assembler& as) { as.add_(RSP, 0); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::NOP); });
+	rewrites("add_zero", "sub rax, 0 with the flags written again before the jcc", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.sub(RAX, 0); as.cmp(RAX, 1); as.jcc(Cond::E, l); as.bind(l); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[0], MOp::NOP); });
+	keeps("add_zero", "add rax, 1", [](Assembler& as) { as.add_(RAX, 1); as.ret(); });
+	keeps("add_zero", "add rax, 0 with a jcc reading the flags", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.add_(RAX, 0); as.jcc(Cond::E, l); as.bind(l); as.ret();
+	});
+	keeps("add_zero", "add rax, 0 before an inc that leaves the carry", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.add_(RAX, 0); as.inc(Mem{RBX, 0}); as.jcc(Cond::B, l); as.bind(l); as.ret();
+	});
+	keeps("add_zero", "add rax, 0 before a jmp, where it goes could read the flags", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.add_(RAX, 0); as.jmp(l); as.ret(); as.bind(l); as.jcc(Cond::E, l); as.ret();
+	});
+}
+
+static void lea_zero()
+{
+	rewrites("lea_zero", "lea rax, [rcx + 0]", [](Assembler& as) { as.lea(RAX, Mem{RCX, 0}); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::MOV_RR) && c[0].r1 == RAX && c[0].r2 == RCX; });
+	rewrites("lea_zero", "lea rax, [rax + 0]", [](Assembler& as) { as.lea(RAX, Mem{RAX, 0}); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::NOP); });
+	keeps("lea_zero", "lea rax, [rcx + 8]", [](Assembler& as) { as.lea(RAX, Mem{RCX, 8}); as.ret(); });
+}
+
+static void move_add()
+{
+	rewrites("move_add", "mov rax, rcx; add rax, 16", [](Assembler& as) { as.mov(RAX, RCX); as.add_(RAX, 16); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::LEA) && c[0].r2 == RCX && c[0].disp == 16 && is(c[1], MOp::NOP); });
+	keeps("move_add", "mov rax, rcx; add rdx, 16", [](Assembler& as) { as.mov(RAX, RCX); as.add_(RDX, 16); as.ret(); });
+	keeps("move_add", "mov rax, rcx; add rax, 16 with a jcc reading the flags", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.mov(RAX, RCX); as.add_(RAX, 16); as.jcc(Cond::S, l); as.bind(l); as.ret();
+	});
+}
+
+static void reload()
+{
+	rewrites("reload", "mov [rbx + 8], rax; mov rcx, [rbx + 8]", [](Assembler& as)
+	{
+		as.mov(Mem{RBX, 8}, RAX); as.mov(RCX, Mem{RBX, 8}); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[1], MOp::MOV_RR) && c[1].r1 == RCX && c[1].r2 == RAX; });
+	rewrites("reload", "mov [rbx + 8], rax; mov rax, [rbx + 8]", [](Assembler& as)
+	{
+		as.mov(Mem{RBX, 8}, RAX); as.mov(RAX, Mem{RBX, 8}); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[0], MOp::MOV_MR) && is(c[1], MOp::NOP); });
+	keeps("reload", "a load 4 bytes into the store", [](Assembler& as) { as.mov(Mem{RBX, 8}, RAX); as.mov(RCX, Mem{RBX, 12}); as.ret(); });
+	keeps("reload", "a load 8 bytes after the store", [](Assembler& as) { as.mov(Mem{RBX, 8}, RAX); as.mov(RCX, Mem{RBX, 16}); as.ret(); });
+	keeps("reload", "a load from another base", [](Assembler& as) { as.mov(Mem{RBX, 8}, RAX); as.mov(RCX, Mem{RDX, 8}); as.ret(); });
+}
+
+static void store_back()
+{
+	rewrites("store_back", "mov rax, [rbx + 8]; mov [rbx + 8], rax", [](Assembler& as)
+	{
+		as.mov(RAX, Mem{RBX, 8}); as.mov(Mem{RBX, 8}, RAX); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[0], MOp::MOV_RM) && is(c[1], MOp::NOP); });
+	keeps("store_back", "a load over its own base", [](Assembler& as) { as.mov(RBX, Mem{RBX, 8}); as.mov(Mem{RBX, 8}, RBX); as.ret(); });
+	keeps("store_back", "a store 8 bytes away", [](Assembler& as) { as.mov(RAX, Mem{RBX, 8}); as.mov(Mem{RBX, 16}, RAX); as.ret(); });
+	keeps("store_back", "a store of another register", [](Assembler& as) { as.mov(RAX, Mem{RBX, 8}); as.mov(Mem{RBX, 8}, RCX); as.ret(); });
+}
+
+static void same_constant()
+{
+	rewrites("same_constant", "mov rcx, 5 twice", [](Assembler& as)
+	{
+		as.mov(RCX, (int64_t)5); as.mov(RAX, Mem{RBX, 0}); as.mov(RCX, (int64_t)5); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[0], MOp::MOV_RI) && is(c[2], MOp::NOP); });
+	rewrites("same_constant", "xor rcx, rcx; mov rcx, 0", [](Assembler& as) { as.xor_(RCX, RCX); as.mov(RCX, (int64_t)0); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[1], MOp::NOP); });
+	rewrites("same_constant", "mov rbx, 5 across a call, which saves rbx", [](Assembler& as)
+	{
+		as.mov(RBX, (int64_t)5); as.call(RAX); as.mov(RBX, (int64_t)5); as.ret();
+	}, [](const vector<MInst>& c) { return is(c[2], MOp::NOP); });
+	keeps("same_constant", "mov rcx, 5; mov rcx, 6", [](Assembler& as) { as.mov(RCX, (int64_t)5); as.mov(RCX, (int64_t)6); as.ret(); });
+	keeps("same_constant", "mov rcx, 5 across a call, which can change rcx", [](Assembler& as)
+	{
+		as.mov(RCX, (int64_t)5); as.call(RAX); as.mov(RCX, (int64_t)5); as.ret();
+	});
+	keeps("same_constant", "mov rcx, 5 across a label", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.mov(RCX, (int64_t)5); as.bind(l); as.mov(RCX, (int64_t)5); as.jmp(l);
+	});
+}
+
+static void push_pop()
+{
+	rewrites("push_pop", "push rax; pop rcx", [](Assembler& as) { as.push(RAX); as.pop(RCX); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::MOV_RR) && c[0].r1 == RCX && c[0].r2 == RAX && is(c[1], MOp::NOP); });
+	rewrites("push_pop", "push rax; pop rax", [](Assembler& as) { as.push(RAX); as.pop(RAX); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::NOP) && is(c[1], MOp::NOP); });
+	keeps("push_pop", "push rax; mov rdx, rsi; pop rcx", [](Assembler& as) { as.push(RAX); as.mov(RDX, RSI); as.pop(RCX); as.ret(); });
+}
+
+// setcc rax; <between>; test rax, rax; jcc l; mov rax, 1; l: <at the label>; ret
+static void setcc(Assembler& as, Cond jump, const Build& between, const Build& at_label)
+{
+	int l = as.new_label();
+	as.setcc(Cond::L, RAX);
+	between(as);
+	as.test8(RAX, RAX);
+	as.jcc(jump, l);
+	as.mov(RAX, (int64_t)1);
+	as.bind(l);
+	at_label(as);
+	as.ret();
+}
+
+static void setcc_branch()
+{
+	Build nothing = [](Assembler&) {};
+	auto jumps = [](Cond cc)
+	{
+		return [cc](const vector<MInst>& c)
+		{
+			for (auto& ins : c)
+				if (is(ins, MOp::TEST8_RR) || (is(ins, MOp::JCC) && ins.cc != cc))
+					return false;
+			return true;
+		};
+	};
+	rewrites("setcc_branch", "setl; test; jne", [&](Assembler& as) { setcc(as, Cond::NE, nothing, nothing); }, jumps(Cond::L));
+	rewrites("setcc_branch", "setl; test; je", [&](Assembler& as) { setcc(as, Cond::E, nothing, nothing); }, jumps(Cond::GE));
+	rewrites("setcc_branch", "setl; mov rcx, rdx; test; jne", [&](Assembler& as)
+	{
+		setcc(as, Cond::NE, [](Assembler& as) { as.mov(RCX, RDX); }, nothing);
+	}, jumps(Cond::L));
+	keeps("setcc_branch", "an add between writes the flags", [&](Assembler& as)
+	{
+		setcc(as, Cond::NE, [](Assembler& as) { as.add_(RCX, 1); }, nothing);
+	});
+	keeps("setcc_branch", "a mov between writes the register", [&](Assembler& as)
+	{
+		setcc(as, Cond::NE, [](Assembler& as) { as.mov(RAX, RDX); }, nothing);
+	});
+	keeps("setcc_branch", "a call between", [&](Assembler& as) { setcc(as, Cond::NE, [](Assembler& as) { as.call(RSI); }, nothing); });
+	keeps("setcc_branch", "jg isn't a test of the register", [&](Assembler& as) { setcc(as, Cond::G, nothing, nothing); });
+	keeps("setcc_branch", "a test of another register", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.setcc(Cond::L, RAX); as.test8(RCX, RCX); as.jcc(Cond::NE, l); as.bind(l); as.ret();
+	});
+	keeps("setcc_branch", "the label reads the flags of the test", [&](Assembler& as)
+	{
+		setcc(as, Cond::NE, nothing, [](Assembler& as) { as.setcc(Cond::E, RDX); });
+	});
+	keeps("setcc_branch", "the next instruction reads the flags of the test", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.setcc(Cond::L, RAX); as.test8(RAX, RAX); as.jcc(Cond::NE, l); as.setcc(Cond::E, RDX); as.bind(l); as.ret();
+	});
+}
+
+// <before>; cmp; jcc l; mov rcx, rdx; l: <at the label>; ret
+static void compare(Assembler& as, Cond cc, const Build& before, const Build& cmp, const Build& at_label)
+{
+	int l = as.new_label();
+	before(as);
+	cmp(as);
+	as.jcc(cc, l);
+	as.mov(RCX, RDX);
+	as.bind(l);
+	at_label(as);
+	as.ret();
+}
+
+static void constant_branch()
+{
+	Build nothing = [](Assembler&) {};
+	auto taken = [](const vector<MInst>& c)
+	{
+		for (auto& ins : c)
+			if (is(ins, MOp::CMP_RI) || is(ins, MOp::CMP8_MI) || is(ins, MOp::CMP32_MI) || is(ins, MOp::JCC))
+				return false;
+		for (auto& ins : c)
+			if (is(ins, MOp::JMP))
+				return true;
+		return false;
+	};
+	auto never = [](const vector<MInst>& c)
+	{
+		for (auto& ins : c)
+			if (is(ins, MOp::CMP_RI) || is(ins, MOp::CMP8_MI) || is(ins, MOp::CMP32_MI) || is(ins, MOp::JCC) || is(ins, MOp::JMP))
+				return false;
+		return true;
+	};
+	Build rax3 = [](Assembler& as) { as.mov(RAX, (int64_t)3); };
+	Build rax_1 = [](Assembler& as) { as.mov(RAX, (int64_t)-1); };
+	Build cmp3 = [](Assembler& as) { as.cmp(RAX, 3); };
+	Build cmp1 = [](Assembler& as) { as.cmp(RAX, 1); };
+
+	rewrites("constant_branch", "mov rax, 3; cmp rax, 3; je", [&](Assembler& as) { compare(as, Cond::E, rax3, cmp3, nothing); }, taken);
+	rewrites("constant_branch", "mov rax, 3; cmp rax, 3; jne", [&](Assembler& as) { compare(as, Cond::NE, rax3, cmp3, nothing); }, never);
+	rewrites("constant_branch", "mov rax, -1; cmp rax, 1; jl, signed", [&](Assembler& as) { compare(as, Cond::L, rax_1, cmp1, nothing); }, taken);
+	rewrites("constant_branch", "mov rax, -1; cmp rax, 1; jb, unsigned", [&](Assembler& as) { compare(as, Cond::B, rax_1, cmp1, nothing); }, never);
+	rewrites("constant_branch", "xor rax, rax; cmp rax, 3; jae", [&](Assembler& as)
+	{
+		compare(as, Cond::AE, [](Assembler& as) { as.xor_(RAX, RAX); }, cmp3, nothing);
+	}, never);
+	rewrites("constant_branch", "a byte stored from a register", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(RAX, (int64_t)3); as.mov(Mem{RBX, 16}, RAX); },
+			[](Assembler& as) { as.cmp8(Mem{RBX, 16}, 3); }, nothing);
+	}, taken);
+	rewrites("constant_branch", "a dword stored as a constant, with a store 8 bytes below", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.mov(Mem{RBX, 8}, RAX); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	}, taken);
+	rewrites("constant_branch", "the byte only holds the low 8 bits", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 0x101); }, [](Assembler& as) { as.cmp8(Mem{RBX, 16}, 1); }, nothing);
+	}, taken);
+
+	keeps("constant_branch", "rax loaded from memory", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(RAX, Mem{RBX, 0}); }, cmp3, nothing);
+	});
+	keeps("constant_branch", "rax written by a call", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(RAX, (int64_t)3); as.call(RSI); }, cmp3, nothing);
+	});
+	keeps("constant_branch", "a store 4 bytes into the compared memory", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.mov8(Mem{RBX, 20}, RAX); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	});
+	keeps("constant_branch", "a store 7 bytes below the compared memory", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.mov(Mem{RBX, 9}, RAX); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	});
+	keeps("constant_branch", "a store through another base", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.mov(Mem{RCX, 64}, RAX); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	});
+	keeps("constant_branch", "the base changes after the store", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.mov(RBX, RCX); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	});
+	keeps("constant_branch", "a call after the store", [&](Assembler& as)
+	{
+		compare(as, Cond::E, [](Assembler& as) { as.mov(Mem{RBX, 16}, 7); as.call(RSI); },
+			[](Assembler& as) { as.cmp32(Mem{RBX, 16}, 7); }, nothing);
+	});
+	keeps("constant_branch", "the label reads the flags of the cmp", [&](Assembler& as)
+	{
+		compare(as, Cond::E, rax3, cmp3, [](Assembler& as) { as.setcc(Cond::E, RDX); });
+	});
+	keeps("constant_branch", "the next instruction reads the flags of the cmp", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.mov(RAX, (int64_t)3); as.cmp(RAX, 3); as.jcc(Cond::E, l); as.setcc(Cond::L, RDX); as.bind(l); as.ret();
+	});
+	keeps("constant_branch", "the constant is set before a label", [](Assembler& as)
+	{
+		int l = as.new_label(), loop = as.new_label();
+		as.mov(RAX, (int64_t)3); as.bind(loop); as.cmp(RAX, 3); as.jcc(Cond::E, l); as.add_(RAX, 1); as.jmp(loop);
+		as.bind(l); as.ret();
+	});
+}
+
+static void jump_next()
+{
+	rewrites("jump_next", "jmp l; l:", [](Assembler& as) { int l = as.new_label(); as.jmp(l); as.bind(l); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[0], MOp::NOP); });
+	rewrites("jump_next", "je l; l:", [](Assembler& as) { int l = as.new_label(); as.cmp(RAX, 0); as.jcc(Cond::E, l); as.bind(l); as.ret(); },
+		[](const vector<MInst>& c) { return is(c[1], MOp::NOP); });
+	keeps("jump_next", "jmp l; mov; l:", [](Assembler& as) { int l = as.new_label(); as.jmp(l); as.mov(RAX, RCX); as.bind(l); as.ret(); });
+	keeps("jump_next", "jmp l to the start of the cold part", [](Assembler& as)
+	{
+		int l = as.new_label();
+		as.mov(RAX, RCX); as.jmp(l); as.cold(); as.bind(l); as.ret();
+	});
+}
+
+static void branch_over()
+{
+	rewrites("branch_over", "je l1; jmp l2; l1:", [](Assembler& as)
+	{
+		int l1 = as.new_label(), l2 = as.new_label();
+		as.cmp(RAX, 0); as.jcc(Cond::E, l1); as.jmp(l2); as.bind(l1); as.mov(RAX, RCX); as.bind(l2); as.ret();
+	}, [](const vector<MInst>& c) { return c[1].cc == Cond::NE && c[1].label == 1 && is(c[2], MOp::NOP); });
+	keeps("branch_over", "je l1; jmp l2; mov; l1:", [](Assembler& as)
+	{
+		int l1 = as.new_label(), l2 = as.new_label();
+		as.cmp(RAX, 0); as.jcc(Cond::E, l1); as.jmp(l2); as.mov(RAX, RDX); as.bind(l1); as.mov(RAX, RCX); as.bind(l2); as.ret();
+	});
+}
+
+static void jump_chain()
+{
+	rewrites("jump_chain", "je l1 ... l1: jmp l2", [](Assembler& as)
+	{
+		int l1 = as.new_label(), l2 = as.new_label();
+		as.cmp(RAX, 0); as.jcc(Cond::E, l1); as.ret(); as.bind(l1); as.jmp(l2); as.mov(RAX, RDX); as.bind(l2); as.ret();
+	}, [](const vector<MInst>& c) { return c[1].label == 1; });
+	keeps("jump_chain", "l: jmp l", [](Assembler& as) { int l = as.new_label(); as.mov(RAX, RCX); as.ret(); as.bind(l); as.jmp(l); });
+	keeps("jump_chain", "je l1 ... l1: mov; jmp l2", [](Assembler& as)
+	{
+		int l1 = as.new_label(), l2 = as.new_label();
+		as.cmp(RAX, 0); as.jcc(Cond::E, l1); as.ret(); as.bind(l1); as.mov(RAX, RDX); as.jmp(l2); as.bind(l2); as.ret();
+	});
+}
+
+int main()
+{
+	self_move();
+	add_zero();
+	lea_zero();
+	move_add();
+	reload();
+	store_back();
+	same_constant();
+	push_pop();
+	setcc_branch();
+	constant_branch();
+	jump_next();
+	branch_over();
+	jump_chain();
+
+	for (size_t i = 0; i < peephole_rule_count; i++)
+	{
+		if (matching[i] == 0 || other[i] == 0)
+		{
+			printf("%s: needs a case it rewrites and one it doesn't\n", peephole_rules[i].name);
+			failures++;
+		}
+	}
+	printf("%d cases of %zu rules, %d failures\n", cases, peephole_rule_count, failures);
+	return failures ? 1 : 0;
+}